@@ -0,0 +1,89 @@
+/*
+一个静态GET请求在解析和生成响应时各有多少次堆分配 需要用-DPROFILE_ALLOCS编译
+给了预算时平均每请求超出预算就返回1 可以放进回归检查 没开PROFILE_ALLOCS时只打印提示
+用法: alloc_bench [解析预算] [响应预算] [次数]
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include "../src/buffer/buffer.hpp"
+#include "../src/http/httprequest.hpp"
+#include "../src/http/httpresponse.hpp"
+#include "../src/metrics/allocprofile.hpp"
+
+static const char REQUEST[] =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "User-Agent: alloc_bench\r\n"
+    "Accept: */*\r\n"
+    "Connection: keep-alive\r\n\r\n";
+
+static bool Check(const char* name, const AllocCount& total, long iters, long budget) {
+    double allocs = static_cast<double>(total.allocs) / iters;
+    printf("%-9s %6.2f allocs %8.1f bytes per request", name, allocs, static_cast<double>(total.bytes) / iters);
+    if(budget < 0) {
+        printf("\n");
+        return true;
+    }
+    bool ok = allocs <= budget;
+    printf("  budget %ld %s\n", budget, ok ? "ok" : "EXCEEDED");
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    long parseBudget = argc > 1 ? atol(argv[1]) : -1;
+    long responseBudget = argc > 2 ? atol(argv[2]) : -1;
+    long iters = argc > 3 ? atol(argv[3]) : 100000;
+    if(!AllocProfiler::ENABLED) {
+        printf("built without -DPROFILE_ALLOCS, nothing to measure\n");
+        return 0;
+    }
+
+    char dir[] = "/tmp/alloc_bench.XXXXXX";
+    if(!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string srcDir = dir;
+    std::string file = srcDir + "/index.html";
+    FILE* fp = fopen(file.c_str(), "w");
+    fputs("<html><body>hello</body></html>\n", fp);
+    fclose(fp);
+
+    HttpRequest request;
+    HttpResponse response;
+    ReadBuffer in;
+    Buffer out;
+    AllocCount parse, build;
+    //第一轮让各个缓冲区和容器长到稳定大小 不计入
+    for(long i = -1; i < iters; i++) {
+        AllocCount parseAllocs, buildAllocs;
+        in.Append(REQUEST, sizeof(REQUEST) - 1);
+        {
+            AllocScope scope(AT_PARSE, &parseAllocs);
+            request.Init();
+            if(!request.parse(in) || !request.IsFinished()) {
+                fprintf(stderr, "parse failed\n");
+                return 1;
+            }
+        }
+        {
+            AllocScope scope(AT_RESPONSE, &buildAllocs);
+            response.Init(srcDir, request.path(), request.IsKeepAlive(), -1);
+            response.MakeResponse(out);
+            response.UnmapFile();
+        }
+        out.RetrieveAll();
+        if(i >= 0) {
+            parse += parseAllocs;
+            build += buildAllocs;
+        }
+    }
+    unlink(file.c_str());
+    rmdir(dir);
+
+    bool ok = Check("parse", parse, iters, parseBudget);
+    ok = Check("response", build, iters, responseBudget) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,67 @@
+/*
+Buffer(连续vector式) 和 RingBuffer(镜像环) 在流式负载下的对比
+生产者线程往socketpair里持续写 消费者每次ReadFd后只消费整帧 剩下的半帧留在缓冲区里
+用法: buffer_bench [总MB] [帧长]
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "../src/buffer/buffer.hpp"
+#include "../src/buffer/ringbuffer.hpp"
+
+template<typename Buf>
+static double Run(Buf& buf, size_t totalBytes, size_t frame) {
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    std::thread producer([&] {
+        std::vector<char> chunk(64 * 1024, 'x');
+        size_t sent = 0;
+        while(sent < totalBytes) {
+            ssize_t n = write(sv[0], chunk.data(), std::min(chunk.size(), totalBytes - sent));
+            if(n <= 0) break;
+            sent += n;
+        }
+        shutdown(sv[0], SHUT_WR);
+    });
+
+    auto begin = std::chrono::steady_clock::now();
+    size_t consumed = 0;
+    unsigned long checksum = 0;
+    int err = 0;
+    while(true) {
+        ssize_t n = buf.ReadFd(sv[1], &err);
+        if(n <= 0) break;
+        while(buf.ReadableBytes() >= frame) {
+            checksum += static_cast<unsigned char>(buf.Peek()[frame - 1]);
+            buf.Retrieve(frame);
+            consumed += frame;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    producer.join();
+    close(sv[0]);
+    close(sv[1]);
+    double sec = std::chrono::duration<double>(end - begin).count();
+    if(checksum == 0) printf("(no data)\n");
+    return consumed / sec / (1 << 20);
+}
+
+int main(int argc, char* argv[]) {
+    size_t mb = argc > 1 ? atoi(argv[1]) : 512;
+    size_t frame = argc > 2 ? atoi(argv[2]) : 1500;
+    size_t total = mb << 20;
+
+    Buffer vec(64 * 1024);
+    RingBuffer ring(64 * 1024);
+    if(!ring.IsValid()) {
+        fprintf(stderr, "memfd/mmap mirror not available\n");
+        return 1;
+    }
+    printf("buffer      %8.1f MB/s\n", Run(vec, total, frame));
+    printf("ringbuffer  %8.1f MB/s\n", Run(ring, total, frame));
+    return 0;
+}
@@ -0,0 +1,262 @@
+/*
+端到端压测 进程内起一个服务器(内存里的桩用户存储 临时资源目录) 用loadgen依次跑各个场景
+每个场景的结果是一行JSON 写到-j指定的文件 同时打印摘要
+给了基线(以前某次的结果文件)时逐个场景比较 吞吐下降或修正后的p99上升超过容差就返回2 可以直接当回归门限
+客户端和服务器在同一台机器上抢CPU 只适合和同一台机器上的基线比
+默认socket配置下流水线场景会撞上Nagle加延迟确认(每批约40ms) -o latency可以对比
+用法: e2e_bench [-u] [-o profile] [-r reactors] [-t threads] [-p port] [-c conns] [-C clientthreads] [-d seconds]
+                [-w warmup] [-R rate] [-s scenario,...] [-B bigfileMB] [-j result.json] [-b baseline.json] [-x tolerance%]
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <netinet/in.h>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "loadgen/loadgen.hpp"
+#include "../src/server/webserver.hpp"
+#include "../src/session/sessionstore.hpp"
+
+//不碰磁盘也不阻塞 登录的开销只剩服务器自己的部分
+class StubUserStore: public UserStore {
+public:
+    bool Find(const std::string& name, std::string& pwd) override {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        auto it = m_users.find(name);
+        if(it == m_users.end()) return false;
+        pwd = it->second;
+        return true;
+    }
+
+    bool Insert(const std::string& name, const std::string& pwd) override {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        return m_users.emplace(name, pwd).second;
+    }
+
+    bool IsBlocking() const override { return false; }
+
+private:
+    std::mutex m_mtx;
+    std::unordered_map<std::string, std::string> m_users;
+};
+
+static bool WriteFile(const std::string& path, const std::string& content) {
+    FILE* fp = fopen(path.c_str(), "w");
+    if(!fp) return false;
+    bool ok = fwrite(content.data(), 1, content.size(), fp) == content.size();
+    return fclose(fp) == 0 && ok;
+}
+
+static std::string Page(const char* title, size_t filler) {
+    return std::string("<html><head><title>") + title + "</title></head><body>" + std::string(filler, 'x')
+           + "</body></html>\n";
+}
+
+static bool MakeResources(const std::string& dir, size_t bigBytes) {
+    if(!WriteFile(dir + "/index.html", Page("index", 2048)) || !WriteFile(dir + "/welcome.html", Page("welcome", 512))
+       || !WriteFile(dir + "/error.html", Page("error", 256)) || !WriteFile(dir + "/404.html", Page("404", 128))
+       || !WriteFile(dir + "/403.html", Page("403", 128)) || !WriteFile(dir + "/400.html", Page("400", 128))) {
+        return false;
+    }
+    std::string chunk(1 << 20, 'b');
+    FILE* fp = fopen((dir + "/big.bin").c_str(), "w");
+    if(!fp) return false;
+    for(size_t left = bigBytes; left > 0;) {
+        size_t n = std::min(left, chunk.size());
+        fwrite(chunk.data(), 1, n, fp);
+        left -= n;
+    }
+    return fclose(fp) == 0;
+}
+
+static bool WaitListening(int port) {
+    for(int i = 0; i < 200; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bool ok = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        close(fd);
+        if(ok) return true;
+        usleep(10000);
+    }
+    return false;
+}
+
+//从一行结果里取 "key": 后面的数 after不为空时先跳到after之后再找
+static bool Field(const std::string& line, const char* after, const char* key, double* value) {
+    size_t pos = 0;
+    if(after) {
+        pos = line.find(after);
+        if(pos == std::string::npos) return false;
+    }
+    std::string pattern = std::string("\"") + key + "\":";
+    pos = line.find(pattern, pos);
+    if(pos == std::string::npos) return false;
+    *value = atof(line.c_str() + pos + pattern.size());
+    return true;
+}
+
+static std::string Scenario(const std::string& line) {
+    const std::string key = "\"scenario\":\"";
+    size_t pos = line.find(key);
+    if(pos == std::string::npos) return "";
+    pos += key.size();
+    return line.substr(pos, line.find('"', pos) - pos);
+}
+
+//和基线里同名场景比较 没有对应基线的场景跳过
+static bool Compare(const std::vector<std::string>& results, const char* baselineFile, double tolerance) {
+    std::ifstream in(baselineFile);
+    if(!in) {
+        fprintf(stderr, "cannot read baseline %s\n", baselineFile);
+        return false;
+    }
+    std::unordered_map<std::string, std::string> baseline;
+    std::string line;
+    while(std::getline(in, line)) {
+        std::string name = Scenario(line);
+        if(!name.empty()) baseline[name] = line;
+    }
+    bool ok = true;
+    printf("%-10s %12s %12s %8s %12s %12s %8s\n", "scenario", "base rps", "rps", "delta", "base p99", "p99", "delta");
+    for(auto& cur: results) {
+        std::string name = Scenario(cur);
+        auto it = baseline.find(name);
+        if(it == baseline.end()) continue;
+        double baseRps, rps, baseP99, p99;
+        if(!Field(it->second, nullptr, "rps", &baseRps) || !Field(cur, nullptr, "rps", &rps)
+           || !Field(it->second, "\"corrected_us\"", "p99", &baseP99) || !Field(cur, "\"corrected_us\"", "p99", &p99)) {
+            continue;
+        }
+        double rpsDelta = baseRps > 0 ? (rps - baseRps) / baseRps * 100 : 0;
+        double p99Delta = baseP99 > 0 ? (p99 - baseP99) / baseP99 * 100 : 0;
+        bool regressed = rpsDelta < -tolerance || p99Delta > tolerance;
+        printf("%-10s %12.1f %12.1f %+7.1f%% %10.1fus %10.1fus %+7.1f%%%s\n", name.c_str(), baseRps, rps, rpsDelta,
+               baseP99, p99, p99Delta, regressed ? "  REGRESSED" : "");
+        ok = ok && !regressed;
+    }
+    return ok;
+}
+
+static void Usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [-u] [-o profile] [-r reactors] [-t threads] [-p port] [-c conns] [-C clientthreads]\n"
+            "          [-d seconds] [-w warmup] [-R rate] [-s scenario,...] [-B bigfileMB] [-j result.json]\n"
+            "          [-b baseline.json] [-x tolerance%%]\n"
+            "  -u  io_uring backend for the server\n"
+            "  -o  server socket profile, same syntax as the server's -o\n"
+            "  -s  scenarios to run, default get,keepalive,pipeline,login,largefile\n"
+            "  -b  compare against an earlier result file, exit 2 when rps drops or p99 grows by more\n"
+            "      than the tolerance (default 10%%)\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    int reactors = 1, serverThreads = 2, port = 19316, bigMB = 8;
+    WebServer::BACKEND backend = WebServer::EPOLL;
+    SocketProfile profile;
+    LoadOptions base;
+    base.seconds = 5;
+    std::string scenarios = "get,keepalive,pipeline,login,largefile";
+    const char* output = nullptr;
+    const char* baseline = nullptr;
+    double tolerance = 10;
+    int opt;
+    while((opt = getopt(argc, argv, "uo:r:t:p:c:C:d:w:R:s:B:j:b:x:h")) != -1) {
+        switch(opt) {
+            case 'u': backend = WebServer::URING; break;
+            case 'o':
+                if(!SocketProfile::Parse(optarg, &profile)) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'r': reactors = atoi(optarg); break;
+            case 't': serverThreads = atoi(optarg); break;
+            case 'p': port = atoi(optarg); break;
+            case 'c': base.connections = atoi(optarg); break;
+            case 'C': base.threads = atoi(optarg); break;
+            case 'd': base.seconds = atof(optarg); break;
+            case 'w': base.warmup = atof(optarg); break;
+            case 'R': base.rate = atof(optarg); break;
+            case 's': scenarios = optarg; break;
+            case 'B': bigMB = atoi(optarg); break;
+            case 'j': output = optarg; break;
+            case 'b': baseline = optarg; break;
+            case 'x': tolerance = atof(optarg); break;
+            default: Usage(argv[0]); return 1;
+        }
+    }
+    std::vector<SCENARIO> runs;
+    std::stringstream ss(scenarios);
+    std::string name;
+    while(std::getline(ss, name, ',')) {
+        SCENARIO scenario;
+        if(!LoadGen::ParseScenario(name, &scenario)) {
+            Usage(argv[0]);
+            return 1;
+        }
+        runs.push_back(scenario);
+    }
+
+    char dir[] = "/tmp/e2e_bench.XXXXXX";
+    if(!mkdtemp(dir) || !MakeResources(dir, static_cast<size_t>(bigMB) << 20)) {
+        perror("resources");
+        return 1;
+    }
+    StubUserStore store;
+    store.Insert(base.user, base.password);
+    SessionStore::Instance()->Init();
+    base.port = port;
+
+    int status = 0;
+    std::vector<std::string> results;
+    {
+        WebServer server(port, reactors, serverThreads, WebServer::REUSEPORT, std::string(dir) + "/", &store, backend,
+                         profile);
+        std::thread serving([&server] { server.Start(); });
+        if(!WaitListening(port)) {
+            fprintf(stderr, "server did not start on port %d\n", port);
+            status = 1;
+        }
+        for(size_t i = 0; status == 0 && i < runs.size(); i++) {
+            LoadOptions options = base;
+            options.scenario = runs[i];
+            LoadResult result = LoadGen::Run(options);
+            fputs(LoadGen::Summary(result).c_str(), stdout);
+            results.push_back(LoadGen::ToJson(result));
+            usleep(200000); //让上一轮的连接关干净
+        }
+        server.Stop();
+        serving.join();
+    }
+    SessionStore::Instance()->Close();
+    for(const char* file: {"index.html", "welcome.html", "error.html", "404.html", "403.html", "400.html", "big.bin"}) {
+        unlink((std::string(dir) + "/" + file).c_str());
+    }
+    rmdir(dir);
+
+    if(output) {
+        FILE* fp = strcmp(output, "-") == 0 ? stdout : fopen(output, "w");
+        if(!fp) {
+            perror(output);
+            return 1;
+        }
+        for(auto& line: results) {
+            fprintf(fp, "%s\n", line.c_str());
+        }
+        if(fp != stdout) fclose(fp);
+    }
+    if(status == 0 && baseline && !Compare(results, baseline, tolerance)) {
+        status = 2;
+    }
+    return status;
+}
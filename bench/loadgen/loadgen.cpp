@@ -0,0 +1,614 @@
+#include "loadgen.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <queue>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+LatencyHistogram::LatencyHistogram(): m_counts(BUCKETS, 0), m_count(0), m_sum(0), m_max(0) {}
+
+size_t LatencyHistogram::Index(uint64_t v) {
+    static const uint64_t LIMIT = (uint64_t(1) << (MAX_EXP + 1)) - 1;
+    if(v > LIMIT) v = LIMIT;
+    if(v < 2 * SUB) return v;
+    int shift = 63 - __builtin_clzll(v) - SUB_BITS;
+    return 2 * SUB + (shift - 1) * SUB + ((v >> shift) - SUB);
+}
+
+uint64_t LatencyHistogram::ValueAt(size_t idx) {
+    if(idx < 2 * SUB) return idx;
+    int shift = (idx - 2 * SUB) / SUB + 1;
+    uint64_t sub = (idx - 2 * SUB) % SUB + SUB;
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t ns, uint64_t n) {
+    m_counts[Index(ns)] += n;
+    m_count += n;
+    m_sum += static_cast<double>(ns) * n;
+    m_max = std::max(m_max, ns);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for(size_t i = 0; i < BUCKETS; i++) {
+        m_counts[i] += other.m_counts[i];
+    }
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_max = std::max(m_max, other.m_max);
+}
+
+LatencyHistogram LatencyHistogram::Corrected(uint64_t expectedInterval) const {
+    LatencyHistogram out;
+    for(size_t i = 0; i < BUCKETS; i++) {
+        if(m_counts[i] == 0) continue;
+        uint64_t v = std::min(ValueAt(i), m_max);
+        out.Record(v, m_counts[i]);
+        if(expectedInterval == 0 || v <= expectedInterval) continue;
+        //这个请求卡住期间本来还应该发出的那些请求
+        for(uint64_t missing = v - expectedInterval; missing >= expectedInterval; missing -= expectedInterval) {
+            out.Record(missing, m_counts[i]);
+        }
+    }
+    return out;
+}
+
+uint64_t LatencyHistogram::Quantile(double q) const {
+    if(m_count == 0) return 0;
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * m_count)));
+    uint64_t seen = 0;
+    for(size_t i = 0; i < BUCKETS; i++) {
+        seen += m_counts[i];
+        if(seen >= target) return std::min(ValueAt(i), m_max);
+    }
+    return m_max;
+}
+
+static const char* SCENARIO_NAME[SC_COUNT] = {"get", "keepalive", "pipeline", "login", "largefile"};
+
+const char* LoadGen::ScenarioName(SCENARIO scenario) {
+    return scenario < SC_COUNT ? SCENARIO_NAME[scenario] : "?";
+}
+
+bool LoadGen::ParseScenario(const std::string& name, SCENARIO* scenario) {
+    for(int i = 0; i < SC_COUNT; i++) {
+        if(name == SCENARIO_NAME[i]) {
+            *scenario = static_cast<SCENARIO>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string LoadGen::DefaultPath(SCENARIO scenario) {
+    switch(scenario) {
+        case SC_LOGIN: return "/login.html";
+        case SC_LARGEFILE: return "/big.bin";
+        default: return "/index.html";
+    }
+}
+
+static uint64_t NowNS() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static std::string FormBody(const LoadOptions& opt) {
+    return "username=" + opt.user + "&password=" + opt.password;
+}
+
+static std::string BuildRequest(const LoadOptions& opt, const std::string& path, bool keepalive) {
+    std::string host = opt.host + ":" + std::to_string(opt.port);
+    std::string conn = keepalive ? "keep-alive" : "close";
+    if(opt.scenario == SC_LOGIN || path == "/register.html") {
+        std::string body = FormBody(opt);
+        return "POST " + path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: " + conn
+               + "\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: " + std::to_string(body.size())
+               + "\r\n\r\n" + body;
+    }
+    return "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: " + conn + "\r\n\r\n";
+}
+
+static bool Resolve(const std::string& host, int port, sockaddr_in* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    if(inet_pton(AF_INET, host.c_str(), &addr->sin_addr) == 1) return true;
+    addrinfo hints = {}, *res = nullptr;
+    hints.ai_family = AF_INET;
+    if(getaddrinfo(host.c_str(), nullptr, &hints, &res) != 0 || !res) return false;
+    addr->sin_addr = reinterpret_cast<sockaddr_in*>(res->ai_addr)->sin_addr;
+    freeaddrinfo(res);
+    return true;
+}
+
+//登录场景开始前注册一次 用户已存在时服务器返回错误页 也没关系
+static void Register(const LoadOptions& opt, const sockaddr_in& addr) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0) return;
+    timeval tv = {opt.timeoutMS / 1000, (opt.timeoutMS % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if(connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0) {
+        std::string req = BuildRequest(opt, "/register.html", false);
+        if(write(fd, req.data(), req.size()) == static_cast<ssize_t>(req.size())) {
+            char buf[4096];
+            while(read(fd, buf, sizeof(buf)) > 0) {}
+        }
+    }
+    close(fd);
+}
+
+namespace {
+
+struct Conn {
+    int fd = -1;
+    bool connected = false;
+    bool queued = false; //在等待发送的堆里
+    std::string out;
+    size_t outpos = 0;
+    std::deque<uint64_t> pending; //已经写进out的请求的起始时刻 按顺序对应响应
+    std::string head; //没收完的响应头
+    uint64_t bodyleft = 0;
+    bool inbody = false;
+    bool closing = false; //响应带Connection: close
+    int code = 0;
+    uint64_t nextdue = 0; //开环时下一批的预定时刻
+    uint64_t retryat = 0; //连接失败后的退避
+    uint64_t progress = 0; //最近一次发出请求或收到数据的时刻 判断超时用
+};
+
+class Worker {
+public:
+    Worker(const LoadOptions& opt, int conns, int first, double rate, const sockaddr_in& addr, uint64_t begin,
+           uint64_t windowBegin, uint64_t end)
+        : requests(0), non2xx(0), errors(0), reconnects(0), bytes(0), m_opt(opt), m_conns(conns), m_addr(addr),
+          m_windowbegin(windowBegin), m_end(end), m_armed(0) {
+        m_batch = opt.scenario == SC_PIPELINE ? std::max(1, opt.depth) : 1;
+        m_request = BuildRequest(opt, opt.path.empty() ? LoadGen::DefaultPath(opt.scenario) : opt.path,
+                                 opt.scenario != SC_GET);
+        if(rate > 0) {
+            //每个连接两批之间的间隔 各连接的起点错开
+            m_interval = static_cast<uint64_t>(1e9 * conns * m_batch / rate);
+            for(int i = 0; i < conns; i++) {
+                m_conns[i].nextdue = begin + m_interval * (first + i) / opt.connections;
+            }
+        }else {
+            m_interval = 0;
+            for(auto& c: m_conns) c.nextdue = begin;
+        }
+    }
+
+    void Run();
+
+    LatencyHistogram latency;
+    uint64_t requests, non2xx, errors, reconnects, bytes;
+
+private:
+    typedef std::pair<uint64_t, int> Due;
+
+    void Idle(int idx);
+    void Issue(int idx, uint64_t start);
+    void Connect(int idx);
+    void Reset(Conn& c);
+    void Flush(int idx);
+    void OnEvent(int idx, uint32_t events, uint64_t now);
+    bool Feed(Conn& c, const char* data, size_t len, uint64_t now);
+    void Complete(Conn& c, uint64_t now);
+    void Closed(int idx, bool clean, uint64_t now);
+    void Fail(int idx, uint64_t now);
+    void CheckTimeouts(uint64_t now);
+    void ArmTimer(uint64_t due);
+
+    const LoadOptions& m_opt;
+    std::vector<Conn> m_conns;
+    sockaddr_in m_addr;
+    uint64_t m_windowbegin, m_end;
+    uint64_t m_interval;
+    int m_batch;
+    std::string m_request;
+    int m_epfd, m_timerfd;
+    uint64_t m_armed;
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> m_due;
+    std::vector<char> m_buf;
+};
+
+void Worker::Idle(int idx) {
+    Conn& c = m_conns[idx];
+    if(c.queued || !c.pending.empty()) return;
+    c.queued = true;
+    m_due.push({std::max(c.nextdue, c.retryat), idx});
+}
+
+void Worker::Issue(int idx, uint64_t start) {
+    Conn& c = m_conns[idx];
+    for(int i = 0; i < m_batch; i++) {
+        c.pending.push_back(start);
+        c.out += m_request;
+    }
+    c.progress = NowNS();
+    if(c.fd < 0) {
+        Connect(idx);
+    }else if(c.connected) {
+        Flush(idx);
+    }
+}
+
+void Worker::Connect(int idx) {
+    Conn& c = m_conns[idx];
+    c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if(connect(c.fd, reinterpret_cast<sockaddr*>(&m_addr), sizeof(m_addr)) < 0 && errno != EINPROGRESS) {
+        Fail(idx, NowNS());
+        return;
+    }
+    epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.u32 = idx;
+    epoll_ctl(m_epfd, EPOLL_CTL_ADD, c.fd, &ev);
+}
+
+void Worker::Reset(Conn& c) {
+    if(c.fd >= 0) close(c.fd); //close会把它从epoll里去掉
+    c.fd = -1;
+    c.connected = false;
+    c.out.clear();
+    c.outpos = 0;
+    c.head.clear();
+    c.inbody = false;
+    c.bodyleft = 0;
+    c.closing = false;
+}
+
+void Worker::Flush(int idx) {
+    Conn& c = m_conns[idx];
+    while(c.outpos < c.out.size()) {
+        ssize_t n = write(c.fd, c.out.data() + c.outpos, c.out.size() - c.outpos);
+        if(n < 0) {
+            if(errno != EAGAIN) Closed(idx, false, NowNS());
+            return;
+        }
+        c.outpos += n;
+    }
+    c.out.clear();
+    c.outpos = 0;
+}
+
+//连接失败 这批请求算错误 退避一会儿再试
+void Worker::Fail(int idx, uint64_t now) {
+    Conn& c = m_conns[idx];
+    errors += c.pending.size();
+    c.pending.clear();
+    Reset(c);
+    c.retryat = now + 10000000;
+    Idle(idx);
+}
+
+void Worker::Complete(Conn& c, uint64_t now) {
+    c.inbody = false;
+    if(c.pending.empty()) {
+        errors++; //多出来的响应
+        return;
+    }
+    uint64_t start = c.pending.front();
+    c.pending.pop_front();
+    if(now >= m_windowbegin && now <= m_end) {
+        latency.Record(now - start);
+        requests++;
+        if(c.code < 200 || c.code >= 300) non2xx++;
+    }
+}
+
+//返回false表示这个连接后面的数据不用再看了(服务器要关闭)
+bool Worker::Feed(Conn& c, const char* data, size_t len, uint64_t now) {
+    while(len > 0) {
+        if(c.inbody) {
+            size_t n = std::min<uint64_t>(len, c.bodyleft);
+            c.bodyleft -= n;
+            data += n;
+            len -= n;
+            if(c.bodyleft == 0) {
+                Complete(c, now);
+                if(c.closing) return false;
+            }
+            continue;
+        }
+        size_t old = c.head.size();
+        c.head.append(data, len);
+        size_t end = c.head.find("\r\n\r\n", old >= 3 ? old - 3 : 0);
+        if(end == std::string::npos) {
+            if(c.head.size() > 65536) {
+                errors++;
+                return false;
+            }
+            break;
+        }
+        size_t used = end + 4 - old;
+        data += used;
+        len -= used;
+        c.head.resize(end + 2);
+        c.code = c.head.size() > 12 ? atoi(c.head.c_str() + 9) : 0;
+        c.bodyleft = 0;
+        size_t pos = c.head.find("\r\n") + 2;
+        while(pos < c.head.size()) {
+            size_t eol = c.head.find("\r\n", pos);
+            std::string line = c.head.substr(pos, eol - pos);
+            pos = eol + 2;
+            size_t colon = line.find(':');
+            if(colon == std::string::npos) continue;
+            const char* value = line.c_str() + colon + 1;
+            while(*value == ' ') value++;
+            if(colon == 14 && strncasecmp(line.c_str(), "content-length", 14) == 0) {
+                c.bodyleft = strtoull(value, nullptr, 10);
+            }else if(colon == 10 && strncasecmp(line.c_str(), "connection", 10) == 0 && strcasecmp(value, "close") == 0) {
+                c.closing = true;
+            }
+        }
+        c.head.clear();
+        c.inbody = true;
+        if(c.bodyleft == 0) {
+            Complete(c, now);
+            if(c.closing) return false;
+        }
+    }
+    return true;
+}
+
+//连接断了 还有没收到响应的请求就重连重发 起始时刻不变
+void Worker::Closed(int idx, bool clean, uint64_t now) {
+    Conn& c = m_conns[idx];
+    Reset(c);
+    if(!c.pending.empty()) {
+        if(clean) reconnects++;
+        else errors++;
+        for(size_t i = 0; i < c.pending.size(); i++) {
+            c.out += m_request;
+        }
+        c.progress = now;
+        Connect(idx);
+        return;
+    }
+    if(m_opt.scenario != SC_GET) reconnects++; //长连接被服务器关掉(比如到了每连接请求数上限)
+    Idle(idx);
+}
+
+void Worker::OnEvent(int idx, uint32_t events, uint64_t now) {
+    Conn& c = m_conns[idx];
+    if(c.fd < 0) return;
+    if(!c.connected) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if(err != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+            Fail(idx, now);
+            return;
+        }
+        if(!(events & EPOLLOUT)) return;
+        c.connected = true;
+    }
+    if(events & EPOLLOUT) {
+        int fd = c.fd;
+        Flush(idx);
+        if(c.fd != fd) return; //写失败 已经断开或者换了新连接
+    }
+    if(events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) {
+        while(true) {
+            ssize_t n = read(c.fd, m_buf.data(), m_buf.size());
+            if(n > 0) {
+                c.progress = now;
+                if(now >= m_windowbegin && now <= m_end) bytes += n;
+                if(!Feed(c, m_buf.data(), n, now)) {
+                    Closed(idx, c.closing, now);
+                    return;
+                }
+                continue;
+            }
+            if(n < 0 && errno == EAGAIN) break;
+            //对端关闭或者出错
+            Closed(idx, c.pending.empty() && !c.inbody && c.head.empty(), now);
+            return;
+        }
+    }
+    if(c.pending.empty() && c.out.empty()) {
+        Idle(idx);
+    }
+}
+
+void Worker::CheckTimeouts(uint64_t now) {
+    uint64_t limit = static_cast<uint64_t>(m_opt.timeoutMS) * 1000000;
+    for(size_t i = 0; i < m_conns.size(); i++) {
+        Conn& c = m_conns[i];
+        if(!c.pending.empty() && now > c.progress + limit) { //progress可能比now还新
+            Fail(i, now);
+        }
+    }
+}
+
+void Worker::ArmTimer(uint64_t due) {
+    if(due == m_armed) return;
+    m_armed = due;
+    itimerspec its = {};
+    its.it_value.tv_sec = due / 1000000000;
+    its.it_value.tv_nsec = due % 1000000000;
+    timerfd_settime(m_timerfd, TFD_TIMER_ABSTIME, &its, nullptr);
+}
+
+void Worker::Run() {
+    m_epfd = epoll_create1(0);
+    //开环要按纳秒排程 epoll_wait只有毫秒 用timerfd叫醒
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    epoll_event tev = {};
+    tev.events = EPOLLIN;
+    tev.data.u32 = UINT32_MAX;
+    epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_timerfd, &tev);
+    m_buf.resize(256 * 1024);
+    for(size_t i = 0; i < m_conns.size(); i++) {
+        Idle(i);
+    }
+    std::vector<epoll_event> events(m_conns.size() + 1);
+    uint64_t lastcheck = NowNS();
+    while(true) {
+        uint64_t now = NowNS();
+        if(now >= m_end) break;
+        while(!m_due.empty() && m_due.top().first <= now) {
+            int idx = m_due.top().second;
+            m_due.pop();
+            Conn& c = m_conns[idx];
+            c.queued = false;
+            if(m_interval > 0) {
+                //开环 延迟从预定时刻算 落后了也照样按原来的时刻算
+                uint64_t start = c.nextdue;
+                c.nextdue += m_interval;
+                Issue(idx, start);
+            }else {
+                Issue(idx, now);
+            }
+        }
+        if(now - lastcheck > 100000000) {
+            CheckTimeouts(now);
+            lastcheck = now;
+        }
+        int timeout = static_cast<int>(std::min<uint64_t>(100, (m_end - now) / 1000000 + 1));
+        if(!m_due.empty()) {
+            ArmTimer(m_due.top().first);
+        }
+        int n = epoll_wait(m_epfd, events.data(), events.size(), timeout);
+        now = NowNS();
+        for(int i = 0; i < n; i++) {
+            if(events[i].data.u32 == UINT32_MAX) {
+                uint64_t expirations;
+                if(read(m_timerfd, &expirations, sizeof(expirations)) > 0) m_armed = 0;
+                continue;
+            }
+            OnEvent(events[i].data.u32, events[i].events, now);
+        }
+    }
+    for(auto& c: m_conns) {
+        Reset(c);
+    }
+    close(m_timerfd);
+    close(m_epfd);
+}
+
+}
+
+LoadResult LoadGen::Run(const LoadOptions& options) {
+    LoadResult result;
+    result.options = options;
+    result.elapsed = options.seconds;
+    result.requests = result.non2xx = result.errors = result.reconnects = result.bytes = 0;
+    sockaddr_in addr;
+    if(!Resolve(options.host, options.port, &addr)) {
+        fprintf(stderr, "cannot resolve %s\n", options.host.c_str());
+        result.errors = 1;
+        return result;
+    }
+    if(options.scenario == SC_LOGIN) {
+        Register(options, addr);
+    }
+
+    int threads = std::max(1, std::min(options.threads, options.connections));
+    uint64_t begin = NowNS() + 10000000;
+    uint64_t windowBegin = begin + static_cast<uint64_t>(options.warmup * 1e9);
+    uint64_t end = windowBegin + static_cast<uint64_t>(options.seconds * 1e9);
+    std::vector<std::unique_ptr<Worker>> workers;
+    int first = 0;
+    for(int i = 0; i < threads; i++) {
+        int conns = options.connections / threads + (i < options.connections % threads ? 1 : 0);
+        double rate = options.rate * conns / options.connections;
+        workers.emplace_back(new Worker(options, conns, first, rate, addr, begin, windowBegin, end));
+        first += conns;
+    }
+    std::vector<std::thread> running;
+    for(auto& w: workers) {
+        running.emplace_back([&w] { w->Run(); });
+    }
+    for(auto& t: running) t.join();
+
+    for(auto& w: workers) {
+        result.latency.Merge(w->latency);
+        result.requests += w->requests;
+        result.non2xx += w->non2xx;
+        result.errors += w->errors;
+        result.reconnects += w->reconnects;
+        result.bytes += w->bytes;
+    }
+    if(options.rate > 0) {
+        result.corrected = result.latency;
+    }else if(result.requests > 0) {
+        //闭环时每个连接平均多久发一批
+        int batch = options.scenario == SC_PIPELINE ? std::max(1, options.depth) : 1;
+        double batches = static_cast<double>(result.requests) / batch;
+        result.corrected = result.latency.Corrected(static_cast<uint64_t>(options.seconds * 1e9 * options.connections / batches));
+    }
+    return result;
+}
+
+static void AppendLatency(std::string& out, const char* name, const LatencyHistogram& hist) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "\"%s\":{\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}",
+             name, hist.Mean() / 1e3, hist.Quantile(0.5) / 1e3, hist.Quantile(0.9) / 1e3, hist.Quantile(0.99) / 1e3,
+             hist.Quantile(0.999) / 1e3, hist.Max() / 1e3);
+    out += buf;
+}
+
+std::string LoadGen::ToJson(const LoadResult& r) {
+    const LoadOptions& o = r.options;
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "{\"scenario\":\"%s\",\"mode\":\"%s\",\"connections\":%d,\"threads\":%d,\"depth\":%d,\"rate\":%.1f,"
+             "\"seconds\":%.3f,\"requests\":%llu,\"rps\":%.1f,\"mbps\":%.2f,\"non2xx\":%llu,\"errors\":%llu,"
+             "\"reconnects\":%llu,",
+             ScenarioName(o.scenario), o.rate > 0 ? "open" : "closed", o.connections, o.threads,
+             o.scenario == SC_PIPELINE ? o.depth : 1, o.rate, r.elapsed, (unsigned long long)r.requests,
+             r.requests / r.elapsed, r.bytes / r.elapsed / 1e6, (unsigned long long)r.non2xx,
+             (unsigned long long)r.errors, (unsigned long long)r.reconnects);
+    std::string out = buf;
+    AppendLatency(out, "latency_us", r.latency);
+    out += ",";
+    AppendLatency(out, "corrected_us", r.corrected);
+    out += "}";
+    return out;
+}
+
+std::string LoadGen::Summary(const LoadResult& r) {
+    const LoadOptions& o = r.options;
+    char buf[512];
+    std::string out;
+    snprintf(buf, sizeof(buf), "%s %s-loop, %d conns, %d threads, %.1fs%s\n", ScenarioName(o.scenario),
+             o.rate > 0 ? "open" : "closed", o.connections, o.threads, r.elapsed,
+             o.scenario == SC_PIPELINE ? (", depth " + std::to_string(o.depth)).c_str() : "");
+    out += buf;
+    snprintf(buf, sizeof(buf), "  %llu requests, %.1f req/s, %.2f MB/s, non2xx %llu, errors %llu, reconnects %llu\n",
+             (unsigned long long)r.requests, r.requests / r.elapsed, r.bytes / r.elapsed / 1e6,
+             (unsigned long long)r.non2xx, (unsigned long long)r.errors, (unsigned long long)r.reconnects);
+    out += buf;
+    snprintf(buf, sizeof(buf), "  %-14s %10s %10s %10s %10s %10s %10s\n", "", "mean", "p50", "p90", "p99", "p99.9", "max");
+    out += buf;
+    const LatencyHistogram* hists[] = {&r.latency, &r.corrected};
+    const char* names[] = {"latency(us)", "corrected(us)"};
+    for(int i = 0; i < 2; i++) {
+        const LatencyHistogram& h = *hists[i];
+        snprintf(buf, sizeof(buf), "  %-14s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", names[i], h.Mean() / 1e3,
+                 h.Quantile(0.5) / 1e3, h.Quantile(0.9) / 1e3, h.Quantile(0.99) / 1e3, h.Quantile(0.999) / 1e3,
+                 h.Max() / 1e3);
+        out += buf;
+    }
+    return out;
+}
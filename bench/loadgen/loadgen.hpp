@@ -0,0 +1,101 @@
+#ifndef __LOADGEN_HPP
+#define __LOADGEN_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+epoll压测客户端 每个线程一个epoll 管理分给它的一组非阻塞连接
+闭环: 连接上的请求(流水线时是一批)全部收完才发下一个 延迟从发出算起
+开环: 按总速率给每个连接排好发送时刻 延迟从预定时刻算起 连接还忙着的话等它空出来再发 排队的时间也算进延迟
+  这样服务器卡住的那段时间不会因为客户端少发而被漏掉(协调遗漏)
+闭环没有预定时刻 另外给一份按平均请求间隔补样本的修正结果 做法同HdrHistogram的copyCorrectedForCoordinatedOmission
+*/
+
+//对数线性直方图 每个2的幂区间分128格 相对误差小于1% 单位纳秒
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void Record(uint64_t ns, uint64_t n = 1);
+    void Merge(const LatencyHistogram& other);
+
+    //大于expectedInterval的样本按间隔往下补上被遗漏的样本
+    LatencyHistogram Corrected(uint64_t expectedInterval) const;
+
+    uint64_t Count() const { return m_count; }
+    uint64_t Max() const { return m_max; }
+    double Mean() const { return m_count ? static_cast<double>(m_sum) / m_count : 0; }
+    uint64_t Quantile(double q) const;
+
+private:
+    static const int SUB_BITS = 7;
+    static const uint64_t SUB = 1 << SUB_BITS;
+    static const int MAX_EXP = 40; //约18分钟 更大的值截断
+    static const size_t BUCKETS = 2 * SUB + (MAX_EXP - SUB_BITS) * SUB;
+
+    static size_t Index(uint64_t v);
+    static uint64_t ValueAt(size_t idx); //这一格里最大的值
+
+    std::vector<uint64_t> m_counts;
+    uint64_t m_count;
+    double m_sum;
+    uint64_t m_max;
+};
+
+enum SCENARIO {
+    SC_GET, //每个请求一个新连接(Connection: close) 延迟包括建连
+    SC_KEEPALIVE,
+    SC_PIPELINE, //长连接上一次发depth个请求
+    SC_LOGIN, //POST /login.html 每次都要查用户存储
+    SC_LARGEFILE, //长连接下载大文件 看吞吐
+    SC_COUNT
+};
+
+struct LoadOptions {
+    std::string host = "127.0.0.1";
+    int port = 1316;
+    SCENARIO scenario = SC_KEEPALIVE;
+    int threads = 1;
+    int connections = 16;
+    double seconds = 10;
+    double warmup = 1; //这段时间里完成的请求不计入
+    double rate = 0; //所有连接合计每秒请求数 0为闭环
+    int depth = 16; //SC_PIPELINE每批的请求数
+    std::string path; //空的话用场景的默认路径
+    std::string user = "bench";
+    std::string password = "bench";
+    int timeoutMS = 5000; //一个请求超过这么久没有响应就断开重连 计为错误
+};
+
+struct LoadResult {
+    LoadOptions options;
+    double elapsed; //统计窗口的实际长度 秒
+    uint64_t requests; //窗口内完成的请求
+    uint64_t non2xx;
+    uint64_t errors; //超时 连接失败 响应不完整
+    uint64_t reconnects; //服务器主动关闭后重连的次数
+    uint64_t bytes; //窗口内收到的字节 包括响应头
+    LatencyHistogram latency;
+    LatencyHistogram corrected; //开环时与latency相同
+};
+
+class LoadGen {
+public:
+    static const char* ScenarioName(SCENARIO scenario);
+    static bool ParseScenario(const std::string& name, SCENARIO* scenario);
+    static std::string DefaultPath(SCENARIO scenario);
+
+    //跑一轮 阻塞到结束 登录场景会先注册一次用户
+    static LoadResult Run(const LoadOptions& options);
+
+    //一行JSON 字段顺序固定 e2e_bench比较基线时按字段名取值
+    static std::string ToJson(const LoadResult& result);
+
+    //给人看的几行摘要
+    static std::string Summary(const LoadResult& result);
+};
+
+
+#endif
@@ -0,0 +1,95 @@
+/*
+HTTP压测客户端 对一个已经在跑的服务器压一个场景
+-R给了速率是开环 否则闭环; -j把结果以一行JSON写进文件(-为标准输出)
+-m/-l给了门限时 吞吐低于或p99(开环的延迟 闭环的修正延迟)高于门限返回2
+用法: loadgen [-a host] [-p port] [-s get|keepalive|pipeline|login|largefile] [-c conns] [-t threads]
+             [-d seconds] [-w warmup] [-R rate] [-D depth] [-P path] [-U user:pwd] [-T timeoutms]
+             [-j file] [-m min_rps] [-l max_p99_ms]
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "loadgen.hpp"
+
+static void Usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [-a host] [-p port] [-s scenario] [-c conns] [-t threads] [-d seconds] [-w warmup]\n"
+            "          [-R rate] [-D depth] [-P path] [-U user:pwd] [-T timeoutms] [-j file] [-m min_rps] [-l max_p99_ms]\n"
+            "  scenarios: get keepalive pipeline login largefile\n"
+            "  -R  total requests per second across connections (open loop), 0 for closed loop\n"
+            "  -D  requests per batch in the pipeline scenario (default 16)\n"
+            "  -j  append the result as one JSON line to file, - for stdout\n"
+            "  -m  exit 2 if throughput is below min_rps\n"
+            "  -l  exit 2 if p99 latency (coordinated-omission corrected) is above max_p99_ms\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    const char* json = nullptr;
+    double minRps = 0, maxP99 = 0;
+    int opt;
+    while((opt = getopt(argc, argv, "a:p:s:c:t:d:w:R:D:P:U:T:j:m:l:h")) != -1) {
+        switch(opt) {
+            case 'a': options.host = optarg; break;
+            case 'p': options.port = atoi(optarg); break;
+            case 's':
+                if(!LoadGen::ParseScenario(optarg, &options.scenario)) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'c': options.connections = atoi(optarg); break;
+            case 't': options.threads = atoi(optarg); break;
+            case 'd': options.seconds = atof(optarg); break;
+            case 'w': options.warmup = atof(optarg); break;
+            case 'R': options.rate = atof(optarg); break;
+            case 'D': options.depth = atoi(optarg); break;
+            case 'P': options.path = optarg; break;
+            case 'U': {
+                const char* colon = strchr(optarg, ':');
+                if(!colon) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                options.user.assign(optarg, colon - optarg);
+                options.password = colon + 1;
+                break;
+            }
+            case 'T': options.timeoutMS = atoi(optarg); break;
+            case 'j': json = optarg; break;
+            case 'm': minRps = atof(optarg); break;
+            case 'l': maxP99 = atof(optarg); break;
+            default: Usage(argv[0]); return 1;
+        }
+    }
+    if(options.connections <= 0 || options.seconds <= 0) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    LoadResult result = LoadGen::Run(options);
+    fputs(LoadGen::Summary(result).c_str(), stdout);
+    if(json) {
+        FILE* fp = strcmp(json, "-") == 0 ? stdout : fopen(json, "a");
+        if(!fp) {
+            perror(json);
+            return 1;
+        }
+        fprintf(fp, "%s\n", LoadGen::ToJson(result).c_str());
+        if(fp != stdout) fclose(fp);
+    }
+
+    double rps = result.requests / result.elapsed;
+    double p99 = result.corrected.Quantile(0.99) / 1e6;
+    bool ok = true;
+    if(minRps > 0 && rps < minRps) {
+        fprintf(stderr, "throughput %.1f req/s below %.1f\n", rps, minRps);
+        ok = false;
+    }
+    if(maxP99 > 0 && p99 > maxP99) {
+        fprintf(stderr, "p99 %.3f ms above %.3f ms\n", p99, maxP99);
+        ok = false;
+    }
+    return ok ? 0 : 2;
+}
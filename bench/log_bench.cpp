@@ -0,0 +1,100 @@
+/*
+日志热路径开销对比: 同步文本 / 异步文本 / 延迟格式化 / 二进制
+用法: log_bench [线程数] [每线程调用次数] [日志目录]
+只统计调用线程花在LOG_INFO上的时间 写线程的开销不计入
+异步模式的日志环按调用次数分配 保证不丢行 否则测到的主要是丢弃的路径
+结果按实际写进日志环的行数平均 不给目录时写到/tmp下的临时目录 跑完删掉
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../src/log/log.hpp"
+
+static int RemoveEntry(const char* path, const struct stat*, int, struct FTW*) {
+    int ret = remove(path);
+    if(ret < 0) perror(path);
+    return ret;
+}
+
+static double Run(int threads, int calls) {
+    std::vector<std::thread> workers;
+    std::vector<double> nsPerCall(threads);
+    for(int t = 0; t < threads; t++) {
+        workers.emplace_back([t, calls, &nsPerCall] {
+            auto begin = std::chrono::steady_clock::now();
+            for(int i = 0; i < calls; i++) {
+                LOG_INFO("request %d from %s took %lu us, ratio %.3f", i, "127.0.0.1", (unsigned long)(i * 7), i / 3.0);
+            }
+            auto end = std::chrono::steady_clock::now();
+            nsPerCall[t] = std::chrono::duration<double, std::nano>(end - begin).count() / calls;
+        });
+    }
+    for(auto& w: workers) {
+        w.join();
+    }
+    double sum = 0;
+    for(double ns: nsPerCall) sum += ns;
+    return sum / threads;
+}
+
+int main(int argc, char* argv[]) {
+    int threads = argc > 1 ? atoi(argv[1]) : 1;
+    int calls = argc > 2 ? atoi(argv[2]) : 200000;
+    if(threads <= 0 || calls <= 0) {
+        fprintf(stderr, "usage: %s [threads] [calls per thread] [log dir]\n", argv[0]);
+        return 1;
+    }
+
+    char tmpdir[] = "/tmp/log_bench.XXXXXX";
+    std::string base;
+    if(argc > 3) {
+        base = argv[3];
+        mkdir(base.c_str(), 0777); //Log只建最后一级目录
+    }else if(mkdtemp(tmpdir)) {
+        base = tmpdir;
+    }else {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    //每个日志环大约能放MaxQueueCap行 按调用次数给足
+    struct Case {
+        const char* name;
+        int queue;
+        Log::LOG_MODE mode;
+    } cases[] = {
+        {"sync-text", 0, Log::TEXT},
+        {"async-text", calls, Log::TEXT},
+        {"deferred", calls, Log::DEFERRED},
+        {"binary", calls, Log::BINARY},
+    };
+
+    if(std::thread::hardware_concurrency() <= static_cast<unsigned>(threads)) {
+        //写线程和调用线程抢同一批核 异步模式的耗时里会混进写线程的时间
+        printf("note: %u cpus for %d threads plus the writer, async numbers include writer time\n",
+               std::thread::hardware_concurrency(), threads);
+    }
+
+    Log* log = Log::Instance();
+    for(auto& c: cases) {
+        log->init(1, (base + "/" + c.name).c_str(), ".log", c.queue, c.mode);
+        uint64_t dropped = log->Dropped();
+        double ns = Run(threads, calls);
+        std::this_thread::sleep_for(std::chrono::milliseconds(300)); //等写线程读空
+        dropped = log->Dropped() - dropped;
+        uint64_t total = static_cast<uint64_t>(threads) * calls;
+        //丢掉的行也花了时间 全部算到写进去的行上
+        double nsPerLine = total > dropped ? ns * total / (total - dropped) : 0;
+        printf("%-12s threads=%d calls=%d  %8.1f ns/line  dropped=%lu\n",
+               c.name, threads, calls, nsPerLine, (unsigned long)dropped);
+    }
+    if(argc <= 3) {
+        nftw(tmpdir, RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+    return 0;
+}
@@ -0,0 +1,43 @@
+/*
+指标记录的开销 单线程和多线程下Counter::Inc和Histogram::Record每次多少纳秒
+多线程时每个线程写自己的分片 互不争用 按总次数平均
+用法: metrics_bench [线程数] [每线程次数]
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "../src/metrics/metrics.hpp"
+
+template<typename F>
+static double Run(int threads, long iters, F&& fn) {
+    std::vector<std::thread> workers;
+    auto begin = std::chrono::steady_clock::now();
+    for(int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            for(long i = 0; i < iters; i++) fn(t, i);
+        });
+    }
+    for(auto& w: workers) w.join();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+    return ns / iters / threads; //按总次数平均 核数够的时候多线程会更小
+}
+
+int main(int argc, char* argv[]) {
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    long iters = argc > 2 ? atol(argv[2]) : 20000000;
+    Counter* counter = Metrics::Instance()->NewCounter("bench_counter_total", "bench");
+    Histogram* hist = Metrics::Instance()->NewHistogram("bench_seconds", "bench");
+
+    for(int n: {1, threads}) {
+        printf("%d thread(s)\n", n);
+        printf("  counter   %6.2f ns/op\n", Run(n, iters, [&](int, long) { counter->Inc(); }));
+        printf("  histogram %6.2f ns/op\n", Run(n, iters, [&](int t, long i) { hist->Record((i * 2654435761u + t) & 0xFFFFF); }));
+    }
+    Histogram::Snapshot snap;
+    hist->Collect(&snap);
+    printf("counter=%llu histogram count=%llu p50=%lluns p99=%lluns\n", (unsigned long long)counter->Value(),
+           (unsigned long long)snap.count, (unsigned long long)snap.Quantile(0.5), (unsigned long long)snap.Quantile(0.99));
+    return 0;
+}
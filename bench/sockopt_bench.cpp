@@ -0,0 +1,124 @@
+/*
+socket选项对小响应和大响应的影响 回环上跑 服务端和客户端各一个线程
+服务端每收到一个请求回一个响应 头部和正文分两次write(旧的写法)或一次writev(现在的写法)
+每个请求统计首字节延迟 整个响应的延迟 和服务端TCP_INFO里发出的段数
+关掉nodelay(default,nodelay=0)时分两次write的小响应会撞上Nagle加对端延迟ACK 一次要等几十毫秒
+用法: sockopt_bench [请求数] [正文字节数]
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "../src/server/socketprofile.hpp"
+
+struct Result {
+    double ttfbUS;
+    double totalUS;
+    double segsPerResp;
+};
+
+static bool ReadFull(int fd, char* buf, size_t len) {
+    while(len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if(n <= 0) return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+static uint32_t SegsOut(int fd) {
+    tcp_info info;
+    socklen_t len = sizeof(info);
+    memset(&info, 0, sizeof(info));
+    getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len);
+    return info.tcpi_segs_out;
+}
+
+static Result Run(const SocketProfile& profile, bool split, int requests, size_t bodyLen) {
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int optval = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+    profile.ApplyListen(listenFd);
+    sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listenFd, (sockaddr*)&addr, sizeof(addr));
+    listen(listenFd, 16);
+    socklen_t alen = sizeof(addr);
+    getsockname(listenFd, (sockaddr*)&addr, &alen);
+
+    std::string header = "HTTP/1.1 200 OK\r\nConnection: keep-alive\r\nContent-type: text/html\r\n"
+                         "Content-length: " + std::to_string(bodyLen) + "\r\n\r\n";
+    std::vector<char> body(bodyLen, 'x');
+    uint32_t segs = 0;
+
+    std::thread server([&] {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if(fd < 0) return;
+        uint32_t before = SegsOut(fd);
+        char req[64];
+        for(int i = 0; i < requests; i++) {
+            if(!ReadFull(fd, req, 16)) break;
+            if(profile.cork) SocketProfile::SetCork(fd, true);
+            if(split) {
+                ssize_t ret = write(fd, header.data(), header.size());
+                ret = write(fd, body.data(), body.size());
+                (void)ret;
+            }else {
+                iovec iov[2] = {{&header[0], header.size()}, {body.data(), body.size()}};
+                ssize_t ret = writev(fd, iov, 2);
+                (void)ret;
+            }
+            if(profile.cork) SocketProfile::SetCork(fd, false);
+        }
+        segs = SegsOut(fd) - before;
+        close(fd);
+    });
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    connect(fd, (sockaddr*)&addr, sizeof(addr));
+    std::vector<char> resp(header.size() + bodyLen);
+    double ttfb = 0, total = 0;
+    for(int i = 0; i < requests; i++) {
+        auto begin = std::chrono::steady_clock::now();
+        ssize_t ret = write(fd, "GET / HTTP/1.1\r\n", 16);
+        (void)ret;
+        if(!ReadFull(fd, resp.data(), 1)) break;
+        auto first = std::chrono::steady_clock::now();
+        if(!ReadFull(fd, resp.data() + 1, resp.size() - 1)) break;
+        auto end = std::chrono::steady_clock::now();
+        ttfb += std::chrono::duration<double, std::micro>(first - begin).count();
+        total += std::chrono::duration<double, std::micro>(end - begin).count();
+    }
+    close(fd);
+    server.join();
+    close(listenFd);
+    return {ttfb / requests, total / requests, static_cast<double>(segs) / requests};
+}
+
+int main(int argc, char* argv[]) {
+    int requests = argc > 1 ? atoi(argv[1]) : 200;
+    size_t bodyLen = argc > 2 ? strtoul(argv[2], nullptr, 10) : 512;
+    printf("%d requests, %zu byte body\n", requests, bodyLen);
+    printf("%-18s %-7s %12s %12s %10s\n", "profile", "write", "ttfb(us)", "total(us)", "segs/resp");
+    for(const char* name: {"default,nodelay=0", "default", "latency", "throughput"}) {
+        SocketProfile profile;
+        SocketProfile::Parse(name, &profile);
+        for(bool split: {true, false}) {
+            Result r = Run(profile, split, requests, bodyLen);
+            printf("%-18s %-7s %12.1f %12.1f %10.2f\n", name, split ? "split" : "writev", r.ttfbUS, r.totalUS,
+                   r.segsPerResp);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,189 @@
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <unistd.h>
+#include "src/server/webserver.hpp"
+#include "src/buffer/bufferpool.hpp"
+#include "src/store/mmapuserstore.hpp"
+#include "src/session/sessionstore.hpp"
+#include "src/metrics/allocprofile.hpp"
+#include "src/metrics/profiledmutex.hpp"
+#include "src/trace/trace.hpp"
+#ifdef USE_MYSQL
+#include "src/store/mysqluserstore.hpp"
+#endif
+
+static WebServer* g_server = nullptr;
+
+static void OnSignal(int) {
+    if(g_server) g_server->Stop();
+}
+
+static void Usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [-p port] [-r reactors] [-t threads] [-e] [-u] [-s srcdir] [-d datadir] [-l loglevel]\n"
+            "          [-T idle:header:body] [-k maxrequests] [-o profile[,key=value...]]\n"
+            "          [-M metricspath] [-x N[:slots]] [-L text|deferred|binary]\n"
+            "          [-F flushms:flushlevel] [-z] [-A maxdays:maxMB] [-B bufferMB]\n"
+#ifdef USE_MYSQL
+            "          [-m host:port:user:pwd:db]\n"
+#endif
+            "  -e  share one listener with EPOLLEXCLUSIVE instead of SO_REUSEPORT\n"
+            "  -u  use the io_uring backend instead of epoll\n"
+            "  -T  idle/header-read/body-read timeouts in seconds, 0 disables (default 120:10:30)\n"
+            "  -k  max requests per connection, 0 for unlimited (default 1000)\n"
+            "  -o  socket profile: default, latency or throughput, then overrides among\n"
+            "      nodelay, cork, deferaccept, fastopen, sndbuf, rcvbuf (e.g. latency,sndbuf=262144);\n"
+            "      default turns on nodelay only, default,nodelay=0 leaves every option to the kernel\n"
+            "  -M  path serving Prometheus metrics to local clients, empty to disable (default /metrics)\n"
+            "      not served with -u, the io_uring backend does not know the peer address\n"
+            "  -x  trace one request in every N into shared memory /webserver-trace-<port>, keeping the\n"
+            "      last slots records (default 4096); read them with tools/tracedump\n"
+            "  -L  log mode: text (default), deferred formatting on the writer thread, or binary\n"
+            "      records decoded with tools/logdecoder\n"
+            "  -F  log writer wakes at least every flushms; lines at or above flushlevel are written\n"
+            "      and synced at once (default 100:3)\n"
+            "  -z  gzip rotated log files in the background; read them with tools/logreader\n"
+            "  -A  delete rotated logs older than maxdays or beyond maxMB in total, 0 for no limit\n"
+            "  -B  memory budget in MB for all Buffers (request, response headers, log); over it\n"
+            "      socket reads pause until usage drops, 0 for no limit (default 256)\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    int port = 1316, reactors = 0, threads = 4, logLevel = 1;
+    WebServer::ACCEPT_MODE mode = WebServer::REUSEPORT;
+    WebServer::BACKEND backend = WebServer::EPOLL;
+    std::string srcDir = "./resources/", dataDir = "./data";
+    const char* mysqlConf = nullptr;
+    SocketProfile profile;
+    int traceEvery = 0;
+    unsigned traceSlots = 4096;
+    Log::LOG_MODE logMode = Log::TEXT;
+    int flushMS = 100, flushLevel = 3;
+    bool logArchive = false, logCompress = false;
+    int logMaxDays = 0;
+    unsigned logMaxMB = 0;
+    unsigned bufferMB = 256;
+    int opt;
+    while((opt = getopt(argc, argv, "p:r:t:eus:d:l:m:T:k:o:M:x:L:F:zA:B:h")) != -1) {
+        switch(opt) {
+            case 'p': port = atoi(optarg); break;
+            case 'r': reactors = atoi(optarg); break;
+            case 't': threads = atoi(optarg); break;
+            case 'e': mode = WebServer::EXCLUSIVE; break;
+            case 'u': backend = WebServer::URING; break;
+            case 's': srcDir = optarg; break;
+            case 'd': dataDir = optarg; break;
+            case 'l': logLevel = atoi(optarg); break;
+            case 'm': mysqlConf = optarg; break;
+            case 'T': {
+                unsigned idle, header, body;
+                if(sscanf(optarg, "%u:%u:%u", &idle, &header, &body) != 3) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                HttpConn::idleTimeoutMS = idle * 1000;
+                HttpConn::headerTimeoutMS = header * 1000;
+                HttpConn::bodyTimeoutMS = body * 1000;
+                break;
+            }
+            case 'k': HttpConn::maxRequests = atoi(optarg); break;
+            case 'M': HttpConn::metricsPath = optarg; break;
+            case 'x':
+                if(sscanf(optarg, "%d:%u", &traceEvery, &traceSlots) < 1 || traceEvery < 0) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'L':
+                if(strcmp(optarg, "text") == 0) logMode = Log::TEXT;
+                else if(strcmp(optarg, "deferred") == 0) logMode = Log::DEFERRED;
+                else if(strcmp(optarg, "binary") == 0) logMode = Log::BINARY;
+                else {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'F':
+                if(sscanf(optarg, "%d:%d", &flushMS, &flushLevel) != 2 || flushMS <= 0) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'z': logArchive = logCompress = true; break;
+            case 'A':
+                if(sscanf(optarg, "%d:%u", &logMaxDays, &logMaxMB) != 2 || logMaxDays < 0) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                logArchive = true;
+                break;
+            case 'B': bufferMB = strtoul(optarg, nullptr, 10); break;
+            case 'o':
+                if(!SocketProfile::Parse(optarg, &profile)) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default: Usage(argv[0]); return 1;
+        }
+    }
+
+    Log::Instance()->init(logLevel, "./log", ".log", 1024, logMode);
+    Log::Instance()->SetFlushPolicy(flushMS, flushLevel);
+    if(logArchive) {
+        Log::Instance()->SetArchive(logCompress, logMaxDays, static_cast<uint64_t>(logMaxMB) << 20);
+    }
+    BufferPool::SetBudget(static_cast<size_t>(bufferMB) << 20);
+    SessionStore::Instance()->Init();
+    if(traceEvery > 0 && !Tracer::Instance()->Init(Tracer::DefaultName(port), traceSlots, traceEvery)) {
+        return 1;
+    }
+
+    std::unique_ptr<UserStore> store;
+#ifdef USE_MYSQL
+    if(mysqlConf) {
+        char host[64], user[64], pwd[64], db[64];
+        int sqlPort = 3306;
+        if(sscanf(mysqlConf, "%63[^:]:%d:%63[^:]:%63[^:]:%63s", host, &sqlPort, user, pwd, db) != 5) {
+            Usage(argv[0]);
+            return 1;
+        }
+        SqlConnPool::Instance()->Init(host, sqlPort, user, pwd, db, threads > 0 ? threads : 1);
+        store.reset(new MysqlUserStore());
+    }
+#else
+    if(mysqlConf) {
+        fprintf(stderr, "built without MySQL support\n");
+        return 1;
+    }
+#endif
+    if(!store) {
+        store.reset(new MmapUserStore(dataDir));
+    }
+
+    {
+        //server先析构: 线程池的工作线程退出后才关连接池和用户存储
+        WebServer server(port, reactors, threads, mode, srcDir, store.get(), backend, profile);
+        g_server = &server;
+        signal(SIGINT, OnSignal);
+        signal(SIGTERM, OnSignal);
+        server.Start();
+        g_server = nullptr;
+    }
+#ifdef PROFILE_LOCKS
+    fputs(LockProfiler::Format().c_str(), stderr);
+#endif
+#ifdef PROFILE_ALLOCS
+    fputs(AllocProfiler::Format().c_str(), stderr);
+#endif
+
+    SessionStore::Instance()->Close();
+    Tracer::Instance()->Close();
+#ifdef USE_MYSQL
+    SqlConnPool::Instance()->ClosePool();
+#endif
+    return 0;
+}
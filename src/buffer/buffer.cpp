@@ -1,16 +1,72 @@
 #include "buffer.hpp"
-#include <strings.h>
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
 #include <sys/uio.h>
 #include <unistd.h>
+#include "../metrics/metrics.hpp"
+
+static Counter* const s_grow = Metrics::Instance()->NewCounter(
+    "webserver_buffer_grow_total", "Buffer reallocations to a larger block");
+static Counter* const s_compact = Metrics::Instance()->NewCounter(
+    "webserver_buffer_compact_total", "Buffer compactions moving unread bytes to the front");
+static Counter* const s_copied = Metrics::Instance()->NewCounter(
+    "webserver_buffer_copied_bytes_total", "Bytes copied by Buffer growth and compaction");
+
+Buffer::Buffer(int initBufferSize): m_data(nullptr), m_cap(0), m_readpos(0), m_writepos(0) {
+    if(initBufferSize > 0) {
+        m_cap = initBufferSize;
+        m_data = BufferPool::Alloc(m_cap);
+    }
+}
+
+Buffer::~Buffer() {
+    BufferPool::Free(m_data, m_cap);
+}
+
+Buffer::Buffer(const Buffer& other): Buffer(0) {
+    Append(other);
+}
+
+Buffer::Buffer(Buffer&& other) noexcept
+    : m_data(other.m_data), m_cap(other.m_cap),
+      m_readpos(other.m_readpos.load()), m_writepos(other.m_writepos.load()) {
+    other.m_data = nullptr;
+    other.m_cap = 0;
+    other.m_readpos = other.m_writepos = 0;
+}
+
+Buffer& Buffer::operator=(const Buffer& other) {
+    if(this != &other) {
+        Invalidate_();
+        m_readpos = m_writepos = 0;
+        Append(other);
+    }
+    return *this;
+}
 
-Buffer::Buffer(int initBufferSize): m_buffer(initBufferSize),m_readpos(0),m_writepos(0){}
+Buffer& Buffer::operator=(Buffer&& other) noexcept {
+    if(this != &other) {
+        Invalidate_();
+        BufferPool::Free(m_data, m_cap);
+        m_data = other.m_data;
+        m_cap = other.m_cap;
+        m_readpos = other.m_readpos.load();
+        m_writepos = other.m_writepos.load();
+        other.m_data = nullptr;
+        other.m_cap = 0;
+        other.m_readpos = other.m_writepos = 0;
+    }
+    return *this;
+}
 
 size_t Buffer::ReadableBytes() const {
     return m_writepos - m_readpos;
 }
 
 size_t Buffer::WritableBytes() const {
-    return m_buffer.size() - m_writepos;
+    return m_cap - m_writepos;
 }
 
 //已经读了多少
@@ -30,13 +86,24 @@ void Buffer::Retrieve(size_t len) {
     m_readpos += len;
 }
 
-//缓冲区清零
+//缓冲区清空 只重置读写位置 不需要把内容清零
 void Buffer::RetrieveAll() {
-    bzero(&m_buffer[0], m_buffer.size()); // std::fill ?
+    Invalidate_();
     m_readpos = 0;
     m_writepos = 0;
 }
 
+void Buffer::Release() {
+    if(ReadableBytes() == 0 && m_data) {
+        Invalidate_();
+        BufferPool::Free(m_data, m_cap);
+        m_data = nullptr;
+        m_cap = 0;
+        m_readpos = 0;
+        m_writepos = 0;
+    }
+}
+
 //取到end指针指向的地址位置?
 void Buffer::RetrieveUntil(const char *end) {
     assert(Peek() <= end);
@@ -51,6 +118,68 @@ std::string Buffer::RetrieveAllToStr() {
 }
 
 
+//读len这么多 返回被读走的那一段
+std::string_view Buffer::RetrieveView(size_t len) {
+    assert(len <= ReadableBytes());
+    std::string_view view(Peek(), len);
+    m_readpos += len;
+    return view;
+}
+
+const char* Buffer::FindCRLF() const {
+    return FindCRLF(Peek());
+}
+
+const char* Buffer::FindCRLF(const char* start) const {
+    assert(Peek() <= start && start <= BeginWriteConst());
+    const char* end = BeginWriteConst();
+    //先用memchr找\r 比逐字节search快
+    while(start < end) {
+        const char* cr = static_cast<const char*>(memchr(start, '\r', end - start));
+        if(!cr || cr + 1 >= end) return nullptr;
+        if(cr[1] == '\n') return cr;
+        start = cr + 1;
+    }
+    return nullptr;
+}
+
+const char* Buffer::Find(char ch) const {
+    return Find(ch, Peek());
+}
+
+const char* Buffer::Find(char ch, const char* start) const {
+    assert(Peek() <= start && start <= BeginWriteConst());
+    return static_cast<const char*>(memchr(start, ch, BeginWriteConst() - start));
+}
+
+uint64_t Buffer::Generation() const {
+#ifndef NDEBUG
+    return m_generation;
+#else
+    return 0;
+#endif
+}
+
+bool Buffer::IsCurrent(uint64_t generation) const {
+#ifndef NDEBUG
+    return generation == m_generation;
+#else
+    (void)generation;
+    return true;
+#endif
+}
+
+//调试模式下把已读走的部分涂掉 过期视图读到的是明显的垃圾而不是看似正确的旧数据
+void Buffer::Invalidate_() {
+#ifndef NDEBUG
+    ++m_generation;
+    if(m_data && m_readpos > 0) {
+        memset(m_data, 0xDD, m_readpos);
+    }
+#endif
+}
+
+
 //当前开始写的位置
 char* Buffer::BeginWrite() {
     return BeginPtr_() + m_writepos;
@@ -63,10 +192,28 @@ const char* Buffer::BeginWriteConst() const {
 
 //根据循环buffer大小与len的关系判断是否扩充
 void Buffer::MakeSpace_(size_t len) {
+    Invalidate_();
     if(WritableBytes() + PrependableBytes() < len) {
-        m_buffer.resize(m_writepos + len + 1);
+        //从池里换一块更大的 只拷贝可读部分
+        size_t ReadableNum = ReadableBytes();
+        size_t cap = std::max(m_cap * 2, ReadableNum + len);
+        char* data = BufferPool::Alloc(cap);
+        if(m_cap > 0) {
+            s_grow->Inc(); //第一次分配不算
+            s_copied->Inc(ReadableNum);
+        }
+        if(ReadableNum) {
+            std::copy(BeginPtr_() + m_readpos, BeginPtr_() + m_writepos, data);
+        }
+        BufferPool::Free(m_data, m_cap);
+        m_data = data;
+        m_cap = cap;
+        m_readpos = 0;
+        m_writepos = ReadableNum;
     }else {
         size_t ReadableNum = ReadableBytes();
+        s_compact->Inc();
+        s_copied->Inc(ReadableNum);
         std::copy(BeginPtr_() + m_readpos, BeginPtr_() + m_writepos, BeginPtr_());
         // 否则把这一段移动到前面去，把后面腾出地方来
         m_readpos = 0;
@@ -107,21 +254,38 @@ void Buffer::Append(const void* data, size_t len) {
     Append(static_cast<const char*>(data), len);
 }
 
-void Buffer::Append(const std::string& str) {
-    Append(str.data(), str.length());
+void Buffer::Append(std::string_view str) {
+    EnsureWritable(str.size());
+    std::copy(str.begin(), str.end(), BeginWrite());
+    HasWritten(str.size());
+}
+
+void Buffer::AppendDecimal(long long value) {
+    EnsureWritable(24);
+    auto res = std::to_chars(BeginWrite(), BeginWrite() + 24, value);
+    HasWritten(res.ptr - BeginWrite());
 }
 
 
 ssize_t Buffer::ReadFd(int fd, int *Errno) {
     char buff[65535];
     struct iovec iov[2];
+    //超出内存预算时不再扩容 只读到现有空间里
+    const bool limited = BufferPool::OverBudget();
+    if(limited && WritableBytes() == 0) {
+        *Errno = ENOBUFS;
+        return -1;
+    }
+    if(!m_data) {
+        EnsureWritable(BufferPool::MIN_SIZE);
+    }
     const size_t writable = WritableBytes();
     iov[0].iov_base = BeginPtr_() + m_writepos; //第一个缓冲区的位置
     iov[0].iov_len = writable;
     iov[1].iov_base = buff;
     iov[1].iov_len = sizeof(buff);
 
-    const ssize_t len = readv(fd, iov, 2); //将数据填充到 iov 数组指定的多个缓冲区中
+    const ssize_t len = readv(fd, iov, limited ? 1 : 2); //将数据填充到 iov 数组指定的多个缓冲区中
 
     if(len < 0) {
         *Errno = errno;
@@ -129,7 +293,7 @@ ssize_t Buffer::ReadFd(int fd, int *Errno) {
         m_writepos += len;
     }else {
         //超过buffer可容纳长度
-        m_writepos = m_buffer.size();
+        m_writepos = m_cap;
         Append(buff, len - writable); // 将写到buff中的剩下那一段利用Append塞进去
         //如果失败的话 在makespace会触发assert
     }
@@ -152,9 +316,9 @@ ssize_t Buffer::WriteFd(int fd, int *Errno) {
 
 
 char* Buffer::BeginPtr_() {
-    return &*m_buffer.begin();
+    return m_data;
 }
 
 const char* Buffer::BeginPtr_() const{
-    return  &*m_buffer.begin();
+    return m_data;
 }
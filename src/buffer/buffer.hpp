@@ -7,11 +7,18 @@
 #include <vector>
 #include <cassert>
 #include <atomic>
+#include <cstdint>
+#include <string_view>
+#include "bufferpool.hpp"
 
 class Buffer {
 public:
     Buffer(int initBufferSize = 1024);
-    ~Buffer() = default;
+    ~Buffer();
+    Buffer(const Buffer& other);
+    Buffer(Buffer&& other) noexcept;
+    Buffer& operator=(const Buffer& other);
+    Buffer& operator=(Buffer&& other) noexcept;
     size_t WritableBytes() const;
     size_t ReadableBytes() const;
     size_t PrependableBytes() const;
@@ -25,24 +32,50 @@ public:
     void RetrieveAll();
     std::string RetrieveAllToStr();
 
+    //返回的string_view在下一次修改Buffer(扩容/搬移/清空/释放)前有效
+    std::string_view RetrieveView(size_t len);
+
+    //在可读区间里查找 找不到返回nullptr
+    const char* FindCRLF() const;
+    const char* FindCRLF(const char* start) const;
+    const char* Find(char ch) const;
+    const char* Find(char ch, const char* start) const;
+
+    //调试模式下每次可能让视图失效的修改都会让代数加一 持有视图的地方(HttpRequest::parse)用它断言视图没有过期
+    uint64_t Generation() const;
+    bool IsCurrent(uint64_t generation) const;
+
     const char* BeginWriteConst() const;
     char* BeginWrite();
 
-    void Append(const std::string& str);
+    void Append(std::string_view str);
     void Append(const char* str, size_t len);
     void Append(const void* data, size_t len);
     void Append(const Buffer& t_buffer);
+    //追加十进制整数 不经过std::to_string
+    void AppendDecimal(long long value);
 
+    //超出BufferPool预算时只读到已有空间里 一点空间都没有时返回-1 Errno为ENOBUFS
     ssize_t ReadFd(int fd, int* Errno);
     ssize_t WriteFd(int fd, int* Errno);
 
+    //没有可读数据时把存储还给BufferPool 连接空闲时调用 下次写入再按需分配
+    void Release();
+
+    size_t Capacity() const { return m_cap; }
+
 private:
     char* BeginPtr_();
     const char* BeginPtr_() const;
     void MakeSpace_(size_t len);
-    std::vector<char> m_buffer;
+    void Invalidate_();
+    char* m_data;
+    size_t m_cap;
     std::atomic<std::size_t> m_readpos;
     std::atomic<std::size_t> m_writepos;
+#ifndef NDEBUG
+    uint64_t m_generation = 0;
+#endif
 };
 
 
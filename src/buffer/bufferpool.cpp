@@ -0,0 +1,104 @@
+#include "bufferpool.hpp"
+#include <vector>
+
+std::atomic<size_t> BufferPool::m_resident(0);
+std::atomic<size_t> BufferPool::m_pooled(0);
+std::atomic<size_t> BufferPool::m_budget(0);
+
+namespace {
+const int CLASS_NUM = 11; // 1KB ~ 1MB
+const size_t MAX_CACHED_PER_CLASS = 2 << 20; //每个线程每档最多缓存的字节数
+
+struct LocalPool {
+    std::vector<char*> free[CLASS_NUM];
+    size_t cached[CLASS_NUM] = {};
+    std::atomic<size_t>* pooled = nullptr;
+    ~LocalPool() {
+        for(int i = 0; i < CLASS_NUM; i++) {
+            for(char* p: free[i]) {
+                delete[] p;
+            }
+            if(pooled) pooled->fetch_sub(cached[i], std::memory_order_relaxed);
+        }
+    }
+};
+thread_local LocalPool t_pool;
+}
+
+int BufferPool::ClassOf(size_t size) {
+    int cls = 0;
+    size_t cap = MIN_SIZE;
+    while(cap < size) {
+        cap <<= 1;
+        cls++;
+    }
+    return cls;
+}
+
+char* BufferPool::Alloc(size_t& size) {
+    if(size > MAX_SIZE) {
+        m_resident.fetch_add(size, std::memory_order_relaxed);
+        return new char[size];
+    }
+    int cls = ClassOf(size);
+    size = MIN_SIZE << cls;
+    m_resident.fetch_add(size, std::memory_order_relaxed);
+    auto& list = t_pool.free[cls];
+    if(!list.empty()) {
+        char* p = list.back();
+        list.pop_back();
+        t_pool.cached[cls] -= size;
+        m_pooled.fetch_sub(size, std::memory_order_relaxed);
+        return p;
+    }
+    return new char[size];
+}
+
+void BufferPool::Free(char* data, size_t size) {
+    if(!data) {
+        return;
+    }
+    m_resident.fetch_sub(size, std::memory_order_relaxed);
+    if(size > MAX_SIZE) {
+        delete[] data;
+        return;
+    }
+    int cls = ClassOf(size);
+    if(t_pool.cached[cls] + size > MAX_CACHED_PER_CLASS) {
+        delete[] data;
+        return;
+    }
+    t_pool.pooled = &m_pooled;
+    t_pool.free[cls].push_back(data);
+    t_pool.cached[cls] += size;
+    m_pooled.fetch_add(size, std::memory_order_relaxed);
+}
+
+void BufferPool::SetBudget(size_t bytes) {
+    m_budget.store(bytes, std::memory_order_relaxed);
+}
+
+size_t BufferPool::Budget() {
+    return m_budget.load(std::memory_order_relaxed);
+}
+
+bool BufferPool::OverBudget() {
+    size_t budget = m_budget.load(std::memory_order_relaxed);
+    return budget && m_resident.load(std::memory_order_relaxed) > budget;
+}
+
+void BufferPool::Charge(size_t size) {
+    m_resident.fetch_add(size, std::memory_order_relaxed);
+}
+
+void BufferPool::Uncharge(size_t size) {
+    m_resident.fetch_sub(size, std::memory_order_relaxed);
+}
+
+size_t BufferPool::ResidentBytes() {
+    return m_resident.load(std::memory_order_relaxed);
+}
+
+size_t BufferPool::PooledBytes() {
+    return m_pooled.load(std::memory_order_relaxed);
+}
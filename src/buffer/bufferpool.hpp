@@ -0,0 +1,44 @@
+#ifndef __BUFFERPOOL_HPP
+#define __BUFFERPOOL_HPP
+
+#include <atomic>
+#include <cstddef>
+
+/*
+Buffer的存储池 按2的幂分档(1KB ~ 1MB) 每个线程各有一组空闲链表 分配和归还不加锁
+更大的请求直接走new
+全局统计被Buffer占用的字节数 超过预算时OverBudget为真 由上层暂停读socket形成背压
+*/
+class BufferPool {
+public:
+    static const size_t MIN_SIZE = 1024;
+    static const size_t MAX_SIZE = 1 << 20;
+
+    //size会被向上取整到所在档位 返回时写回实际容量
+    static char* Alloc(size_t& size);
+    static void Free(char* data, size_t size);
+
+    //0表示不限制
+    static void SetBudget(size_t bytes);
+    static size_t Budget();
+    static bool OverBudget();
+
+    //不经过Alloc/Free的存储(RingBuffer的映射)也计入占用
+    static void Charge(size_t size);
+    static void Uncharge(size_t size);
+
+    //被Buffer持有的字节数
+    static size_t ResidentBytes();
+    //缓存在各线程空闲链表里的字节数
+    static size_t PooledBytes();
+
+private:
+    static int ClassOf(size_t size);
+
+    static std::atomic<size_t> m_resident;
+    static std::atomic<size_t> m_pooled;
+    static std::atomic<size_t> m_budget;
+};
+
+
+#endif
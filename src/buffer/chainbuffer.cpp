@@ -0,0 +1,184 @@
+#include "chainbuffer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <vector>
+
+namespace {
+//线程本地的空闲块 线程退出时释放
+struct BlockPool {
+    static const size_t MAX_FREE = 256;
+    std::vector<char*> blocks;
+    ~BlockPool() {
+        for(char* b: blocks) {
+            delete[] b;
+        }
+    }
+};
+thread_local BlockPool t_blockpool;
+}
+
+char* ChainBuffer::AllocBlock() {
+    if(!t_blockpool.blocks.empty()) {
+        char* b = t_blockpool.blocks.back();
+        t_blockpool.blocks.pop_back();
+        return b;
+    }
+    return new char[BLOCK_SIZE];
+}
+
+void ChainBuffer::FreeBlock(char* block) {
+    if(t_blockpool.blocks.size() < BlockPool::MAX_FREE) {
+        t_blockpool.blocks.push_back(block);
+    }else {
+        delete[] block;
+    }
+}
+
+size_t ChainBuffer::PooledBlocks() {
+    return t_blockpool.blocks.size();
+}
+
+ChainBuffer::~ChainBuffer() {
+    RetrieveAll();
+}
+
+size_t ChainBuffer::TailWritable() const {
+    if(m_nodes.empty() || !m_nodes.back().block) {
+        return 0;
+    }
+    const Node& tail = m_nodes.back();
+    return tail.cap - tail.len;
+}
+
+void ChainBuffer::Append(const char* data, size_t len) {
+    assert(data || len == 0);
+    while(len > 0) {
+        if(TailWritable() == 0) {
+            char* block = AllocBlock();
+            m_nodes.push_back({block, block, 0, BLOCK_SIZE, nullptr});
+        }
+        Node& tail = m_nodes.back();
+        size_t n = std::min(len, tail.cap - tail.len);
+        memcpy(const_cast<char*>(tail.data) + tail.len, data, n);
+        tail.len += n;
+        m_readable += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void ChainBuffer::Append(std::string_view str) {
+    Append(str.data(), str.size());
+}
+
+void ChainBuffer::Append(const Buffer& buff) {
+    Append(buff.Peek(), buff.ReadableBytes());
+}
+
+void ChainBuffer::AppendSlice(const char* data, size_t len, std::shared_ptr<const void> owner) {
+    if(len == 0) {
+        return;
+    }
+    assert(data);
+    m_nodes.push_back({nullptr, data, len, 0, std::move(owner)});
+    m_readable += len;
+}
+
+void ChainBuffer::PopFront() {
+    Node& front = m_nodes.front();
+    m_readable -= front.len;
+    if(front.block) {
+        FreeBlock(front.block);
+    }
+    m_nodes.pop_front();
+}
+
+void ChainBuffer::Retrieve(size_t len) {
+    assert(len <= m_readable);
+    while(len > 0) {
+        Node& front = m_nodes.front();
+        if(len >= front.len) {
+            len -= front.len;
+            PopFront();
+        }else {
+            front.data += len;
+            front.len -= len;
+            if(front.block) {
+                front.cap -= len;
+            }
+            m_readable -= len;
+            len = 0;
+        }
+    }
+}
+
+void ChainBuffer::RetrieveAll() {
+    while(!m_nodes.empty()) {
+        PopFront();
+    }
+    m_readable = 0;
+}
+
+ssize_t ChainBuffer::ReadFd(int fd, int* Errno) {
+    //先填尾块剩下的空间 再读进一个新块 读不完的下次再读(水平/边沿触发都会再来)
+    char* extra = AllocBlock();
+    struct iovec iov[2];
+    int cnt = 0;
+    size_t writable = TailWritable();
+    if(writable) {
+        Node& tail = m_nodes.back();
+        iov[cnt].iov_base = const_cast<char*>(tail.data) + tail.len;
+        iov[cnt].iov_len = writable;
+        cnt++;
+    }
+    iov[cnt].iov_base = extra;
+    iov[cnt].iov_len = BLOCK_SIZE;
+    cnt++;
+
+    const ssize_t len = readv(fd, iov, cnt);
+    if(len < 0) {
+        *Errno = errno;
+        FreeBlock(extra);
+        return len;
+    }
+    size_t first = std::min(static_cast<size_t>(len), writable);
+    if(first) {
+        m_nodes.back().len += first;
+        m_readable += first;
+    }
+    if(static_cast<size_t>(len) > writable) {
+        m_nodes.push_back({extra, extra, len - writable, BLOCK_SIZE, nullptr});
+        m_readable += len - writable;
+    }else {
+        FreeBlock(extra);
+    }
+    return len;
+}
+
+int ChainBuffer::PeekIov(struct iovec* iov, int maxCnt) const {
+    int cnt = 0;
+    for(auto it = m_nodes.begin(); it != m_nodes.end() && cnt < maxCnt; ++it) {
+        if(it->len == 0) continue;
+        iov[cnt].iov_base = const_cast<char*>(it->data);
+        iov[cnt].iov_len = it->len;
+        cnt++;
+    }
+    return cnt;
+}
+
+ssize_t ChainBuffer::WriteFd(int fd, int* Errno) {
+    struct iovec iov[IOV_MAX];
+    int cnt = PeekIov(iov, IOV_MAX);
+    if(cnt == 0) {
+        return 0;
+    }
+    const ssize_t len = writev(fd, iov, cnt);
+    if(len < 0) {
+        *Errno = errno;
+        return len;
+    }
+    Retrieve(len);
+    return len;
+}
@@ -0,0 +1,72 @@
+#ifndef __CHAINBUFFER_HPP
+#define __CHAINBUFFER_HPP
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "buffer.hpp"
+
+/*
+分段缓冲区 由定长块串成链
+块来自线程本地的块池 写满了就接一个新块 不会整体扩容和搬移
+可以把外部的只读内存(mmap的文件 缓存好的响应头)作为一段挂进来 不拷贝
+WriteFd用writev一次把整条链写出去 最多IOV_MAX段
+*/
+class ChainBuffer {
+public:
+    static const size_t BLOCK_SIZE = 16 * 1024;
+
+    ChainBuffer() = default;
+    ~ChainBuffer();
+    ChainBuffer(const ChainBuffer&) = delete;
+    ChainBuffer& operator=(const ChainBuffer&) = delete;
+
+    size_t ReadableBytes() const { return m_readable; }
+
+    size_t SegmentCount() const { return m_nodes.size(); }
+
+    void Append(const char* data, size_t len);
+    void Append(std::string_view str);
+    void Append(const Buffer& buff);
+
+    //挂一段外部只读内存 owner不为空时持有它直到这段写完 否则调用者保证内存一直有效
+    void AppendSlice(const char* data, size_t len, std::shared_ptr<const void> owner = nullptr);
+
+    void Retrieve(size_t len);
+    void RetrieveAll();
+
+    ssize_t ReadFd(int fd, int* Errno);
+    ssize_t WriteFd(int fd, int* Errno);
+
+    //把链头最多maxCnt段填进iov 不消费数据 给异步发送(io_uring)用 发送完成后再Retrieve
+    int PeekIov(struct iovec* iov, int maxCnt) const;
+
+    //线程本地块池里缓存的块数
+    static size_t PooledBlocks();
+
+private:
+    struct Node {
+        char* block; //自有块 外部段为nullptr
+        const char* data;
+        size_t len; //可读长度
+        size_t cap; //自有块从data开始还能写到的位置
+        std::shared_ptr<const void> owner;
+    };
+
+    static char* AllocBlock();
+    static void FreeBlock(char* block);
+
+    //尾部自有块还能写多少
+    size_t TailWritable() const;
+
+    void PopFront();
+
+    std::deque<Node> m_nodes;
+    size_t m_readable = 0;
+};
+
+
+#endif
@@ -0,0 +1,208 @@
+#include "ringbuffer.hpp"
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "bufferpool.hpp"
+
+RingBuffer::RingBuffer(size_t capacity): m_base(nullptr), m_cap(0), m_readpos(0), m_writepos(0) {
+    if(capacity == 0) {
+        return;
+    }
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t cap = page;
+    while(cap < capacity) cap <<= 1;
+    m_base = MapMirror(cap);
+    if(m_base) {
+        m_cap = cap;
+        BufferPool::Charge(m_cap);
+    }
+}
+
+RingBuffer::~RingBuffer() {
+    UnmapMirror(m_base, m_cap);
+    BufferPool::Uncharge(m_cap);
+}
+
+char* RingBuffer::MapMirror(size_t capacity) {
+    int fd = memfd_create("ringbuffer", MFD_CLOEXEC);
+    if(fd < 0) {
+        return nullptr;
+    }
+    if(ftruncate(fd, capacity) < 0) {
+        close(fd);
+        return nullptr;
+    }
+    //先占住两倍的地址空间 再把同一个文件映射到前后两半
+    void* base = mmap(nullptr, capacity * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(base == MAP_FAILED) {
+        close(fd);
+        return nullptr;
+    }
+    char* addr = static_cast<char*>(base);
+    void* first = mmap(addr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    void* second = mmap(addr + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    close(fd); //映射会持有文件
+    if(first == MAP_FAILED || second == MAP_FAILED) {
+        munmap(base, capacity * 2);
+        return nullptr;
+    }
+    return addr;
+}
+
+void RingBuffer::UnmapMirror(char* base, size_t capacity) {
+    if(base) {
+        munmap(base, capacity * 2);
+    }
+}
+
+bool RingBuffer::Grow(size_t need) {
+    size_t cap = m_cap ? m_cap : static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    while(cap - ReadableBytes() < need) cap <<= 1;
+    char* base = MapMirror(cap);
+    if(!base) {
+        return false; //保留原来的映射 数据不丢
+    }
+    size_t readable = ReadableBytes();
+    if(readable) {
+        memcpy(base, Peek(), readable);
+    }
+    UnmapMirror(m_base, m_cap);
+    BufferPool::Uncharge(m_cap);
+    BufferPool::Charge(cap);
+#ifndef NDEBUG
+    ++m_generation;
+#endif
+    m_base = base;
+    m_cap = cap;
+    m_readpos = 0;
+    m_writepos = readable;
+    return true;
+}
+
+bool RingBuffer::EnsureWritable(size_t len) {
+    return WritableBytes() >= len || Grow(len);
+}
+
+void RingBuffer::HasWritten(size_t len) {
+    assert(len <= WritableBytes());
+    m_writepos += len;
+}
+
+void RingBuffer::Retrieve(size_t len) {
+    assert(len <= ReadableBytes());
+    m_readpos += len;
+}
+
+void RingBuffer::RetrieveUntil(const char* end) {
+    assert(Peek() <= end);
+    Retrieve(end - Peek());
+}
+
+void RingBuffer::RetrieveAll() {
+    m_readpos = m_writepos = 0;
+}
+
+std::string RingBuffer::RetrieveAllToStr() {
+    std::string str(Peek(), ReadableBytes());
+    RetrieveAll();
+    return str;
+}
+
+std::string_view RingBuffer::RetrieveView(size_t len) {
+    assert(len <= ReadableBytes());
+    std::string_view view(Peek(), len);
+    m_readpos += len;
+    return view;
+}
+
+//可读区间在镜像映射里总是连续的 和Buffer一样直接memchr
+const char* RingBuffer::FindCRLF() const {
+    const char* start = Peek();
+    const char* end = start + ReadableBytes();
+    while(start < end) {
+        const char* cr = static_cast<const char*>(memchr(start, '\r', end - start));
+        if(!cr || cr + 1 >= end) return nullptr;
+        if(cr[1] == '\n') return cr;
+        start = cr + 1;
+    }
+    return nullptr;
+}
+
+bool RingBuffer::Append(const char* str, size_t len) {
+    assert(str || len == 0);
+    if(!EnsureWritable(len)) {
+        return false;
+    }
+    memcpy(BeginWrite(), str, len);
+    HasWritten(len);
+    return true;
+}
+
+bool RingBuffer::Append(const void* data, size_t len) {
+    return Append(static_cast<const char*>(data), len);
+}
+
+bool RingBuffer::Append(const std::string& str) {
+    return Append(str.data(), str.size());
+}
+
+uint64_t RingBuffer::Generation() const {
+#ifndef NDEBUG
+    return m_generation;
+#else
+    return 0;
+#endif
+}
+
+bool RingBuffer::IsCurrent(uint64_t generation) const {
+#ifndef NDEBUG
+    return generation == m_generation;
+#else
+    (void)generation;
+    return true;
+#endif
+}
+
+//写位置之后的空间总是连续的 一次read就够 读满了下次先扩容 超出预算时不扩容
+ssize_t RingBuffer::ReadFd(int fd, int* Errno) {
+    if(WritableBytes() == 0 && BufferPool::OverBudget()) {
+        *Errno = ENOBUFS;
+        return -1;
+    }
+    if(WritableBytes() == 0 && !Grow(m_cap ? m_cap : 1)) {
+        *Errno = ENOMEM;
+        return -1;
+    }
+    ssize_t len = read(fd, BeginWrite(), WritableBytes());
+    if(len < 0) {
+        *Errno = errno;
+        return len;
+    }
+    m_writepos += len;
+    return len;
+}
+
+ssize_t RingBuffer::WriteFd(int fd, int* Errno) {
+    ssize_t len = write(fd, Peek(), ReadableBytes());
+    if(len < 0) {
+        *Errno = errno;
+        return len;
+    }
+    m_readpos += len;
+    return len;
+}
+
+void RingBuffer::Release() {
+    if(ReadableBytes() == 0 && m_base) {
+        UnmapMirror(m_base, m_cap);
+        BufferPool::Uncharge(m_cap);
+#ifndef NDEBUG
+        ++m_generation;
+#endif
+        m_base = nullptr;
+        m_cap = 0;
+        m_readpos = m_writepos = 0;
+    }
+}
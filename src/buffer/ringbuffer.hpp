@@ -0,0 +1,83 @@
+#ifndef __RINGBUFFER_HPP
+#define __RINGBUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+/*
+镜像环形缓冲区: 同一组物理页(memfd)在虚拟地址上连续映射两次
+读写位置绕回开头时 [Peek, Peek + ReadableBytes) 依然是连续内存 不需要搬移数据
+ReadFd直接读到写位置上 接口和Buffer保持一致 编译时定义RING_READBUF时用作连接的读缓冲
+容量按页对齐 空间不够时才换一个更大的环 映射的字节数计入BufferPool的占用和预算
+*/
+class RingBuffer {
+public:
+    //capacity为0时先不映射 第一次写入时再建立
+    explicit RingBuffer(size_t capacity = 64 * 1024);
+    ~RingBuffer();
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    //映射失败时为false
+    bool IsValid() const { return m_base != nullptr; }
+
+    size_t WritableBytes() const { return m_cap - ReadableBytes(); }
+    size_t ReadableBytes() const { return m_writepos - m_readpos; }
+    size_t Capacity() const { return m_cap; }
+
+    const char* Peek() const { return m_base + (m_readpos & (m_cap - 1)); }
+    //扩容失败(映射不出新的环)时返回false 原有数据不受影响
+    bool EnsureWritable(size_t len);
+    void HasWritten(size_t len);
+
+    void Retrieve(size_t len);
+    void RetrieveUntil(const char* end);
+    void RetrieveAll();
+    std::string RetrieveAllToStr();
+
+    //返回的string_view在下一次换环或Release前有效
+    std::string_view RetrieveView(size_t len);
+
+    //在可读区间里查找 找不到返回nullptr
+    const char* FindCRLF() const;
+
+    //调试模式下换环或解除映射时代数加一 和Buffer一样用来断言视图没有过期
+    uint64_t Generation() const;
+    bool IsCurrent(uint64_t generation) const;
+
+    char* BeginWrite() { return m_base + (m_writepos & (m_cap - 1)); }
+    const char* BeginWriteConst() const { return m_base + (m_writepos & (m_cap - 1)); }
+
+    //空间不够又扩不了容时什么都不写 返回false
+    bool Append(const std::string& str);
+    bool Append(const char* str, size_t len);
+    bool Append(const void* data, size_t len);
+
+    //满了时超出BufferPool预算返回-1 Errno为ENOBUFS 扩容失败返回-1 Errno为ENOMEM
+    ssize_t ReadFd(int fd, int* Errno);
+    ssize_t WriteFd(int fd, int* Errno);
+
+    //没有可读数据时解除映射 连接空闲时调用 下次写入再建立
+    void Release();
+
+private:
+    //建立capacity大小的双重映射 capacity需为2的幂且按页对齐
+    static char* MapMirror(size_t capacity);
+    static void UnmapMirror(char* base, size_t capacity);
+
+    bool Grow(size_t need);
+
+    char* m_base;
+    size_t m_cap;
+    uint64_t m_readpos;
+    uint64_t m_writepos;
+#ifndef NDEBUG
+    uint64_t m_generation = 0;
+#endif
+};
+
+
+#endif
@@ -0,0 +1,270 @@
+#include "httpconn.hpp"
+#include <cerrno>
+#include <unistd.h>
+#include "../metrics/metrics.hpp"
+
+static Counter* const s_requests = Metrics::Instance()->NewCounter(
+    "webserver_http_requests_total", "Requests parsed completely");
+static Counter* const s_parseErrors = Metrics::Instance()->NewCounter(
+    "webserver_http_parse_errors_total", "Malformed or oversized requests answered with an error status");
+static Histogram* const s_parseTime = Metrics::Instance()->NewHistogram(
+    "webserver_http_parse_seconds", "Time spent in one incremental parse call");
+static Histogram* const s_buildTime = Metrics::Instance()->NewHistogram(
+    "webserver_http_response_build_seconds", "Time to build a response (stat, open, mmap, headers)");
+
+//每个响应码一个计数器 第一次出现时创建
+static Counter* ResponseCounter(int code) {
+    static std::atomic<Counter*> counters[600];
+    if(code < 0 || code >= 600) code = 0;
+    Counter* counter = counters[code].load(std::memory_order_acquire);
+    if(!counter) {
+        counter = Metrics::Instance()->NewCounter("webserver_http_responses_total{code=\"" + std::to_string(code) + "\"}",
+                                                  "Responses by status code");
+        counters[code].store(counter, std::memory_order_release);
+    }
+    return counter;
+}
+
+std::string HttpConn::srcDir;
+std::atomic<int> HttpConn::userCount(0);
+uint32_t HttpConn::idleTimeoutMS = 120000;
+uint32_t HttpConn::headerTimeoutMS = 10000;
+uint32_t HttpConn::bodyTimeoutMS = 30000;
+int HttpConn::maxRequests = 1000;
+std::string HttpConn::metricsPath = "/metrics";
+
+HttpConn::HttpConn(): m_fd(-1), m_isclose(true), m_busy(false), m_keepalive(false), m_ownfd(true),
+                      m_corked(false), m_phase(PHASE_NONE), m_requests(0), m_id(0), m_addr({0}), m_readbuf(0) {
+    m_timer.data = this;
+    m_response.SetTrace(&m_trace);
+}
+
+HttpConn::~HttpConn() {
+    Close();
+}
+
+void HttpConn::Init(int fd, const sockaddr_in& addr, uint64_t id, bool ownFd) {
+    assert(fd >= 0);
+    m_ownfd = ownFd;
+    userCount++;
+    m_fd = fd;
+    m_id = id;
+    m_addr = addr;
+    m_isclose = false;
+    m_busy = false;
+    m_keepalive = false;
+    m_corked = false;
+    m_phase = PHASE_NONE;
+    m_requests = 0;
+    m_readbuf.RetrieveAll();
+    m_writebuf.RetrieveAll();
+    m_request.Init();
+    m_trace.Reset();
+    m_allocs = AllocCount();
+    LOG_INFO("Client[%d](%s:%d) in, userCount:%d", m_fd, GetIP(), GetPort(), (int)userCount);
+}
+
+void HttpConn::Close() {
+    if(m_isclose) return;
+    //链里可能还挂着文件映射 先清掉再解除映射
+    m_writebuf.RetrieveAll();
+    m_response.UnmapFile();
+    m_readbuf.RetrieveAll();
+    if(m_readbuf.Capacity() > WARM_BUFFER) {
+        m_readbuf.Release(); //大缓冲区不留给下一个连接
+    }
+    m_trace.Reset();
+    m_allocs = AllocCount();
+    m_isclose = true;
+    userCount--;
+    if(m_ownfd) {
+        close(m_fd);
+    }
+    LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", m_fd, GetIP(), GetPort(), (int)userCount);
+}
+
+const char* HttpConn::GetIP() const {
+    return inet_ntoa(m_addr.sin_addr);
+}
+
+bool HttpConn::Feed(const char* data, size_t len) {
+#ifdef RING_READBUF
+    return m_readbuf.Append(data, len);
+#else
+    m_readbuf.Append(data, len);
+    return true;
+#endif
+}
+
+ssize_t HttpConn::Read(int* saveErrno) {
+    ssize_t len = -1;
+    do {
+        if(m_readbuf.ReadableBytes() >= MAX_READ) {
+            //一个客户端一直塞满socket也只能占这么多 剩下的留在内核里
+            *saveErrno = ENOBUFS;
+            return -1;
+        }
+        len = m_readbuf.ReadFd(m_fd, saveErrno);
+    }while(len > 0);
+    return len;
+}
+
+ssize_t HttpConn::Write(int* saveErrno) {
+    ssize_t len = -1;
+    while(m_writebuf.ReadableBytes() > 0) {
+        len = m_writebuf.WriteFd(m_fd, saveErrno);
+        if(len <= 0) break;
+    }
+    return len;
+}
+
+HttpConn::PARSE_RESULT HttpConn::Parse() {
+    if(m_readbuf.ReadableBytes() == 0) {
+        return PARSE_AGAIN;
+    }
+    if(!m_trace.Started()) {
+        TRACE_PROBE1(request_start, m_id);
+        m_trace.Begin(m_id);
+    }
+    AllocScope scope(AT_PARSE, &m_allocs);
+    auto begin = std::chrono::steady_clock::now();
+    bool ok = m_request.parse(m_readbuf);
+    s_parseTime->RecordSince(begin);
+    if(!ok) {
+        s_parseErrors->Inc();
+        return PARSE_BAD;
+    }
+    if(!m_request.IsFinished()) {
+        return PARSE_AGAIN; //等更多数据
+    }
+    s_requests->Inc();
+    TRACE_MARK(m_trace, TP_PARSED, request_parsed, m_id);
+    if(m_request.NeedsVerify()) {
+        TRACE_MARK(m_trace, TP_VERIFY_BEGIN, verify_begin, m_id);
+        if(HttpRequest::VerifyBlocks()) {
+            return PARSE_VERIFY; //由reactor交给线程池
+        }
+        m_request.Verify();
+        TRACE_MARK(m_trace, TP_VERIFY_END, verify_end, m_id);
+    }
+    return PARSE_OK;
+}
+
+void HttpConn::FinishVerify(bool ok) {
+    TRACE_MARK(m_trace, TP_VERIFY_END, verify_end, m_id);
+    m_request.FinishVerify(ok);
+}
+
+bool HttpConn::Process() {
+    switch(Parse()) {
+        case PARSE_OK:
+            if(!RespondInternal()) Respond();
+            return true;
+        case PARSE_BAD: Respond(m_request.ErrorCode()); return true;
+        default: return false;
+    }
+}
+
+void HttpConn::Respond(int code) {
+    AllocScope scope(AT_RESPONSE, &m_allocs);
+    auto begin = StartResponse();
+    InitResponse(code);
+    m_response.MakeResponse(m_writebuf);
+    RecordResponse(begin);
+    LOG_DEBUG("response %d to be written", (int)m_writebuf.ReadableBytes());
+}
+
+void HttpConn::Respond(int fd, const struct stat& st) {
+    AllocScope scope(AT_RESPONSE, &m_allocs);
+    auto begin = StartResponse();
+    InitResponse(-1);
+    m_response.MakeResponse(m_writebuf, fd, st);
+    RecordResponse(begin);
+}
+
+void HttpConn::Reject(int retryAfter) {
+    AllocScope scope(AT_RESPONSE, &m_allocs);
+    auto begin = StartResponse();
+    InitResponse(503);
+    m_response.SetRetryAfter(retryAfter);
+    m_response.MakeResponse(m_writebuf);
+    RecordResponse(begin);
+}
+
+bool HttpConn::RespondInternal() {
+    if(metricsPath.empty() || m_request.path() != metricsPath) {
+        return false;
+    }
+    //io_uring的连接没有对端地址(0.0.0.0) 分不清是不是本机 也当外面来的
+    if((ntohl(m_addr.sin_addr.s_addr) >> 24) != 127) {
+        return false; //外面来的当普通文件处理 一般就是404
+    }
+    AllocScope scope(AT_RESPONSE, &m_allocs);
+    auto begin = StartResponse();
+    InitResponse(-1);
+    m_response.SetContent(Metrics::Instance()->Render());
+    m_response.MakeResponse(m_writebuf);
+    RecordResponse(begin);
+    return true;
+}
+
+std::chrono::steady_clock::time_point HttpConn::StartResponse() {
+    TRACE_MARK(m_trace, TP_BUILD_BEGIN, build_begin, m_id);
+    return std::chrono::steady_clock::now();
+}
+
+void HttpConn::RecordResponse(std::chrono::steady_clock::time_point begin) {
+    s_buildTime->RecordSince(begin);
+    ResponseCounter(m_response.Code())->Inc();
+    TRACE_MARK(m_trace, TP_BUILD_END, build_end, m_id);
+    m_trace.SetBytes(m_writebuf.ReadableBytes());
+}
+
+void HttpConn::InitResponse(int code) {
+    m_requests++;
+    //解析出错后缓冲区里剩下的数据没法再对齐到请求边界 回完错误就关
+    m_keepalive = m_request.IsKeepAlive() && m_request.ErrorCode() == 0
+                  && (maxRequests <= 0 || m_requests < maxRequests);
+    m_response.Init(srcDir, m_request.path(), m_keepalive, code);
+    if(m_keepalive) {
+        m_response.SetKeepAlive(idleTimeoutMS / 1000, maxRequests > 0 ? maxRequests - m_requests : 0);
+    }
+    if(m_request.NewSession() != "") {
+        m_response.SetSession(m_request.NewSession(), SessionStore::Instance()->Ttl());
+    }
+}
+
+void HttpConn::ResetForNext() {
+    TRACE_PROBE2(request_done, m_id, m_response.Code());
+    m_trace.End(m_response.Code(), m_request.path());
+    AllocProfiler::RequestDone(m_allocs);
+    m_allocs = AllocCount();
+    m_writebuf.RetrieveAll();
+    m_response.UnmapFile();
+    m_request.Init();
+    if(m_readbuf.Capacity() > WARM_BUFFER) {
+        m_readbuf.Release(); //大请求撑大的缓冲区不留着等下一个请求 没有剩余数据时才真正释放
+    }
+}
+
+bool HttpConn::NextDeadline(uint32_t* timeoutMS) {
+    TIMEOUT_PHASE phase = PHASE_IDLE;
+    if(!m_busy && m_writebuf.ReadableBytes() == 0) {
+        HttpRequest::PARSE_STATE state = m_request.State();
+        if(state == HttpRequest::BODY) {
+            phase = PHASE_BODY;
+        }else if(state == HttpRequest::HEADERS || (state == HttpRequest::REQUEST_LINE && m_readbuf.ReadableBytes() > 0)) {
+            phase = PHASE_HEADER;
+        }
+    }
+    if(phase == m_phase && phase != PHASE_IDLE) {
+        return false; //期限不随数据到达而推迟
+    }
+    m_phase = phase;
+    switch(phase) {
+        case PHASE_HEADER: *timeoutMS = headerTimeoutMS; break;
+        case PHASE_BODY: *timeoutMS = bodyTimeoutMS; break;
+        default: *timeoutMS = idleTimeoutMS; break;
+    }
+    return true;
+}
@@ -0,0 +1,180 @@
+#ifndef __HTTPCONN_HPP
+#define __HTTPCONN_HPP
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include "httprequest.hpp"
+#include "httpresponse.hpp"
+#include "../buffer/buffer.hpp"
+#include "../buffer/chainbuffer.hpp"
+#include "../metrics/allocprofile.hpp"
+#include "../timer/timerwheel.hpp"
+#include "../trace/trace.hpp"
+
+/*
+一个HTTP连接 只属于创建它的reactor线程 所有方法都只在那个线程调用
+边缘触发: Read/Write都会一直读写到EAGAIN为止
+读缓冲用Buffer或RingBuffer(RING_READBUF 超预算时ReadFd都返回ENOBUFS 由reactor稍后重试) 写用ChainBuffer 文件内容直接挂mmap
+对象由ConnPool复用 关闭后不超过WARM_BUFFER的读缓冲留着给下一个连接
+*/
+class alignas(64) HttpConn {
+public:
+    //连接当前处在哪个超时阶段
+    enum TIMEOUT_PHASE : uint8_t {
+        PHASE_NONE,
+        PHASE_IDLE, //等下一个请求 或者响应正在发送 有进展就续期
+        PHASE_HEADER, //收到请求的第一个字节起 头部必须在期限内收完 中途收到数据不续期
+        PHASE_BODY //头部收完起 请求体必须在期限内收完
+    };
+
+    enum PARSE_RESULT {
+        PARSE_AGAIN, //请求还不完整
+        PARSE_BAD, //请求格式错误
+        PARSE_VERIFY, //需要查用户存储 之后调用FinishVerify
+        PARSE_OK //请求完整 可以生成响应
+    };
+
+    HttpConn();
+    ~HttpConn();
+    HttpConn(const HttpConn&) = delete;
+    HttpConn& operator=(const HttpConn&) = delete;
+
+    //ownFd为false时fd不是真正的描述符(io_uring固定文件槽位) Close不去close它
+    void Init(int fd, const sockaddr_in& addr, uint64_t id, bool ownFd = true);
+
+    void Close();
+
+    //池里空闲对象太多时调用 把留着的缓冲区还给BufferPool
+    void Shrink() { m_readbuf.Release(); }
+
+    //读到EAGAIN/对端关闭/超预算为止 返回最后一次ReadFd的结果
+    //读缓冲里已经有MAX_READ字节时不再读 和超预算一样返回-1和ENOBUFS 先解析再稍后重试
+    ssize_t Read(int* saveErrno);
+
+    //写到写完或EAGAIN为止
+    ssize_t Write(int* saveErrno);
+
+    //把别处收到的数据放进读缓冲(io_uring的provided buffer) 读缓冲扩不了容时返回false 调用者关闭连接
+    bool Feed(const char* data, size_t len);
+
+    //解析读缓冲里的请求 不生成响应 不阻塞时的用户验证直接在这里做完
+    PARSE_RESULT Parse();
+
+    //同步生成响应(stat/open/mmap都在当前线程)
+    void Respond(int code = -1);
+
+    //文件已经异步打开 只做mmap
+    void Respond(int fd, const struct stat& st);
+
+    //过载时拒绝当前请求 回503和Retry-After 不碰文件系统
+    void Reject(int retryAfter);
+
+    //PARSE_OK之后先调用 请求的是内部路由(/metrics)时直接生成响应并返回true 否则照常发文件
+    bool RespondInternal();
+
+    //PARSE_OK之后要发送的文件路径
+    std::string Target() const { return srcDir + m_request.path(); }
+
+    //Parse + 同步Respond 请求完整并生成了响应时返回true
+    //请求需要阻塞地查用户存储时返回false 并把NeedsVerify置位 由调用者安排Verify
+    bool Process();
+
+    //阻塞的Verify完成后回到reactor线程调用 之后再Respond
+    void FinishVerify(bool ok);
+
+    //待发送数据 异步发送时用PeekIov取段 完成后Retrieve
+    ChainBuffer& WriteBuffer() { return m_writebuf; }
+
+    int GetFd() const { return m_fd; }
+    uint64_t GetId() const { return m_id; }
+    int GetPort() const { return ntohs(m_addr.sin_port); }
+    const char* GetIP() const;
+    bool IsClosed() const { return m_isclose; }
+
+    //TCP_CORK是否打开着 由reactor在一个响应要分多次写时设置
+    bool IsCorked() const { return m_corked; }
+    void SetCorked(bool corked) { m_corked = corked; }
+
+    //有请求交给了线程池还没回来
+    bool IsBusy() const { return m_busy; }
+    void SetBusy(bool busy) { m_busy = busy; }
+
+    bool NeedsVerify() const { return m_request.NeedsVerify(); }
+    const HttpRequest& Request() const { return m_request; }
+
+    size_t ToWriteBytes() const { return m_writebuf.ReadableBytes(); }
+    size_t ToReadBytes() const { return m_readbuf.ReadableBytes(); }
+
+    //当前响应写完后是否保持连接
+    bool IsKeepAlive() const { return m_keepalive; }
+
+    //响应写完之后调用 释放文件映射 准备下一个请求 超过WARM_BUFFER的空读缓冲还给池
+    void ResetForNext();
+
+    //reactor的时间轮节点
+    TimerNode& Timer() { return m_timer; }
+
+    //当前请求的分阶段追踪 后端自己的阶段(异步打开文件)也打在这上面
+    RequestTrace& Trace() { return m_trace; }
+
+    //每次处理完事件后调用 需要(重新)设定超时时返回true并给出时长 时长为0表示取消定时器
+    //头部和请求体阶段的期限从进入阶段时算起 期间的数据不会推迟它
+    bool NextDeadline(uint32_t* timeoutMS);
+
+    static const int MAX_CONN = 65536;
+    static const size_t CACHE_LINE = 64;
+    static const size_t WARM_BUFFER = 16 * 1024;
+    //一个连接读缓冲的上限 够放一个最大的请求 再多解析器也会回431/413
+    static const size_t MAX_READ = HttpRequest::MAX_HEADER + HttpRequest::MAX_BODY;
+
+    static std::string srcDir;
+    static std::atomic<int> userCount;
+
+    //超时和每连接请求数上限 启动前设置 0表示不限制
+    static uint32_t idleTimeoutMS;
+    static uint32_t headerTimeoutMS;
+    static uint32_t bodyTimeoutMS;
+    static int maxRequests;
+
+    //指标输出的路径 为空时不提供 只响应来自本机的请求(io_uring下拿不到对端地址 等于不提供)
+    static std::string metricsPath;
+
+private:
+    void InitResponse(int code);
+
+    //开始生成响应 返回开始时间
+    std::chrono::steady_clock::time_point StartResponse();
+
+    //响应生成之后记录耗时和响应码
+    void RecordResponse(std::chrono::steady_clock::time_point begin);
+
+    //每个事件都要碰的字段放在第一条缓存行里
+    int m_fd;
+    bool m_isclose;
+    bool m_busy;
+    bool m_keepalive;
+    bool m_ownfd;
+    bool m_corked;
+    TIMEOUT_PHASE m_phase;
+    int m_requests; //这个连接上已经响应的请求数
+    uint64_t m_id;
+    TimerNode m_timer;
+
+    alignas(CACHE_LINE) sockaddr_in m_addr;
+
+    ReadBuffer m_readbuf;
+    ChainBuffer m_writebuf;
+
+    HttpRequest m_request;
+    HttpResponse m_response;
+
+    RequestTrace m_trace;
+    AllocCount m_allocs; //当前请求在解析和生成响应时的堆分配 PROFILE_ALLOCS时才有值
+};
+
+
+#endif
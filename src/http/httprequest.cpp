@@ -1,10 +1,13 @@
 #include "httprequest.hpp"
 #include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cstdint>
 #include <cstdio>
-#include <mysql/mysql.h>
 #include <regex>
 #include <unordered_map>
 #include <unordered_set>
+#include "../metrics/metrics.hpp"
 
 const std::unordered_set<std::string> HttpRequest::DEFAULT_HTML {
     "/index","/register","/login","/welcome",
@@ -15,11 +18,87 @@ const std::unordered_map<std::string, int> HttpRequest::DEFAULT_HTML_TAG {
     {"/register.html", 0},{"/login.html", 1}
 };
 
+UserStore* HttpRequest::m_userstore = nullptr;
+
+//头部名字和Connection等的取值都不区分大小写 统一转成小写再比较
+static std::string ToLower(std::string_view str) {
+    std::string out(str);
+    std::transform(out.begin(), out.end(), out.begin(), [](unsigned char ch) { return std::tolower(ch); });
+    return out;
+}
+
+static std::string_view Trim(std::string_view str) {
+    while(!str.empty() && (str.front() == ' ' || str.front() == '\t')) str.remove_prefix(1);
+    while(!str.empty() && (str.back() == ' ' || str.back() == '\t')) str.remove_suffix(1);
+    return str;
+}
+
+//逗号分隔的列表里有没有token 比如Connection: Keep-Alive, Upgrade
+static bool HasToken(std::string_view list, std::string_view token) {
+    while(!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = Trim(list.substr(0, comma));
+        if(item.size() == token.size()
+           && std::equal(item.begin(), item.end(), token.begin(),
+                         [](char a, char b) { return std::tolower((unsigned char)a) == std::tolower((unsigned char)b); })) {
+            return true;
+        }
+        if(comma == std::string_view::npos) break;
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+//请求路径直接拼在srcDir后面打开 必须以/开头 不能有..这一段 也不能夹着\0
+static bool SafePath(std::string_view path) {
+    if(path.empty() || path[0] != '/' || path.find('\0') != std::string_view::npos) {
+        return false;
+    }
+    size_t pos = 0;
+    while(pos < path.size()) {
+        size_t end = path.find('/', pos);
+        if(end == std::string_view::npos) end = path.size();
+        if(path.substr(pos, end - pos) == "..") {
+            return false;
+        }
+        pos = end + 1;
+    }
+    return true;
+}
+
+//Content-Length只能是十进制数字 不能为空 不能溢出 否则请求体边界说不清
+static bool ParseLength(std::string_view value, size_t* len) {
+    if(value.empty()) {
+        return false;
+    }
+    size_t n = 0;
+    for(char ch: value) {
+        if(ch < '0' || ch > '9') {
+            return false;
+        }
+        if(n > (SIZE_MAX - (ch - '0')) / 10) {
+            return false;
+        }
+        n = n * 10 + (ch - '0');
+    }
+    *len = n;
+    return true;
+}
+
+void HttpRequest::SetUserStore(UserStore* store) {
+    m_userstore = store;
+}
+
 
 void HttpRequest::Init() {
     m_body = m_method = m_version = m_path = "";
+    m_user = m_newsession = "";
 
     m_state = REQUEST_LINE;
+    m_contentlen = 0;
+    m_headerlen = 0;
+    m_errcode = 0;
+    m_verify = VERIFY_NONE;
 
     m_header.clear();
     m_post.clear();
@@ -27,47 +106,78 @@ void HttpRequest::Init() {
 
 
 bool HttpRequest::IsKeepAlive() const {
-    if(m_header.count("Connection") == 1) {
-        return (m_header.find("Connection")->second == "keep-alive") && (m_version == "1.1");
+    //HTTP/1.1默认保持连接 除非带了close HTTP/1.0要显式带keep-alive
+    auto it = m_header.find("connection");
+    std::string_view conn = (it == m_header.end()) ? std::string_view() : std::string_view(it->second);
+    if(HasToken(conn, "close")) {
+        return false;
     }
-    return false;
+    if(m_version == "1.1") {
+        return true;
+    }
+    return m_version == "1.0" && HasToken(conn, "keep-alive");
 }
 
-bool HttpRequest::parse(Buffer& buffer) {
-    const char CRLF[] = "\r\n";
-
+bool HttpRequest::parse(ReadBuffer& buffer) {
     if(buffer.ReadableBytes() <= 0) {
         return false;
     }
 
     while(buffer.ReadableBytes() && m_state != FINISH) { //没解析完就继续解析
-        const char* lineEnd = std::search(buffer.Peek(), buffer.BeginWriteConst(), CRLF, CRLF + 2);
-        std::string line(buffer.Peek(), lineEnd);
+        if(m_state == BODY) {
+            //请求体按Content-Length收齐了再解析
+            if(buffer.ReadableBytes() < m_contentlen) break;
+            [[maybe_unused]] const uint64_t gen = buffer.Generation();
+            ParseBody(buffer.RetrieveView(m_contentlen));
+            assert(buffer.IsCurrent(gen));
+            break;
+        }
+        //行直接是Buffer里的视图 解析期间Buffer不会被修改 不完整的行留到下次
+        const char* lineEnd = buffer.FindCRLF();
+        [[maybe_unused]] const uint64_t gen = buffer.Generation();
+        if(!lineEnd) {
+            //一直等不到换行的话缓冲区会无限增长
+            if(m_headerlen + buffer.ReadableBytes() > MAX_HEADER) {
+                LOG_WARN_EVERY_MS(1000, "Request Error! Header too large");
+                return Fail(431);
+            }
+            break;
+        }
+        m_headerlen += lineEnd + 2 - buffer.Peek();
+        if(m_headerlen > MAX_HEADER) {
+            LOG_WARN_EVERY_MS(1000, "Request Error! Header too large");
+            return Fail(431);
+        }
+        std::string_view line(buffer.Peek(), lineEnd - buffer.Peek());
         switch(m_state) {
             case REQUEST_LINE: {
                 if(!ParseRequestLine(line)) {
-                    return false;
+                    return Fail(400);
                 }
                 ParsePath();
             }break;
             case HEADERS: {
-                ParseHeader(line);
-                if(buffer.ReadableBytes() <= 2) {
-                    m_state = FINISH;
+                if(!ParseHeader(line)) {
+                    return Fail(400);
                 }
             }break;
-            case BODY: {
-                ParseBody(line);
-            }
             default:break;
         }
-        if(lineEnd == buffer.BeginWriteConst()) break;
+        assert(buffer.IsCurrent(gen)); //lineEnd和line在Parse*期间一直指着缓冲区
         buffer.RetrieveUntil(lineEnd + 2); //跳过这么多
     }
-    LOG_DEBUG("[%s],[%s],[%s]", m_method.c_str(), m_path.c_str(), m_version.c_str());
+    if(m_state == FINISH) {
+        LOG_DEBUG("[%s],[%s],[%s]", m_method.c_str(), m_path.c_str(), m_version.c_str());
+    }
     return true;
 }
 
+bool HttpRequest::Fail(int code) {
+    if(m_errcode == 0) {
+        m_errcode = code;
+    }
+    return false;
+}
 
 void HttpRequest::ParsePath() {
     if(m_path == "/") {
@@ -83,37 +193,98 @@ void HttpRequest::ParsePath() {
 }
 
 
-bool HttpRequest::ParseRequestLine(const std::string& line) {
-    std::regex pattern("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$"); 
-    std::smatch submatches;
-    if(std::regex_match(line, submatches, pattern)) {
+bool HttpRequest::ParseRequestLine(std::string_view line) {
+    static const std::regex pattern("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
+    std::cmatch submatches;
+    if(std::regex_match(line.data(), line.data() + line.size(), submatches, pattern)) {
         //submatches[0]是整个匹配内容 ()代表第几组
         m_method = submatches[1];   
         m_path = submatches[2];   
         m_version = submatches[3];
+        if(!SafePath(m_path)) {
+            LOG_WARN_EVERY_MS(1000, "Request Error! Unsafe path");
+            return false;
+        }
         m_state = HEADERS;   
         return true;
     }
-    LOG_ERROR("Request Error! Match line failed");
+    LOG_ERROR_EVERY_MS(1000, "Request Error! Match line failed");
     return false;
 } 
 
-void HttpRequest::ParseHeader(const std::string& line) {
-    std::regex pattern("^([^:]*): ?(.*)$"); //.matches any character (except for line terminators)
+bool HttpRequest::ParseHeader(std::string_view line) {
+    if(line.empty()) {
+        //空行 头部结束
+        //不支持分块传输 带Transfer-Encoding的请求体边界和上游代理的理解可能不一致 直接拒绝并关闭
+        if(m_header.count("transfer-encoding")) {
+            if(m_header.count("content-length")) {
+                LOG_WARN_EVERY_MS(1000, "Request Error! Both Transfer-Encoding and Content-Length");
+                return Fail(400);
+            }
+            LOG_WARN_EVERY_MS(1000, "Request Error! Transfer-Encoding not supported");
+            return Fail(501);
+        }
+        auto it = m_header.find("content-length");
+        m_contentlen = 0;
+        if(it != m_header.end() && !ParseLength(it->second, &m_contentlen)) {
+            LOG_WARN_EVERY_MS(1000, "Request Error! Bad Content-Length");
+            return Fail(400);
+        }
+        if(m_contentlen > MAX_BODY) {
+            LOG_WARN_EVERY_MS(1000, "Request body too large: %zu", m_contentlen);
+            return Fail(413);
+        }
+        m_state = m_contentlen > 0 ? BODY : FINISH;
+        return true;
+    }
+    static const std::regex pattern("^([^:]*): ?(.*)$"); //.matches any character (except for line terminators)
     // ?matches the previous token between zero and one times, as many times as possible, giving back as needed
-    std::smatch submatches;
-    if(std::regex_match(line, submatches, pattern)) {
-        m_header[submatches[1]] = submatches[2];
-    }else {
-        m_state = BODY;
+    std::cmatch submatches;
+    if(std::regex_match(line.data(), line.data() + line.size(), submatches, pattern)) {
+        std::string name = ToLower(std::string_view(submatches[1].first, submatches[1].length()));
+        std::string_view value = Trim(std::string_view(submatches[2].first, submatches[2].length()));
+        auto it = m_header.find(name);
+        if(it == m_header.end()) {
+            m_header.emplace(name, value);
+        }else if(name == "content-length") {
+            if(it->second != value) {
+                LOG_WARN_EVERY_MS(1000, "Request Error! Conflicting Content-Length");
+                return false; //两个不同的长度 按哪个都可能被利用来走私请求
+            }
+        }else {
+            //同名头部按列表合并
+            it->second += ", ";
+            it->second += value;
+        }
+        if(name == "cookie") {
+            ParseSession(value);
+        }
+        return true;
+    }
+    LOG_ERROR_EVERY_MS(1000, "Request Error! Bad header line");
+    return false;
+}
+
+void HttpRequest::ParseSession(std::string_view cookie) {
+    //Cookie: a=b; sid=xxx
+    size_t pos = 0;
+    while(pos < cookie.size()) {
+        size_t end = cookie.find(';', pos);
+        if(end == std::string::npos) end = cookie.size();
+        size_t begin = cookie.find_first_not_of(' ', pos);
+        if(begin < end && cookie.compare(begin, 4, "sid=") == 0) {
+            SessionStore::Instance()->Lookup(std::string(cookie.substr(begin + 4, end - begin - 4)), m_user);
+            return;
+        }
+        pos = end + 1;
     }
 }
 
-void HttpRequest::ParseBody(const std::string& line) {
+void HttpRequest::ParseBody(std::string_view line) {
     m_body = line;
     ParsePost();
     m_state = FINISH;
-    LOG_DEBUG("Body:%s, len: %d", line.c_str(), line.size());
+    LOG_DEBUG("Body:%s, len: %d", m_body.c_str(), m_body.size());
 }
 
 
@@ -125,23 +296,51 @@ int HttpRequest::ConverHex(char ch) {
 }
 
 void HttpRequest::ParsePost() {
-    if(m_method == "POST" && m_header["Content-Type"] == "application/x-www-form-urlencoded") {
+    auto it = m_header.find("content-type");
+    //媒体类型不区分大小写 后面可能还带着; charset=...
+    if(m_method == "POST" && it != m_header.end()
+       && ToLower(Trim(std::string_view(it->second).substr(0, it->second.find(';')))) == "application/x-www-form-urlencoded") {
         ParseFromUrlencoded();
         if(DEFAULT_HTML_TAG.count(m_path)) {
             int tag = DEFAULT_HTML_TAG.find(m_path)->second;
             LOG_DEBUG("Tag:%d", tag);
             if(tag == 0 || tag == 1) {
                 bool islogin = (tag == 1);
-                if(UserVerify(m_post["username"], m_post["password"], islogin)) {
+                const std::string& name = m_post["username"];
+                if(islogin && m_user != "" && (name == "" || name == m_user)) {
+                    //已有有效会话 不用再查用户存储
                     m_path = "/welcome.html";
                 }else {
-                    m_path = "/error.html";
+                    //查用户存储可能阻塞 交给调用者决定在哪个线程做
+                    m_verify = islogin ? VERIFY_LOGIN : VERIFY_REGISTER;
                 }
             }
         }
     }
 }
 
+void HttpRequest::Verify() {
+    FinishVerify(UserVerify(GetPost("username"), GetPost("password"), IsLogin()));
+}
+
+void HttpRequest::FinishVerify(bool ok) {
+    if(m_verify == VERIFY_NONE) return;
+    if(ok) {
+        m_path = "/welcome.html";
+        if(m_verify == VERIFY_LOGIN) {
+            m_user = m_post["username"];
+            m_newsession = SessionStore::Instance()->Create(m_user);
+        }
+    }else {
+        m_path = "/error.html";
+    }
+    m_verify = VERIFY_NONE;
+}
+
+bool HttpRequest::VerifyBlocks() {
+    return m_userstore && m_userstore->IsBlocking();
+}
+
 void HttpRequest::ParseFromUrlencoded() {
     if(m_body.size() == 0) return ;
     
@@ -181,63 +380,36 @@ void HttpRequest::ParseFromUrlencoded() {
 }
 
 
+static Histogram* const s_findTime = Metrics::Instance()->NewHistogram(
+    "webserver_user_store_seconds{op=\"find\"}", "User store operation latency");
+static Histogram* const s_insertTime = Metrics::Instance()->NewHistogram(
+    "webserver_user_store_seconds{op=\"insert\"}", "User store operation latency");
+
 bool HttpRequest::UserVerify(const std::string& name, const std::string& pwd, bool islogin) {
     if(name == "" || pwd == "") return false;
     LOG_INFO("Verify name:%s, pwd:%s", name.c_str(), pwd.c_str());
-    MYSQL* sql;
-    SqlConnRAII(&sql, SqlConnPool::Instance());
-    assert(sql != nullptr);
-    bool flag = false;
-    unsigned int j = 0;
-    char order[256] = {0};
-    MYSQL_FIELD* fields = nullptr;
-    MYSQL_RES* res = nullptr;
-
-    if(!islogin) flag = true;
-    snprintf(order, 256, "SELECT username, password FROM user WHERE username='%s' LIMIT 1", name.c_str());
-    LOG_DEBUG("%s", order);
-    if(mysql_query(sql, order)) { //Zero for success. Nonzero if an error occurred.
-        mysql_free_result(res);
+    if(!m_userstore) {
+        LOG_ERROR("UserStore not set!");
         return false;
     }
-    res = mysql_store_result(sql);
-    j = mysql_num_fields(res); //Returns the number of columns in a result set.
-    fields = mysql_fetch_fields(res);
-    // Returns the definition of one column of a result set as a MYSQL_FIELD structure. 
-    // Call this function repeatedly to retrieve information about all columns in the result set.
-
-    while(MYSQL_ROW row = mysql_fetch_row(res)) {//retrieves the next row of a result set:
-        LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
-        std::string password(row[1]);
-        //注册行为 且 用户名未被使用
-        if(islogin) {
-            if(pwd == password) flag = true;
-            else {
-                flag = false;
-                LOG_DEBUG("pwd error!");
-            }
-        }
-        else {
-            flag = false;
-            LOG_DEBUG("user used!");
-        }
-    }
-    mysql_free_result(res);
-
-    //注册行为 且 用户名未被使用
-    if(!islogin && flag == true) {
-        LOG_DEBUG("register!");
-        bzero(order, 256);
-        snprintf(order, 256, "INSERT INFO user(username, password) VALUES('%s','%s')", name.c_str(), pwd.c_str());
-        if(mysql_query(sql, order)) {
-            LOG_DEBUG("Insert error!");
-            flag = false;
+
+    bool flag = false;
+    auto begin = std::chrono::steady_clock::now();
+    if(islogin) {
+        std::string password;
+        if(m_userstore->Find(name, password) && pwd == password) {
+            flag = true;
+        }else {
+            LOG_DEBUG("pwd error!");
         }
-        flag = true;
+        s_findTime->RecordSince(begin);
+    }else {
+        //注册行为 用户名已被使用时Insert失败
+        flag = m_userstore->Insert(name, pwd);
+        s_insertTime->RecordSince(begin);
+        LOG_DEBUG("%s", flag ? "register!" : "user used!");
     }
-
-    SqlConnPool::Instance()->FreeConn(sql);
-    LOG_DEBUG( "UserVerify success!!");
+    LOG_DEBUG("UserVerify %s!!", flag ? "success" : "failed");
     return flag;
 }
 
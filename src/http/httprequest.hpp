@@ -3,14 +3,22 @@
 
 #include <cstring>
 #include <regex>
+#include <string_view>
 #include <errno.h>
-#include <mysql/mysql.h>
 #include <unordered_map>
 #include <unordered_set>
 #include "../buffer/buffer.hpp"
+#include "../buffer/ringbuffer.hpp"
 #include "../log/log.hpp"
-#include "../pool/sqlconnpool.hpp"
-#include "../pool/sqlconnRAII.hpp"
+#include "../store/userstore.hpp"
+#include "../session/sessionstore.hpp"
+
+//连接的读缓冲 编译时定义RING_READBUF时换成镜像环 读写位置绕回时不搬移数据
+#ifdef RING_READBUF
+using ReadBuffer = RingBuffer;
+#else
+using ReadBuffer = Buffer;
+#endif
 
 class HttpRequest {
 public:
@@ -23,6 +31,9 @@ public:
         FINISH
     };
     
+    static const size_t MAX_BODY = 1 << 20; //请求体上限 超过回413
+    static const size_t MAX_HEADER = 16 * 1024; //请求行加所有头部的上限 超过回431
+
     enum HTTP_CODE {
         NO_REQUEST = 0,
         GET_REQUEST,
@@ -42,7 +53,16 @@ public:
 
     void Init();
 
-    bool parse(Buffer& buff);
+    //增量解析 数据不完整时返回true并等待更多数据 请求格式错误返回false
+    bool parse(ReadBuffer& buff);
+
+    //整个请求(含请求体)是否已经解析完
+    bool IsFinished() const { return m_state == FINISH; }
+
+    PARSE_STATE State() const { return m_state; }
+
+    //parse返回false时应答的状态码 其他时候为0
+    int ErrorCode() const { return m_errcode; }
 
 
     std::string path() const;
@@ -57,7 +77,34 @@ public:
 
     std::string GetPost(const char* key) const;
 
-    bool IsKeepAlive() const;   
+    //HTTP/1.1默认保持连接 Connection里有close时关闭 HTTP/1.0只有带keep-alive才保持
+    bool IsKeepAlive() const;
+
+    //请求携带有效会话时的用户名 否则为空
+    const std::string& user() const { return m_user; }
+
+    //本次请求登录成功新发放的会话token 需要写入Set-Cookie
+    const std::string& NewSession() const { return m_newsession; }
+
+    //登录注册请求解析完后还需要查用户存储 调用Verify或FinishVerify之前响应路径不确定
+    bool NeedsVerify() const { return m_verify != VERIFY_NONE; }
+
+    bool IsLogin() const { return m_verify == VERIFY_LOGIN; }
+
+    //在当前线程查用户存储并更新结果
+    void Verify();
+
+    //用别的线程算好的UserVerify结果更新路径和会话
+    void FinishVerify(bool ok);
+
+    //设置登录注册使用的用户存储 需要在处理请求前调用
+    static void SetUserStore(UserStore* store);
+
+    //当前用户存储是否会阻塞 阻塞时应在线程池里调用UserVerify
+    static bool VerifyBlocks();
+
+    //身份验证 只依赖参数和用户存储 可以在任意线程调用
+    static bool UserVerify(const std::string& name, const std::string& pwd, bool islogin);
 
     /* 
     todo 
@@ -70,27 +117,46 @@ public:
 private:
 
     //解析请求行
-    bool ParseRequestLine(const std::string& line); 
+    bool ParseRequestLine(std::string_view line); 
 
-    //解析请求头
-    void ParseHeader(const std::string& line); 
+    //解析请求头 空行表示头部结束
+    bool ParseHeader(std::string_view line); 
     
     //解析请求体
-    void ParseBody(const std::string& line); 
+    void ParseBody(std::string_view line); 
 
     void ParsePath();
 
+    //从Cookie头中取出sid并查会话
+    void ParseSession(std::string_view cookie);
+
     void ParsePost();
 
     void ParseFromUrlencoded();
 
-    //身份验证
-    static bool UserVerify(const std::string& name, const std::string& pwd, bool islogin);
+    //记下出错的状态码(先出的错优先) 返回false
+    bool Fail(int code);
+
+    enum VERIFY_STATE {
+        VERIFY_NONE,
+        VERIFY_LOGIN,
+        VERIFY_REGISTER
+    };
 
     PARSE_STATE m_state;
 
+    size_t m_contentlen;
+
+    size_t m_headerlen; //已经解析的请求行和头部字节数
+
+    int m_errcode;
+
+    VERIFY_STATE m_verify;
+
     std::string m_method, m_path, m_version, m_body;
 
+    std::string m_user, m_newsession;
+
     std::unordered_map<std::string, std::string> m_header;
     std::unordered_map<std::string, std::string> m_post;
 
@@ -99,6 +165,8 @@ private:
     static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;
 
     static int ConverHex(char ch);
+
+    static UserStore* m_userstore;
 };
 
 
@@ -30,6 +30,10 @@ const std::unordered_map<int, std::string> HttpResponse::CODE_STATUS = {
     { 400, "Bad Request" },
     { 403, "Forbidden" },
     { 404, "Not Found" },
+    { 413, "Payload Too Large" },
+    { 431, "Request Header Fields Too Large" },
+    { 501, "Not Implemented" },
+    { 503, "Service Unavailable" },
 };
 
 const std::unordered_map<int, std::string> HttpResponse::CODE_PATH = {
@@ -41,10 +45,14 @@ const std::unordered_map<int, std::string> HttpResponse::CODE_PATH = {
 
 HttpResponse::HttpResponse() {
     m_code = -1;
-    m_path = m_srcdir = "";
+    m_path = m_srcdir = m_session = m_content = "";
+    m_sessionage = 0;
+    m_retryafter = 0;
+    m_katimeout = m_kamax = 0;
     m_iskeepalive = false;
     m_mmFile = nullptr; 
     m_mmFileStat = { 0 };
+    m_trace = nullptr;
 };
 
 HttpResponse::~HttpResponse() {
@@ -61,21 +69,47 @@ void HttpResponse::Init(const std::string &srcdir, std::string &path, bool iskee
     m_iskeepalive = iskeepalive;
     m_path = path;
     m_srcdir = srcdir;
+    m_session = "";
+    m_content.clear();
+    m_sessionage = 0;
+    m_retryafter = 0;
+    m_katimeout = m_kamax = 0;
     m_mmFile = nullptr;
     m_mmFileStat = {0};
 }
 
 
 void HttpResponse :: MakeResponse(Buffer &buff) {
-    //如果没有该文件或者该文件是文件夹
-    if(stat((m_srcdir + m_path).data(), &m_mmFileStat) < 0 || S_ISDIR(m_mmFileStat.st_mode)) {
-        m_code = 404;
+    if(m_code >= 400 && CODE_PATH.count(m_code) == 0) {
+        //没有错误页的状态码(比如过载时的503)要尽量便宜 不碰文件系统 内容直接生成
+        m_path = "/error.html";
+        AddStateLine(buff);
+        AddHeader(buff);
+        ErrorContent(buff, m_code == 503 ? "Server is busy, please retry later." : CODE_STATUS.at(m_code));
+        return;
     }
-    else if(!(m_mmFileStat.st_mode & S_IROTH)) {
-        m_code = 403;
-    }else if(m_code == -1) {
-
+    if(!m_content.empty()) {
         m_code = 200;
+        AddStateLine(buff);
+        AddHeader(buff);
+        buff.Append("Content-length: ");
+        buff.AppendDecimal(m_content.size());
+        buff.Append("\r\n\r\n");
+        buff.Append(m_content);
+        return;
+    }
+    //已经确定是错误(比如解析失败的400)时不再看请求的路径 否则会被改成404
+    if(m_code < 400) {
+        //如果没有该文件或者该文件是文件夹
+        if(stat((m_srcdir + m_path).data(), &m_mmFileStat) < 0 || S_ISDIR(m_mmFileStat.st_mode)) {
+            m_code = 404;
+        }
+        else if(!(m_mmFileStat.st_mode & S_IROTH)) {
+            m_code = 403;
+        }else if(m_code == -1) {
+
+            m_code = 200;
+        }
     }
     ErrorHtml();
     AddStateLine(buff);
@@ -83,6 +117,33 @@ void HttpResponse :: MakeResponse(Buffer &buff) {
     AddContent(buff);
 }
 
+void HttpResponse::MakeResponse(ChainBuffer& buff) {
+    Buffer head;
+    MakeResponse(head);
+    buff.Append(head);
+    if(m_mmFile) {
+        buff.AppendSlice(m_mmFile, FileLen());
+    }
+}
+
+void HttpResponse::MakeResponse(ChainBuffer& buff, int fd, const struct stat& st) {
+    if(fd < 0 || m_code != -1 || S_ISDIR(st.st_mode) || !(st.st_mode & S_IROTH)) {
+        //错误页很小也很少见 直接走同步路径
+        MakeResponse(buff);
+        return;
+    }
+    m_code = 200;
+    m_mmFileStat = st;
+    Buffer head;
+    AddStateLine(head);
+    AddHeader(head);
+    AddContent(head, fd);
+    buff.Append(head);
+    if(m_mmFile) {
+        buff.AppendSlice(m_mmFile, FileLen());
+    }
+}
+
 char* HttpResponse::File() {
     return m_mmFile;
 }
@@ -99,30 +160,59 @@ void HttpResponse::ErrorHtml() {
 }
 
 void HttpResponse::AddStateLine(Buffer& buff) {
-    std::string status;
-    if(CODE_STATUS.count(m_code) == 1) {
-        status = CODE_STATUS.find(m_code)->second;
-    }else {
+    auto it = CODE_STATUS.find(m_code);
+    if(it == CODE_STATUS.end()) {
         m_code = 400;
-        status = CODE_STATUS.find(400)->second; 
+        it = CODE_STATUS.find(400);
     }
-    buff.Append("Http/1.1" + std::to_string(m_code) + " " + status + "\r\n");
+    //分段直接写进Buffer 不拼临时string
+    buff.Append("HTTP/1.1 ");
+    buff.AppendDecimal(m_code);
+    buff.Append(" ");
+    buff.Append(it->second);
+    buff.Append("\r\n");
 }
 
 void HttpResponse::AddHeader(Buffer& buff) {
     buff.Append("Connection: ");
     if(m_iskeepalive) {
         buff.Append("keep-alive\r\n");
-        buff.Append("keep-alive: max=6, timeout=120\r\n");
+        if(m_katimeout > 0 || m_kamax > 0) {
+            //通告的是连接层真正执行的限制
+            buff.Append("Keep-Alive: ");
+            if(m_katimeout > 0) {
+                buff.Append("timeout=");
+                buff.AppendDecimal(m_katimeout);
+            }
+            if(m_kamax > 0) {
+                buff.Append(m_katimeout > 0 ? ", max=" : "max=");
+                buff.AppendDecimal(m_kamax);
+            }
+            buff.Append("\r\n");
+        }
     }else {
         buff.Append("close\r\n");
     }
-    buff.Append("Content-type: " + GetFileType() + "\r\n");
+    buff.Append("Content-type: ");
+    buff.Append(GetFileType());
+    buff.Append("\r\n");
+    if(m_retryafter > 0) {
+        buff.Append("Retry-After: ");
+        buff.AppendDecimal(m_retryafter);
+        buff.Append("\r\n");
+    }
+    if(m_session != "") {
+        buff.Append("Set-Cookie: sid=");
+        buff.Append(m_session);
+        buff.Append("; Path=/; HttpOnly; Max-Age=");
+        buff.AppendDecimal(m_sessionage);
+        buff.Append("\r\n");
+    }
 }
 
 
-void HttpResponse::AddContent(Buffer& buff) {
-    int srcFd = open((m_srcdir + m_path).data(), O_RDONLY);
+void HttpResponse::AddContent(Buffer& buff, int fd) {
+    int srcFd = fd >= 0 ? fd : open((m_srcdir + m_path).data(), O_RDONLY);
     if(srcFd < 0) {
         ErrorContent(buff, "File NotFount!");
         return ;
@@ -130,14 +220,22 @@ void HttpResponse::AddContent(Buffer& buff) {
     LOG_DEBUG("File path %s", (m_srcdir + m_path).data());
     
     //一个文件映射到进程的地址空间中，以便后续可以直接在内存中访问文件内容。
-    int* mmRet = (int*)mmap(0, m_mmFileStat.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if(*mmRet == -1) {
+    TRACE_PROBE1(mmap_begin, m_mmFileStat.st_size);
+    if(m_trace) m_trace->Mark(TP_MMAP_BEGIN);
+    void* mmRet = mmap(0, m_mmFileStat.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
+    if(m_trace) m_trace->Mark(TP_MMAP_END);
+    TRACE_PROBE1(mmap_end, m_mmFileStat.st_size);
+    if(fd < 0) {
+        close(srcFd);
+    }
+    if(mmRet == MAP_FAILED) {
         ErrorContent(buff, "File NotFound!");
         return ;
     }
     m_mmFile = (char *)mmRet;
-    close(srcFd);
-    buff.Append("Content-length: " + std::to_string(m_mmFileStat.st_size) + "\r\n\r\n");
+    buff.Append("Content-length: ");
+    buff.AppendDecimal(m_mmFileStat.st_size);
+    buff.Append("\r\n\r\n");
 }
 
 //停止映射，释放内存
@@ -149,16 +247,17 @@ void HttpResponse::UnmapFile() {
 }
 
 
-std::string HttpResponse::GetFileType() {
+const std::string& HttpResponse::GetFileType() {
+    static const std::string PLAIN = "text/plain";
     size_t idx = m_path.find_last_of('.');
     if(idx == std::string::npos) {
-        return "text/plain";
+        return PLAIN;
     }
-    std::string suffix = m_path.substr(idx);
-    if(SUFFIX_TYPE.count(suffix) == 1) {
-        return SUFFIX_TYPE.find(suffix)->second;
+    auto it = SUFFIX_TYPE.find(m_path.substr(idx));
+    if(it != SUFFIX_TYPE.end()) {
+        return it->second;
     }
-    return "text/plain";
+    return PLAIN;
 }
 
 void HttpResponse::ErrorContent(Buffer& buff, std::string msg) {
@@ -174,6 +273,8 @@ void HttpResponse::ErrorContent(Buffer& buff, std::string msg) {
     body += "<p>" + msg + "</p>";
     body += "<hr><em>TinyWebServer</em></body></html>";
 
-    buff.Append("Content-length: " + std::to_string(body.size()) + "\r\n\r\n");
+    buff.Append("Content-length: ");
+    buff.AppendDecimal(body.size());
+    buff.Append("\r\n\r\n");
     buff.Append(body);
 }
\ No newline at end of file
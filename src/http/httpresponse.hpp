@@ -8,7 +8,9 @@
 #include <sys/mman.h>
 #include <unordered_map>
 #include "../buffer/buffer.hpp"
+#include "../buffer/chainbuffer.hpp"
 #include "../log/log.hpp"
+#include "../trace/trace.hpp"
 
 
 class HttpResponse {
@@ -21,6 +23,15 @@ public:
 
     void MakeResponse(Buffer& buff);
 
+    //响应头拷进链 文件内容作为外部段直接挂上去 写完之前不能UnmapFile
+    void MakeResponse(ChainBuffer& buff);
+
+    //文件已由调用者(异步)打开并取得属性 只做mmap 出错时退回同步路径生成错误页 fd由调用者关闭
+    void MakeResponse(ChainBuffer& buff, int fd, const struct stat& st);
+
+    //要发送的文件完整路径
+    std::string Target() const { return m_srcdir + m_path; }
+
     //取消文件内存映射
     void UnmapFile();
 
@@ -34,18 +45,34 @@ public:
     //状态码
     int Code()const {return m_code;}
 
+    //登录成功后下发会话cookie 需要在MakeResponse之前调用
+    void SetSession(const std::string& token, int maxAge) { m_session = token; m_sessionage = maxAge; }
+
+    //保持连接时通告的空闲超时(秒)和这个连接上还能发的请求数 0表示不通告 需要在MakeResponse之前调用
+    void SetKeepAlive(int timeout, int max) { m_katimeout = timeout; m_kamax = max; }
+
+    //503时告诉客户端多少秒后重试 需要在MakeResponse之前调用
+    void SetRetryAfter(int seconds) { m_retryafter = seconds; }
+
+    //mmap前后在trace上打点 trace归调用者所有
+    void SetTrace(RequestTrace* trace) { m_trace = trace; }
+
+    //响应内容在内存里生成 不对应文件 类型按路径后缀取 需要在MakeResponse之前调用
+    void SetContent(std::string content) { m_content = std::move(content); }
+
 private:
     //写返回 状态行
     void AddStateLine(Buffer& buff);
 
     void AddHeader(Buffer& buff);
 
-    void AddContent(Buffer& buff);
+    //fd小于0时自己打开文件
+    void AddContent(Buffer& buff, int fd = -1);
 
     //错误信息的html
     void ErrorHtml();
     
-    std::string GetFileType();
+    const std::string& GetFileType();
 
     int m_code;
     
@@ -55,8 +82,20 @@ private:
 
     std::string m_srcdir;
 
+    std::string m_session;
+
+    std::string m_content;
+
+    int m_sessionage;
+
+    int m_retryafter;
+
+    int m_katimeout, m_kamax;
+
     char* m_mmFile;
 
+    RequestTrace* m_trace;
+
     struct stat m_mmFileStat;
 
     static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;
@@ -1,18 +1,30 @@
 #ifndef __BLOCKQUEUE_HPP
 #define __BLOCKQUEUE_HPP
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <mutex>
 #include <deque>
 #include <condition_variable>
 #include <sys/time.h>
 #include <cassert>
+#include <thread>
+#include <vector>
 
 
 //阻塞队列
 template<typename T>
 class BlockDeque {
 public:
+    //队列满时try_push的处理方式
+    enum OVERFLOW_POLICY {
+        DROP, //丢弃新元素
+        BLOCK, //等到有空位
+        OVERWRITE, //挤掉最旧的元素
+    };
+
     explicit BlockDeque(size_t MaxCapacity = 1000);
     ~BlockDeque();
     void clear();
@@ -24,15 +36,45 @@ public:
     T front();
     T back();
     void push_back(const T& item);
+    void push_back(T&& item);
     void push_front(const T& item);
+    void push_front(T&& item);
     bool pop(T &item);
     bool pop(T&teim, int timeout);
     void flush();
+
+    //不阻塞的push(BLOCK除外) 没放进去返回false
+    bool try_push(T&& item, OVERFLOW_POLICY policy = DROP);
+
+    //一次加锁放入一批 空间不够时等待 返回放入的个数(关闭时可能不全)
+    template<typename It>
+    size_t push_bulk(It first, It last);
+
+    //一次加锁取走所有元素 队列为空时等待 关闭后返回0
+    size_t pop_all(std::deque<T>& out);
+
+    //最多取max个追加到out 等待最多timeoutMS毫秒 超时或关闭返回0
+    size_t drain_into(std::vector<T>& out, size_t max, int timeoutMS);
+
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    uint64_t overwritten() const { return m_overwritten.load(std::memory_order_relaxed); }
+
 private:
+    //等待前先自旋一会儿 生产者很快跟上时省掉一次睡眠和唤醒
+    bool SpinForItems();
+
+    //调用者持有锁 等到队列非空或关闭 超时返回false
+    bool WaitForItems(std::unique_lock<std::mutex>& lck, int timeoutMS);
+
+    static const int SPIN_COUNT = 200;
+
     std::deque<T> m_deq;
     size_t m_cap;
     std::mutex m_mtx;
     bool m_is_close;
+    std::atomic<size_t> m_size; //锁外自旋时读
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<uint64_t> m_overwritten;
     std::condition_variable m_cond_consumer;
     std::condition_variable m_cond_producer;
 };
@@ -41,6 +83,9 @@ template<typename T>
 BlockDeque<T>::BlockDeque(size_t t_Maxcap): m_cap(t_Maxcap){
     assert(t_Maxcap > 0);
     m_is_close = false;
+    m_size = 0;
+    m_dropped = 0;
+    m_overwritten = 0;
 }
 
 template<typename T>
@@ -53,6 +98,7 @@ void BlockDeque<T>::Close() {
     {
         std::lock_guard<std::mutex> lck(m_mtx);
         m_deq.clear();
+        m_size = 0;
         m_is_close = true;
     }
     m_cond_producer.notify_all();
@@ -62,6 +108,10 @@ void BlockDeque<T>::Close() {
 
 template<typename T>
 void BlockDeque<T>::flush() {
+    //加锁再通知 不然消费者检查完条件还没睡下时会丢掉这次唤醒
+    {
+        std::lock_guard<std::mutex> lck(m_mtx);
+    }
     m_cond_consumer.notify_one();
 }
 
@@ -69,7 +119,9 @@ void BlockDeque<T>::flush() {
 template<typename T>
 void BlockDeque<T>::clear() {
     std::lock_guard<std::mutex> lck(m_mtx);
-    return m_deq.clear();
+    m_deq.clear();
+    m_size = 0;
+    m_cond_producer.notify_all();
 }
 
 template<typename T>
@@ -100,27 +152,98 @@ size_t BlockDeque<T>::capacity() {
 
 template<typename T>
 void BlockDeque<T>::push_back(const T& item) {
+    push_back(T(item));
+}
+
+template<typename T>
+void BlockDeque<T>::push_back(T&& item) {
     std::unique_lock<std::mutex> lck(m_mtx);
-    while(m_deq.size() >= m_cap) {
+    while(m_deq.size() >= m_cap && !m_is_close) {
         //队列长度大于容量说明目前队列消息过多需要先处理
         m_cond_producer.wait(lck);
 
     }
-    m_deq.push_back(item);
+    if(m_is_close) {
+        return;
+    }
+    m_deq.push_back(std::move(item));
+    m_size = m_deq.size();
     m_cond_consumer.notify_one();
 }
 
 template<typename T>
 void BlockDeque<T>::push_front(const T&item) {
+    push_front(T(item));
+}
+
+template<typename T>
+void BlockDeque<T>::push_front(T&& item) {
     std::unique_lock<std::mutex> lck(m_mtx);
-    while(m_deq.size() >= m_cap) {
+    while(m_deq.size() >= m_cap && !m_is_close) {
         m_cond_producer.wait(lck);
 
     }
-    m_deq.push_front(item);
+    if(m_is_close) {
+        return;
+    }
+    m_deq.push_front(std::move(item));
+    m_size = m_deq.size();
     m_cond_consumer.notify_one();
 }
 
+template<typename T>
+bool BlockDeque<T>::try_push(T&& item, OVERFLOW_POLICY policy) {
+    std::unique_lock<std::mutex> lck(m_mtx);
+    if(m_is_close) {
+        return false;
+    }
+    if(m_deq.size() >= m_cap) {
+        if(policy == DROP) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if(policy == OVERWRITE) {
+            m_deq.pop_front();
+            m_overwritten.fetch_add(1, std::memory_order_relaxed);
+        }else {
+            while(m_deq.size() >= m_cap && !m_is_close) {
+                m_cond_producer.wait(lck);
+            }
+            if(m_is_close) {
+                return false;
+            }
+        }
+    }
+    m_deq.push_back(std::move(item));
+    m_size = m_deq.size();
+    m_cond_consumer.notify_one();
+    return true;
+}
+
+template<typename T>
+template<typename It>
+size_t BlockDeque<T>::push_bulk(It first, It last) {
+    size_t pushed = 0;
+    std::unique_lock<std::mutex> lck(m_mtx);
+    while(first != last) {
+        while(m_deq.size() >= m_cap && !m_is_close) {
+            m_cond_producer.wait(lck);
+        }
+        if(m_is_close) {
+            break;
+        }
+        //有多少空位就放多少 只唤醒一次
+        while(first != last && m_deq.size() < m_cap) {
+            m_deq.push_back(std::move(*first));
+            ++first;
+            pushed++;
+        }
+        m_size = m_deq.size();
+        m_cond_consumer.notify_all();
+    }
+    return pushed;
+}
+
 
 template<typename T>
 bool BlockDeque<T>::empty() {
@@ -135,16 +258,50 @@ bool BlockDeque<T>::full(){
 }
 
 template<typename T>
-bool BlockDeque<T>::pop(T &item) {
-    std::unique_lock<std::mutex> lck(m_mtx);
+bool BlockDeque<T>::SpinForItems() {
+    for(int i = 0; i < SPIN_COUNT; i++) {
+        if(m_size.load(std::memory_order_relaxed) > 0) {
+            return true;
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+    return false;
+}
+
+template<typename T>
+bool BlockDeque<T>::WaitForItems(std::unique_lock<std::mutex>& lck, int timeoutMS) {
+    if(m_deq.empty() && !m_is_close) {
+        lck.unlock();
+        SpinForItems();
+        lck.lock();
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMS);
     while(m_deq.empty()) {
-        m_cond_consumer.wait(lck);
         if(m_is_close) {
             return false;
         }
+        if(timeoutMS < 0) {
+            m_cond_consumer.wait(lck);
+        }else if(m_cond_consumer.wait_until(lck, deadline) == std::cv_status::timeout && m_deq.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+bool BlockDeque<T>::pop(T &item) {
+    std::unique_lock<std::mutex> lck(m_mtx);
+    if(!WaitForItems(lck, -1)) {
+        return false;
     }
-    item = m_deq.front();
+    item = std::move(m_deq.front());
     m_deq.pop_front();
+    m_size = m_deq.size();
     m_cond_producer.notify_one();
     return true;
 }
@@ -153,27 +310,57 @@ bool BlockDeque<T>::pop(T &item) {
 template<typename T>
 bool BlockDeque<T>::pop(T& item, int timeout) {
     std::unique_lock<std::mutex> lck(m_mtx);
-    while(m_deq.empty()) {
-        //当超时发生时，等待线程会被唤醒，并且会尝试重新获取互斥锁执行后续的代码
-        //因此，超时时的行为就像是等待线程被唤醒一样，但是没有其他线程的通知。
-        /*
-        超时发生时，等待线程虽然被唤醒，但并不意味着条件已经满足。可能是由于超时而唤醒，
-        而不是其他线程发出的通知。因此，在这种情况下，等待线程无法确保共享资源已经处于可用状态,
-        因此需要返回获取失败
-        */
-        if(m_cond_consumer.wait_for(lck, std::chrono::seconds(timeout))
-            == std::cv_status::timeout
-        ){
-            return false;
-        }
-        if(m_is_close) {
-            return false;
-        }
+    //当超时发生时，等待线程会被唤醒，并且会尝试重新获取互斥锁执行后续的代码
+    //因此，超时时的行为就像是等待线程被唤醒一样，但是没有其他线程的通知。
+    /*
+    超时发生时，等待线程虽然被唤醒，但并不意味着条件已经满足。可能是由于超时而唤醒，
+    而不是其他线程发出的通知。因此，在这种情况下，等待线程无法确保共享资源已经处于可用状态,
+    因此需要返回获取失败
+    */
+    if(!WaitForItems(lck, timeout * 1000)) {
+        return false;
     }
-    item = m_deq.front();
+    item = std::move(m_deq.front());
     m_deq.pop_front();
+    m_size = m_deq.size();
     m_cond_producer.notify_one();
     return true;
 }
 
-#endif
\ No newline at end of file
+template<typename T>
+size_t BlockDeque<T>::pop_all(std::deque<T>& out) {
+    std::unique_lock<std::mutex> lck(m_mtx);
+    if(!WaitForItems(lck, -1)) {
+        return 0;
+    }
+    size_t n = m_deq.size();
+    if(out.empty()) {
+        out.swap(m_deq);
+    }else {
+        for(auto& item: m_deq) {
+            out.push_back(std::move(item));
+        }
+        m_deq.clear();
+    }
+    m_size = 0;
+    m_cond_producer.notify_all();
+    return n;
+}
+
+template<typename T>
+size_t BlockDeque<T>::drain_into(std::vector<T>& out, size_t max, int timeoutMS) {
+    std::unique_lock<std::mutex> lck(m_mtx);
+    if(!WaitForItems(lck, timeoutMS)) {
+        return 0;
+    }
+    size_t n = std::min(max, m_deq.size());
+    for(size_t i = 0; i < n; i++) {
+        out.push_back(std::move(m_deq.front()));
+        m_deq.pop_front();
+    }
+    m_size = m_deq.size();
+    m_cond_producer.notify_all();
+    return n;
+}
+
+#endif
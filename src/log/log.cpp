@@ -1,37 +1,53 @@
 #include "log.hpp"
-#include "blockqueue.hpp"
-#include <bits/types/struct_timeval.h>
-#include <bits/types/struct_tm.h>
-#include <bits/types/time_t.h>
 #include <cstdarg>
 #include <cstdio>
 #include <ctime>
+#include <dirent.h>
 #include <memory>
 #include <mutex>
-#include <sys/select.h>
+#include "../metrics/allocprofile.hpp"
+#include "../metrics/metrics.hpp"
 
 Log::Log() {
     m_LineCount = 0;
+    m_fileseq = 0;
     m_isasync = false;
+    m_isopen = false;
+    m_level = 1;
+    m_flushinterval = 100;
+    m_flushlevel = 3;
+    m_path = "./log";
+    m_suffix = ".log";
+    m_ringsize = 0;
     write_thread_ptr = nullptr;
-    m_deq_ptr = nullptr;
     m_today = 0;
-    m_fp = nullptr; 
+    m_nextday = 0;
+    m_retireddropped = 0;
+    m_writer_sleeping = false;
+    m_is_close = false;
+    m_mode = TEXT;
+    m_tsc0 = m_wall0 = 0;
+    m_ticksperus = 1.0;
+    NameLock(m_mtx, "log");
+    NameLock(m_ringmtx, "log.rings");
 }
 
+LogSite* Log::m_sites[MAX_SITES];
+std::atomic<int> Log::m_sitecount(0);
+std::mutex Log::m_sitemtx;
+
 Log::~Log() {
     if(write_thread_ptr && write_thread_ptr->joinable()) { //如果写线程还没有停止
-        while(!m_deq_ptr->empty()) {
-            m_deq_ptr->flush();
+        {
+            std::lock_guard<ProfiledMutex> lck(m_mtx);
+            m_is_close = true;
         }
-        m_deq_ptr->Close();
-        write_thread_ptr->join();
-    }
-    if(m_fp) {
-        std::lock_guard<std::mutex> lck(m_mtx);
-        flush();
-        fclose(m_fp);
+        m_cond.notify_one();
+        write_thread_ptr->join(); //写线程退出前会把所有日志环读空
     }
+    std::lock_guard<ProfiledMutex> lck(m_mtx);
+    m_seg.Close();
+    m_spare.Discard();
 }
 
 
@@ -41,164 +57,464 @@ bool Log::IsOpen() {
 
 // 获取日志级别
 int Log::GetLevel() {
-    std::lock_guard<std::mutex> lck(m_mtx);
-    return m_level;
+    return m_level.load(std::memory_order_relaxed);
 }
 
 //设置日志级别
 void Log::SetLevel(int level) {
-    std::lock_guard<std::mutex> lck(m_mtx);
-    m_level = level;
+    m_level.store(level, std::memory_order_relaxed);
 }
 
-void Log::init(int level = 1, const char* path, const char* suffix, int MaxQueueCap) {
-    m_isopen = true;
+void Log::SetFlushPolicy(int intervalMS, int flushLevel) {
+    assert(intervalMS > 0);
+    m_flushinterval.store(intervalMS, std::memory_order_relaxed);
+    m_flushlevel.store(flushLevel, std::memory_order_relaxed);
+}
+
+int64_t Log::CoarseMS() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000ll + ts.tv_nsec / 1000000;
+}
+
+uint64_t Log::Dropped() {
+    std::lock_guard<ProfiledMutex> lck(m_ringmtx);
+    uint64_t dropped = m_retireddropped;
+    for(auto& ring: m_rings) {
+        dropped += ring->Dropped();
+    }
+    return dropped;
+}
+
+void Log::init(int level, const char* path, const char* suffix, int MaxQueueCap, LOG_MODE mode) {
     m_level = level;
+    {
+        //写线程可能还在写上一次init留下的记录 模式和tsc校准点要在锁里一起换 和新文件的文件头保持一致
+        std::lock_guard<ProfiledMutex> lck(m_mtx);
+        //延迟格式化依赖写线程
+        m_mode = MaxQueueCap > 0 ? mode : TEXT;
+        if(m_mode != TEXT) {
+            Calibrate();
+        }
+        m_path = path; //写线程在锁里用它们准备文件段
+        m_suffix = suffix;
+        m_seg.Close(); //如果有没关闭的文件，先关闭
+        m_spare.Discard();
+        m_archiver.reset(); //目录可能变了 需要重新SetArchive
+        m_LineCount = 0;
+        m_nextday = 0; //下面按当前时间打开文件
+        timeval now = {0, 0};
+        gettimeofday(&now, nullptr);
+        RotateIfNeeded(now.tv_sec * 1000000ull + now.tv_usec);
+        assert(m_seg.IsOpen());
+        PrepareSpare();
+    }
+
     if(MaxQueueCap > 0) {
         m_isasync = true; // 是异步的
-        if(!m_deq_ptr) {
-            std::unique_ptr<BlockDeque<std::string>> newdeq(new BlockDeque<std::string>);
-            m_deq_ptr = std::move(newdeq); // 使用 std::move 转移指针的所有权
-
+        m_ringsize = static_cast<size_t>(MaxQueueCap) * 256;
+        if(!write_thread_ptr) {
             std::unique_ptr<std::thread> newthread(new std::thread(FlushLogThread));
-            
             write_thread_ptr = std::move(newthread);
         }
     }else {
         m_isasync = false;
     }
+    m_isopen = true;
+
+    Metrics::Instance()->AddCallback("webserver_log_dropped_lines_total", "Log lines dropped because a log ring was full",
+                                     Metrics::COUNTER, [this] { return static_cast<double>(Dropped()); });
+    Metrics::Instance()->AddCallback("webserver_log_archive_backlog", "Rotated log files waiting for compression",
+                                     Metrics::GAUGE, [this] {
+        std::lock_guard<ProfiledMutex> lck(m_mtx);
+        return m_archiver ? static_cast<double>(m_archiver->Backlog()) : 0.0;
+    });
+}
+
+//log文件的名称命名 path/year_mon_day[-n]suffix
+void Log::RotateIfNeeded(uint64_t tsUs) {
+    bool newday = tsUs >= m_nextday;
+    bool full = m_LineCount && (m_LineCount % MAX_LINES == 0);
+    if(m_seg.IsOpen() && !newday && !full) {
+        return;
+    }
 
+    time_t tSec = tsUs / 1000000;
+    tm t;
+    localtime_r(&tSec, &t);
+    if(newday) {
+        m_today = t.tm_mday; //更新m_today
+        m_LineCount = 0; //清空计数
+        m_fileseq = FirstFileSeq(t);
+        tm midnight = t;
+        midnight.tm_hour = midnight.tm_min = midnight.tm_sec = 0;
+        midnight.tm_mday += 1;
+        m_nextday = static_cast<uint64_t>(mktime(&midnight)) * 1000000ull;
+    }
 
-    m_LineCount = 0;
-    time_t timer = time(nullptr);
-    tm *systime = localtime(&timer);
-    tm t = *systime;
-    m_path = path;
-    m_suffix = suffix;
-
-    char fileName[LOG_NAME_LEN] = {0};
-    snprintf(fileName, LOG_NAME_LEN - 1, "%s%04d_%02d_%02d%s",
-        m_path, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, m_suffix);
-    //log文件的名称命名 path_year_mon_day_suffix
-    
-    m_today = t.tm_mday;
-    {
-        std::lock_guard<std::mutex> lck(m_mtx);
-        m_buff.RetrieveAll(); //清空buff
-        if(m_fp) {
-            flush();
-            fclose(m_fp);
-        }//如果有没关闭的fp，先关闭
-
-        m_fp = fopen(fileName, "a");
-        if(m_fp == nullptr) {
-            mkdir(m_path, 0777);
-            m_fp = fopen(fileName, "a");
-        }//打开指定文件
-        assert(m_fp != nullptr);
-    }  
+    char newFile[LOG_NAME_LEN];
+    int seq = m_fileseq + m_LineCount / MAX_LINES;
+    if(seq == 0) {
+        snprintf(newFile, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s",
+                 m_path.c_str(), t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, m_suffix.c_str());
+    }else {
+        snprintf(newFile, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d-%d%s",
+                 m_path.c_str(), t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, seq, m_suffix.c_str());
+    }
+
+    //关闭旧文件打开新文件 有预备段的话只是一次改名
+    std::string oldFile = m_seg.Path();
+    m_seg.Close();
+    if(m_archiver) {
+        //先登记新文件 免得后台扫描时把它当成旧文件压缩掉
+        m_archiver->SetActive(newFile);
+        if(!oldFile.empty() && oldFile != newFile) {
+            m_archiver->Submit(oldFile);
+        }
+    }
+    bool trim = m_mode != BINARY;
+    if(!m_seg.Open(newFile, SEGMENT_SIZE, &m_spare, trim)) {
+        mkdir(m_path.c_str(), 0777);
+        m_seg.Open(newFile, SEGMENT_SIZE, &m_spare, trim);
+    }
+    assert(m_seg.IsOpen());
+    if(m_mode == BINARY) {
+        WriteFileHeader();
+    }
+    if(!m_isasync && !m_spare.IsOpen()) {
+        //同步模式没有后台线程 只能当场准备下一段
+        PrepareSpare();
+    }
+}
+
+int Log::FirstFileSeq(const tm& t) {
+    //同一天重启时编号会从0重新开始 已经压缩的-N.log.gz会被新的-N.log压缩后覆盖
+    //没压缩的文件接着追加 压缩过的跳到下一个编号
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+    size_t plen = strlen(prefix);
+    int seq = 0;
+    DIR* dir = opendir(m_path.c_str());
+    if(!dir) {
+        return 0;
+    }
+    while(dirent* ent = readdir(dir)) {
+        std::string name = ent->d_name;
+        if(name.compare(0, plen, prefix) != 0) {
+            continue;
+        }
+        bool gz = name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0;
+        if(gz) {
+            name.resize(name.size() - 3);
+        }
+        if(name.size() < plen + m_suffix.size()
+           || name.compare(name.size() - m_suffix.size(), m_suffix.size(), m_suffix) != 0) {
+            continue;
+        }
+        std::string mid = name.substr(plen, name.size() - plen - m_suffix.size());
+        int n = 0;
+        if(!mid.empty()) {
+            if(mid[0] != '-' || mid.size() < 2 || mid.find_first_not_of("0123456789", 1) != std::string::npos) {
+                continue;
+            }
+            n = atoi(mid.c_str() + 1);
+        }
+        seq = std::max(seq, gz ? n + 1 : n);
+    }
+    closedir(dir);
+    return seq;
+}
+
+void Log::SetArchive(bool compress, int maxAgeDays, uint64_t maxTotalBytes) {
+    std::lock_guard<ProfiledMutex> lck(m_mtx);
+    m_archiver.reset(); //先停掉旧的后台线程
+    m_archiver.reset(new LogArchiver(m_path, m_suffix, compress, maxAgeDays, maxTotalBytes));
+    m_archiver->SetActive(m_seg.Path());
+}
+
+void Log::PrepareSpare() {
+    if(m_spare.IsOpen()) {
+        return;
+    }
+    std::string tmp = m_path + "/.next" + m_suffix;
+    if(!m_spare.Prepare(tmp, SEGMENT_SIZE)) {
+        mkdir(m_path.c_str(), 0777);
+        m_spare.Prepare(tmp, SEGMENT_SIZE);
+    }
+}
+
+void Log::WriteFileHeader() {
+    LogFileHeader header;
+    memcpy(header.magic, "TWSBLOG1", 8);
+    header.tsc0 = m_tsc0;
+    header.wall0 = m_wall0;
+    header.ticksperus = m_ticksperus;
+    m_seg.Append(reinterpret_cast<const char*>(&header), sizeof(header));
+    m_siteemitted.assign(MAX_SITES, false);
+}
+
+int Log::FormatLine(char* dst, size_t size, uint64_t wallUs, int level, const char* format, va_list vaList) {
+    int n = LogFormat::Prefix(dst, size, wallUs, level); //先写时间和等级
+    int m = vsnprintf(dst + n, size - n, format, vaList); //根据format将可变参数输出到数组中
+    //超长的行截断 留一个位置给换行
+    size_t len = std::min(static_cast<size_t>(n) + std::max(m, 0), size - 1);
+    dst[len++] = '\n';
+    return len;
+}
+
+int Log::RegisterSite(int level, const char* format, const char* file, int line, std::vector<uint8_t> tags) {
+    std::lock_guard<std::mutex> lck(m_sitemtx);
+    int id = m_sitecount.load(std::memory_order_relaxed);
+    if(id >= MAX_SITES) {
+        return -1;
+    }
+    m_sites[id] = new LogSite{level, line, format, file, std::move(tags)};
+    m_sitecount.store(id + 1, std::memory_order_release);
+    return id;
+}
+
+void Log::Calibrate() {
+    timeval w0, w1;
+    gettimeofday(&w0, nullptr);
+    uint64_t t0 = LogFormat::Tsc();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    gettimeofday(&w1, nullptr);
+    uint64_t t1 = LogFormat::Tsc();
+    uint64_t us0 = w0.tv_sec * 1000000ull + w0.tv_usec;
+    uint64_t us1 = w1.tv_sec * 1000000ull + w1.tv_usec;
+    m_tsc0 = t0;
+    m_wall0 = us0;
+    m_ticksperus = us1 > us0 ? static_cast<double>(t1 - t0) / (us1 - us0) : 1000.0;
+}
+
+uint64_t Log::ToWallUs(uint64_t ts) const {
+    if(m_mode == TEXT) {
+        return ts;
+    }
+    return m_wall0 + static_cast<int64_t>(static_cast<int64_t>(ts - m_tsc0) / m_ticksperus);
+}
+
+LogRing* Log::ThreadRing() {
+    //线程退出时标记回收 写线程读空后释放
+    struct RingHolder {
+        std::shared_ptr<LogRing> ring;
+        ~RingHolder() { if(ring) ring->Retire(); }
+    };
+    static thread_local RingHolder holder;
+    if(!holder.ring) {
+        holder.ring = std::make_shared<LogRing>(m_ringsize);
+        std::lock_guard<ProfiledMutex> lck(m_ringmtx);
+        m_rings.push_back(holder.ring);
+    }
+    return holder.ring.get();
 }
 
 void Log::write(int level, const char* format, ...) {
+    AllocScope scope(AT_LOG);
     timeval now =  {0, 0};  //更加精确
     gettimeofday(&now, nullptr);
-    time_t tSec = now.tv_sec;
-    tm* sysTime = localtime(&tSec);
-    tm t = *sysTime;
 
     va_list vaList;
-
-    //如果日期不相等 或者文件写满的话
-    if(m_today != t.tm_mday || (m_LineCount && (m_LineCount % m_MAX_LINES == 0))) {
-        std::unique_lock<std::mutex> lck(m_mtx);
-        lck.unlock();
-
-        char newFile[LOG_NAME_LEN];
-        char tail[36] = {0};
-        snprintf(tail, 36, "%04d_%02d_%02d",t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
-
-        if(m_today != t.tm_mday) {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s%s", m_path, tail, m_suffix);
-            m_today = t.tm_mday; //更新m_today
-            m_LineCount = 0; //清空计数
+    va_start(vaList, format); //初始化va_list
+    if(m_isasync) {
+        //直接格式化进本线程的日志环 满了就丢弃 不会阻塞在磁盘上
+        LogRing* ring = ThreadRing();
+        char* dst = ring->Reserve(LINE_MAX);
+        if(dst) {
+            uint64_t wallUs = now.tv_sec * 1000000ull + now.tv_usec;
+            int len = FormatLine(dst, LINE_MAX, wallUs, level, format, vaList);
+            ring->Commit(m_mode == TEXT ? wallUs : LogFormat::Tsc(), level, len);
+            Notify(ring, level);
         }
-        else {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s-%d%s", m_path, tail, (m_LineCount / MAX_LINES), m_suffix);
+    }else {
+        char line[LINE_MAX];
+        int len = FormatLine(line, LINE_MAX, now.tv_sec * 1000000ull + now.tv_usec, level, format, vaList);
+        std::lock_guard<ProfiledMutex> lck(m_mtx);
+        RotateIfNeeded(now.tv_sec * 1000000ull + now.tv_usec);
+        m_LineCount++;
+        m_seg.Append(line, len);
+        if(level >= m_flushlevel.load(std::memory_order_relaxed)) {
+            m_seg.Sync();
         }
-        lck.lock();
+    }
+    va_end(vaList); // 结束对可变参数列表的访问
+}
 
-        flush();
-        fclose(m_fp);
-        m_fp = fopen(newFile, "a");
-        //关闭旧文件打开新文件
-        assert(m_fp != nullptr);
-    } 
 
+void Log::flush() {
+    if(m_isasync) {
+        Wake();
+        return;
+    }
+    //同步模式写进映射的内存就已经对其他进程可见了 这里只是让内核开始回写
+    std::lock_guard<ProfiledMutex> lck(m_mtx);
+    m_seg.Sync();
+}
 
+void Log::Wake() {
+    //写线程睡着的话唤醒它 否则它自己会读到
+    //fence保证: 要么这里看到标志 要么写线程设置标志后能看到刚提交的记录
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_writer_sleeping.load(std::memory_order_relaxed)
+        && m_writer_sleeping.exchange(false)) {
+        //写线程在m_mtx里设置标志直到进入wait才放锁 拿一下锁再通知 通知不会落在它真正等待之前
+        { std::lock_guard<ProfiledMutex> lck(m_mtx); }
+        m_cond.notify_one();
+    }
+}
 
+bool Log::HasPending() {
+    std::lock_guard<ProfiledMutex> lck(m_ringmtx);
+    for(auto& ring: m_rings) {
+        if(!ring->Empty()) return true;
+    }
+    return false;
+}
 
+size_t Log::DrainRings(bool& urgent) {
+    std::vector<std::shared_ptr<LogRing>> rings;
     {
-        std::unique_lock<std::mutex> lck(m_mtx);
+        std::lock_guard<ProfiledMutex> lck(m_ringmtx);
+        //线程已经退出并且读空的日志环可以回收了
+        for(auto it = m_rings.begin(); it != m_rings.end();) {
+            if((*it)->Retired() && (*it)->Empty()) {
+                m_retireddropped += (*it)->Dropped();
+                it = m_rings.erase(it);
+            }else {
+                ++it;
+            }
+        }
+        rings = m_rings;
+    }
+
+    //多路归并 每次取时间戳最小的一条 各线程内部本身是有序的
+    size_t written = 0;
+    std::lock_guard<ProfiledMutex> lck(m_mtx);
+    while(true) {
+        LogRing* best = nullptr;
+        uint64_t bestts = 0;
+        uint32_t bestlevel = 0;
+        const char* data = nullptr;
+        size_t len = 0;
+        for(auto& ring: rings) {
+            uint64_t ts;
+            uint32_t level;
+            const char* d;
+            size_t l;
+            if(ring->Peek(ts, level, d, l) && (!best || ts < bestts)) {
+                best = ring.get();
+                bestts = ts;
+                bestlevel = level;
+                data = d;
+                len = l;
+            }
+        }
+        if(!best) {
+            break;
+        }
+        RotateIfNeeded(ToWallUs(bestts));
         m_LineCount++;
-        int n = snprintf(m_buff.BeginWrite(), 128, "%d-%02d-%02d %02d:%02d:%02d.%06ld",
-                    t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, now.tv_usec);
-        m_buff.HasWritten(n); //先向buff写时间
-        AppendLogLevelTitle(level); //等级
-        
-        va_start(vaList, format); //初始化va_list
-        int m = vsnprintf(m_buff.BeginWrite(), m_buff.WritableBytes(), format, vaList); //根据format将可变参数输出到数组中
-        va_end(vaList); // 结束对可变参数列表的访问
-
-        m_buff.HasWritten(m);//向buff写内容
-        m_buff.Append("\n\0", 2); //追加换行符和\0
-        if(m_isasync && m_deq_ptr && !m_deq_ptr->full()) {
-            //满足条件的话就把buff中的内容全部加入到阻塞队列中
-            m_deq_ptr->push_back(m_buff.RetrieveAllToStr());
-        }else {
-            //否则的话将buff中当前位置开始直到\0输出到文件中
-            fputs(m_buff.Peek(), m_fp);
-        }
-        m_buff.RetrieveAll();
-    }
-}
-
-
-void Log::AppendLogLevelTitle(int level) {
-    switch(level) {
-    case 0:
-        m_buff.Append("[debug]: ", 9);
-        break;
-    case 1:
-        m_buff.Append("[info] : ", 9);
-        break;
-    case 2:
-        m_buff.Append("[warn] : ", 9);
-        break;
-    case 3:
-        m_buff.Append("[error]: ", 9);
-        break;
-    default:
-        m_buff.Append("[info] : ", 9);
-        break;
+        if(static_cast<int>(bestlevel & ~BINARY_RECORD) >= m_flushlevel.load(std::memory_order_relaxed)) {
+            urgent = true;
+        }
+        WriteRecord(bestts, bestlevel, data, len);
+        best->Pop();
+        written++;
     }
+    return written;
 }
 
+void Log::WriteRecord(uint64_t ts, uint32_t level, const char* data, size_t len) {
+    bool binary = level & BINARY_RECORD;
+    level &= ~BINARY_RECORD;
+    if(m_mode == BINARY) {
+        //先拼成一段再一次拷进文件段
+        auto put = [this](const void* p, size_t n) {
+            m_scratch.append(static_cast<const char*>(p), n);
+        };
+        m_scratch.clear();
+        if(!binary) {
+            uint32_t head[2] = {level, static_cast<uint32_t>(len)};
+            put("T", 1);
+            put(&ts, 8);
+            put(head, 8);
+            put(data, len);
+            m_seg.Append(m_scratch.data(), m_scratch.size());
+            return;
+        }
+        uint32_t site;
+        memcpy(&site, data, 4);
+        if(site < static_cast<uint32_t>(MAX_SITES) && !m_siteemitted[site]) {
+            //这个文件里第一次出现的站点先写定义
+            const LogSite* def = m_sites[site];
+            uint32_t ids[3] = {site, static_cast<uint32_t>(def->level), static_cast<uint32_t>(def->line)};
+            uint16_t lens[3] = {static_cast<uint16_t>(def->tags.size()),
+                                static_cast<uint16_t>(def->format.size()), static_cast<uint16_t>(def->file.size())};
+            put("S", 1);
+            put(ids, sizeof(ids));
+            put(lens, sizeof(lens));
+            put(def->tags.data(), lens[0]);
+            put(def->format.data(), lens[1]);
+            put(def->file.data(), lens[2]);
+            m_siteemitted[site] = true;
+        }
+        uint32_t rec[3] = {level, site, static_cast<uint32_t>(len - 4)};
+        put("B", 1);
+        put(&ts, 8);
+        put(rec, sizeof(rec));
+        put(data + 4, len - 4);
+        m_seg.Append(m_scratch.data(), m_scratch.size());
+        return;
+    }
+    if(!binary) {
+        m_seg.Append(data, len);
+        return;
+    }
 
-void Log::flush() {
-    if(m_isasync) {
-        m_deq_ptr->flush();
-        //唤醒一个消费者线程看看执不执行任务
+    //DEFERRED 在写线程里格式化
+    uint32_t site;
+    memcpy(&site, data, 4);
+    if(site >= static_cast<uint32_t>(m_sitecount.load(std::memory_order_acquire))) {
+        return;
     }
-    fflush(m_fp);
-    //刷新缓冲区
+    char line[LINE_MAX];
+    size_t n = LogFormat::Prefix(line, LINE_MAX, ToWallUs(ts), level);
+    n += LogFormat::Format(*m_sites[site], data + 4, len - 4, line + n, LINE_MAX - n - 1);
+    line[n++] = '\n';
+    m_seg.Append(line, n);
 }
 
 void Log::AsynWrite() {
-    std::string str = "";
-    while(m_deq_ptr->pop(str)) { //如果阻塞队列有任务
-        std::lock_guard<std::mutex> lck(m_mtx);
-        fputs(str.c_str(), m_fp);
+    AllocScope scope(AT_LOG);
+    bool urgent = false;
+    while(true) {
+        if(DrainRings(urgent)) {
+            continue;
+        }
+        std::unique_lock<ProfiledMutex> lck(m_mtx);
+        if(urgent) {
+            m_seg.Sync();
+            urgent = false;
+        }
+        if(m_is_close) {
+            break;
+        }
+        //空闲时把下一个文件段准备好 切换文件时不用再建文件
+        if(!m_spare.IsOpen()) {
+            PrepareSpare();
+        }
+        //没有日志时睡眠 生产者唤醒或者定时醒来看看
+        //设置标志之后再看一次日志环: 之前提交的生产者看到写线程醒着 不会来唤醒
+        m_writer_sleeping.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst); //和Wake里的fence配对
+        if(HasPending()) {
+            m_writer_sleeping.store(false);
+            continue;
+        }
+        m_cond.wait_for(lck, std::chrono::milliseconds(m_flushinterval.load(std::memory_order_relaxed)));
+        m_writer_sleeping.store(false);
     }
+    DrainRings(urgent);
 }
 
 //饿汉模式
@@ -212,5 +528,3 @@ Log* Log::Instance() {
 void Log::FlushLogThread() {
     Log::Instance()->AsynWrite();
 }
-
-
@@ -2,21 +2,37 @@
 #define __LOG_HPP
 
 #include <bits/types/FILE.h>
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <cstring>
 #include <string>
 #include <thread>
+#include <vector>
 #include <sys/time.h>
 #include <stdarg.h>
 #include <cassert>
 #include <sys/stat.h>
-#include "../buffer/buffer.hpp"
-#include "blockqueue.hpp"
+#include "logring.hpp"
+#include "logformat.hpp"
+#include "logsegment.hpp"
+#include "../metrics/profiledmutex.hpp"
+#include "logarchiver.hpp"
 
 class Log {
 public:
-    void init(int level, const char* path = "./log", const char* suffix = ".log", int MaxQueueCap = 1024);
+    //日志模式 后两种只在异步时可用
+    enum LOG_MODE {
+        TEXT, //调用线程格式化成文本
+        DEFERRED, //调用线程只记录原始参数 写线程格式化成文本
+        BINARY, //调用线程只记录原始参数 写线程直接写二进制文件 用tools/logdecoder解码
+    };
+
+    //MaxQueueCap > 0 时为异步模式 每个线程的日志环大约能放MaxQueueCap行
+    void init(int level, const char* path = "./log", const char* suffix = ".log", int MaxQueueCap = 1024,
+              LOG_MODE mode = TEXT);
 
     //单例模式 获取日志实例
     static Log* Instance();
@@ -27,8 +43,12 @@ public:
     //写日志 还要有级别
     void write(int level, const char* format, ...);
     
-    //刷新
+    //刷新 唤醒写线程把已有的日志写出去
     void flush();
+
+    //刷新策略: 写线程最多每intervalMS写一次 级别不低于flushLevel的日志立即唤醒写线程并刷盘
+    //日志环用到一半也会唤醒写线程
+    void SetFlushPolicy(int intervalMS, int flushLevel);
     
     //获取日志级别 0 debug  1 info  2 warn  3 error
     int GetLevel();
@@ -38,47 +58,199 @@ public:
 
     //判断是否日志可写
     bool IsOpen();
+
+    //轮转下来的文件后台gzip压缩 并按天数和总大小清理 0表示不限制 需要在init之后调用
+    void SetArchive(bool compress, int maxAgeDays, uint64_t maxTotalBytes);
+
+    //热路径上的判断 不加锁
+    bool IsEnabled(int level) const {
+        return m_isopen.load(std::memory_order_relaxed) && m_level.load(std::memory_order_relaxed) <= level;
+    }
+
+    //异步模式下因为日志环写满而丢弃的行数
+    uint64_t Dropped();
+
+    //粗粒度单调时钟 毫秒 给限流宏用
+    static int64_t CoarseMS();
+
+    //是否走二进制记录的热路径
+    bool IsDeferred() const { return m_mode != TEXT; }
+
+    //注册一个LOG_*调用点 每个调用点只在第一次执行时注册一次
+    static int RegisterSite(int level, const char* format, const char* file, int line, std::vector<uint8_t> tags);
+
+    //只记录站点id 时间戳和原始参数 格式化留给写线程
+    template<typename... Args>
+    void WriteBinary(int site, int level, const Args&... args) {
+        size_t len = 4 + (LogArgTrait<typename std::decay<Args>::type>::Size(args) + ... + 0);
+        LogRing* ring = ThreadRing();
+        char* dst = ring->Reserve(len);
+        if(!dst) {
+            return;
+        }
+        uint32_t id = site;
+        memcpy(dst, &id, 4);
+        char* p = dst + 4;
+        ((p = LogArgTrait<typename std::decay<Args>::type>::Encode(p, args)), ...);
+        (void)p;
+        ring->Commit(LogFormat::Tsc(), level | BINARY_RECORD, len);
+        Notify(ring, level);
+    }
     
 private:
     Log();
     virtual ~Log();
-    void AppendLogLevelTitle(int level);
     void AsynWrite();
 
+    //当前线程的日志环 第一次使用时注册
+    LogRing* ThreadRing();
+
+    //按刷新策略决定要不要唤醒写线程
+    void Notify(LogRing* ring, int level) {
+        if(level >= m_flushlevel.load(std::memory_order_relaxed) || ring->Used() * 2 >= ring->Capacity()) {
+            Wake();
+        }
+    }
+
+    void Wake();
+
+    //有没有日志环里还有没写出去的记录 写线程睡眠前最后检查一次
+    bool HasPending();
+
+    //把所有线程的日志环按时间戳归并写入文件 返回写入的行数 urgent表示写了需要立即刷盘的日志
+    size_t DrainRings(bool& urgent);
+
+    //日期变化或行数写满时切换文件 调用者持有m_mtx
+    void RotateIfNeeded(uint64_t tsUs);
+
+    //目录里t这一天已有的日志文件之后的第一个编号 同一天重启时不覆盖已经压缩的文件
+    int FirstFileSeq(const tm& t);
+
+    //不管是不是异步 都格式化成一行 返回长度
+    static int FormatLine(char* dst, size_t size, uint64_t wallUs, int level, const char* format, va_list vaList);
+
+    //把一条日志环里的记录写到文件
+    void WriteRecord(uint64_t ts, uint32_t level, const char* data, size_t len);
+
+    //二进制模式新文件的文件头
+    void WriteFileHeader();
+
+    //预先创建并映射好下一个文件段 切换文件时只需要改名
+    void PrepareSpare();
+
+    //测量tsc频率 用于把记录里的tsc换算成墙上时间
+    void Calibrate();
+
+    uint64_t ToWallUs(uint64_t ts) const;
+
 private:
     static const int LOG_PATH_LEN = 256;
     static const int LOG_NAME_LEN = 256;
     static const int MAX_LINES = 50000;
+    static const int LINE_MAX = 1024;
+    static const int MAX_SITES = 4096;
+    static const size_t SEGMENT_SIZE = 8 << 20; //文件段预分配大小 写满按这个大小扩展
+    static const uint32_t BINARY_RECORD = 0x100; //日志环记录的level里标记二进制记录
 
-    const char* m_path;
-    const char* m_suffix;
-    int m_MAX_LINES;
+    std::string m_path; //init时拷贝一份 调用者的字符串不用一直活着
+    std::string m_suffix;
 
     int m_LineCount; //行计数
 
+    int m_fileseq; //今天第一个文件的编号 重启后从目录里已有的文件接着往下编
+
     int m_today; //今天的日期
 
-    bool m_isopen;
-    Buffer m_buff;
+    uint64_t m_nextday; //下一个零点 微秒
+
+    std::atomic<bool> m_isopen;
+
+    std::atomic<int> m_level;
 
-    int m_level;
+    std::atomic<int> m_flushinterval; //写线程的最长睡眠时间 毫秒
+
+    std::atomic<int> m_flushlevel; //不低于这个级别的日志立即写出并刷盘
     bool m_isasync;
 
-    FILE* m_fp;
-    //控制一个阻塞队列实例
-    std::unique_ptr<BlockDeque<std::string>> m_deq_ptr;
+    LOG_MODE m_mode;
+
+    //tsc校准点
+    uint64_t m_tsc0;
+    uint64_t m_wall0;
+    double m_ticksperus;
+
+    //所有调用点 只追加 写线程按下标无锁读取
+    static LogSite* m_sites[MAX_SITES];
+    static std::atomic<int> m_sitecount;
+    static std::mutex m_sitemtx;
+    std::vector<bool> m_siteemitted; //当前二进制文件里已经写过定义的站点
+
+    size_t m_ringsize; //每个线程日志环的字节数
+
+    LogSegment m_seg; //当前写的文件
+    LogSegment m_spare; //预先准备好的下一个文件段
+    std::string m_scratch; //拼二进制记录用 复用避免分配
+    std::unique_ptr<LogArchiver> m_archiver; //压缩和清理轮转下来的文件
+
+    //所有线程的日志环 只在注册和写线程取快照时加锁
+    std::vector<std::shared_ptr<LogRing>> m_rings;
+    ProfiledMutex m_ringmtx;
+    uint64_t m_retireddropped; //已经回收的日志环丢弃的行数
+
+    //写线程没事做时睡在这里 生产者只在它睡着时唤醒
+    ProfiledCondVar m_cond;
+    std::atomic<bool> m_writer_sleeping;
+    bool m_is_close;
+
     //控制一个写线程
     std::unique_ptr<std::thread> write_thread_ptr;
-    std::mutex m_mtx;
+    ProfiledMutex m_mtx;
 
 };
 
+//编译期最低级别 低于它的调用点整个被编译器删掉 例如 -DLOG_MIN_LEVEL=1 去掉所有LOG_DEBUG
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
 #define LOG_BASE(level, format, ...) \
     do {\
-        Log* log = Log::Instance();\
-        if(log->IsOpen() && log->GetLevel() <= level) {\
-            log->write(level, format, ##__VA_ARGS__); \
-            log->flush();\
+        if((level) >= LOG_MIN_LEVEL) {\
+            Log* log = Log::Instance();\
+            if(log->IsEnabled(level)) {\
+                if(log->IsDeferred()) {\
+                    static const int logSite = Log::RegisterSite(level, format, __FILE__, __LINE__,\
+                        decltype(LogArgTypes(__VA_ARGS__))::Get());\
+                    if(logSite >= 0) log->WriteBinary(logSite, level, ##__VA_ARGS__);\
+                    else log->write(level, format, ##__VA_ARGS__);\
+                }else {\
+                    log->write(level, format, ##__VA_ARGS__); \
+                }\
+            }\
+        }\
+    }while(0);
+
+//热路径采样: 每n次调用只记录一次
+#define LOG_EVERY_N(level, n, format, ...) \
+    do {\
+        if((level) >= LOG_MIN_LEVEL && Log::Instance()->IsEnabled(level)) {\
+            static std::atomic<unsigned> logEveryN(0);\
+            if(logEveryN.fetch_add(1, std::memory_order_relaxed) % (n) == 0) {\
+                LOG_BASE(level, format, ##__VA_ARGS__)\
+            }\
+        }\
+    }while(0);
+
+//热路径限流: 每ms毫秒最多记录一次
+#define LOG_EVERY_MS(level, ms, format, ...) \
+    do {\
+        if((level) >= LOG_MIN_LEVEL && Log::Instance()->IsEnabled(level)) {\
+            static std::atomic<int64_t> logLastMS(INT64_MIN / 2);\
+            int64_t logNowMS = Log::CoarseMS();\
+            int64_t logLast = logLastMS.load(std::memory_order_relaxed);\
+            if(logNowMS - logLast >= (ms) && logLastMS.compare_exchange_strong(logLast, logNowMS)) {\
+                LOG_BASE(level, format, ##__VA_ARGS__)\
+            }\
         }\
     }while(0);
 
@@ -87,6 +259,9 @@ private:
 #define LOG_WARN(format, ...) do {LOG_BASE(2, format, ##__VA_ARGS__)} while(0);
 #define LOG_ERROR(format, ...) do {LOG_BASE(3, format, ##__VA_ARGS__)} while(0);
 
+#define LOG_WARN_EVERY_MS(ms, format, ...) LOG_EVERY_MS(2, ms, format, ##__VA_ARGS__)
+#define LOG_ERROR_EVERY_MS(ms, format, ...) LOG_EVERY_MS(3, ms, format, ##__VA_ARGS__)
+
 
 
-#endif
\ No newline at end of file
+#endif
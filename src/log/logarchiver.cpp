@@ -0,0 +1,257 @@
+#include "logarchiver.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+const size_t LogArchiver::CHUNK_SIZE;
+
+LogArchiver::LogArchiver(const std::string& dir, const std::string& suffix, bool compress,
+                         int maxAgeDays, uint64_t maxTotalBytes, int level)
+    : m_dir(dir), m_suffix(suffix), m_compress(compress), m_maxage(maxAgeDays),
+      m_maxbytes(maxTotalBytes), m_level(level), m_stop(false), m_jobs(1024) {
+    m_thread = std::thread(&LogArchiver::Run, this);
+}
+
+LogArchiver::~LogArchiver() {
+    m_stop = true;
+    m_jobs.Close();
+    if(m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void LogArchiver::Submit(const std::string& path) {
+    //队列满了丢掉也没关系 下次Scan会把遗留的文件补上
+    m_jobs.try_push(std::string(path), BlockDeque<std::string>::DROP);
+}
+
+void LogArchiver::SetActive(const std::string& path) {
+    std::lock_guard<std::mutex> lck(m_mtx);
+    m_active = path;
+}
+
+uint64_t LogArchiver::ParseLineTime(const char* line, size_t len) {
+    //2024-01-01 00:00:00.000000
+    if(len < 26 || line[4] != '-' || line[10] != ' ' || line[19] != '.') {
+        return 0;
+    }
+    tm t = {};
+    long us = 0;
+    if(sscanf(line, "%4d-%2d-%2d %2d:%2d:%2d.%6ld", &t.tm_year, &t.tm_mon, &t.tm_mday,
+              &t.tm_hour, &t.tm_min, &t.tm_sec, &us) != 7) {
+        return 0;
+    }
+    t.tm_year -= 1900;
+    t.tm_mon -= 1;
+    t.tm_isdst = -1;
+    time_t sec = mktime(&t);
+    if(sec < 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(sec) * 1000000ull + us;
+}
+
+//块内第一行和最后一行的时间
+static void ChunkTimes(const char* data, size_t len, uint64_t& first, uint64_t& last) {
+    first = LogArchiver::ParseLineTime(data, len);
+    last = first;
+    size_t end = len;
+    while(end > 0 && data[end - 1] == '\n') end--;
+    const char* nl = static_cast<const char*>(memrchr(data, '\n', end));
+    if(nl) {
+        uint64_t t = LogArchiver::ParseLineTime(nl + 1, end - (nl + 1 - data));
+        if(t) last = t;
+    }
+}
+
+bool LogArchiver::CompressFile(const std::string& path, int level) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return false;
+    }
+    struct stat st = {};
+    fstat(fd, &st);
+    size_t size = st.st_size;
+    const char* data = nullptr;
+    if(size > 0) {
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(addr == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        data = static_cast<const char*>(addr);
+        madvise(addr, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    bool text = size == 0 || ParseLineTime(data, size) != 0;
+    std::string gzpath = path + ".gz";
+    std::string tmppath = gzpath + ".tmp";
+    FILE* out = fopen(tmppath.c_str(), "wb");
+    std::vector<LogChunkIndex> index;
+    std::vector<unsigned char> buf;
+    bool ok = out != nullptr;
+    uint64_t offset = 0;
+
+    for(size_t pos = 0; ok && pos < size;) {
+        //文本日志按行切块 保证每块都从行首开始
+        size_t len = std::min(CHUNK_SIZE, size - pos);
+        if(text && pos + len < size) {
+            const char* nl = static_cast<const char*>(memrchr(data + pos, '\n', len));
+            if(nl) len = nl + 1 - (data + pos);
+        }
+
+        z_stream zs = {};
+        if(deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            ok = false;
+            break;
+        }
+        buf.resize(deflateBound(&zs, len));
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data + pos));
+        zs.avail_in = len;
+        zs.next_out = buf.data();
+        zs.avail_out = buf.size();
+        ok = deflate(&zs, Z_FINISH) == Z_STREAM_END;
+        size_t csize = buf.size() - zs.avail_out;
+        deflateEnd(&zs);
+        if(!ok || fwrite(buf.data(), 1, csize, out) != csize) {
+            ok = false;
+            break;
+        }
+
+        LogChunkIndex entry = {offset, static_cast<uint32_t>(csize), static_cast<uint32_t>(len), 0, 0};
+        if(text) {
+            ChunkTimes(data + pos, len, entry.firstus, entry.lastus);
+        }
+        index.push_back(entry);
+        offset += csize;
+        pos += len;
+    }
+    if(data) {
+        munmap(const_cast<char*>(data), size);
+    }
+    if(out && fclose(out) != 0) {
+        ok = false;
+    }
+
+    std::string idxpath = gzpath + ".idx";
+    std::string idxtmp = idxpath + ".tmp";
+    if(ok) {
+        FILE* idx = fopen(idxtmp.c_str(), "wb");
+        ok = idx && fwrite("TWSIDX01", 1, 8, idx) == 8
+             && fwrite(index.data(), sizeof(LogChunkIndex), index.size(), idx) == index.size();
+        if(idx && fclose(idx) != 0) ok = false;
+    }
+    //link在目标已存在时失败(EEXIST) 不会像rename那样把以前的归档悄悄覆盖掉 原文件留着
+    if(ok && link(tmppath.c_str(), gzpath.c_str()) == 0) {
+        unlink(tmppath.c_str());
+        rename(idxtmp.c_str(), idxpath.c_str());
+        //保留原文件的修改时间 否则按天数清理时压缩过的文件永远是新的
+        timespec times[2] = {st.st_atim, st.st_mtim};
+        utimensat(AT_FDCWD, gzpath.c_str(), times, 0);
+        utimensat(AT_FDCWD, idxpath.c_str(), times, 0);
+        unlink(path.c_str());
+        return true;
+    }
+    unlink(tmppath.c_str());
+    unlink(idxtmp.c_str());
+    return false;
+}
+
+void LogArchiver::Run() {
+    //压缩不能和业务线程抢CPU和磁盘: nice 19 + idle io调度类
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+    syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, 3 << 13 /* IOPRIO_CLASS_IDLE */);
+
+    const int SCAN_INTERVAL = 60;
+    int idle = SCAN_INTERVAL; //启动时先扫一次
+    std::vector<std::string> paths;
+    while(true) {
+        if(idle >= SCAN_INTERVAL) {
+            Scan();
+            idle = 0;
+        }
+        paths.clear();
+        if(m_jobs.drain_into(paths, 64, 1000)) {
+            if(m_compress) {
+                for(auto& path: paths) {
+                    CompressFile(path, m_level);
+                }
+            }
+            idle = SCAN_INTERVAL; //有文件轮转就顺便检查一下保留策略
+        }else if(m_stop) {
+            break;
+        }else {
+            idle++;
+        }
+    }
+}
+
+void LogArchiver::Scan() {
+    struct Entry {
+        std::string path;
+        time_t mtime;
+        uint64_t size;
+    };
+    std::string active;
+    {
+        std::lock_guard<std::mutex> lck(m_mtx);
+        active = m_active;
+    }
+
+    std::vector<Entry> files;
+    DIR* dir = opendir(m_dir.c_str());
+    if(!dir) {
+        return;
+    }
+    while(dirent* ent = readdir(dir)) {
+        std::string name = ent->d_name;
+        if(name.empty() || name[0] == '.') {
+            continue; //包括预备段
+        }
+        std::string path = m_dir + "/" + name;
+        if(path == active) {
+            continue;
+        }
+        bool plain = name.size() > m_suffix.size()
+                     && name.compare(name.size() - m_suffix.size(), m_suffix.size(), m_suffix) == 0;
+        bool gz = name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0;
+        if(!plain && !gz) {
+            continue;
+        }
+        if(plain && m_compress && CompressFile(path, m_level)) {
+            path += ".gz";
+        }
+        struct stat st = {};
+        if(stat(path.c_str(), &st) == 0) {
+            files.push_back({path, st.st_mtime, static_cast<uint64_t>(st.st_size)});
+        }
+    }
+    closedir(dir);
+
+    //从最旧的开始删
+    std::sort(files.begin(), files.end(), [](const Entry& a, const Entry& b) { return a.mtime < b.mtime; });
+    uint64_t total = 0;
+    for(auto& f: files) total += f.size;
+    time_t now = time(nullptr);
+    for(auto& f: files) {
+        bool tooOld = m_maxage > 0 && now - f.mtime > static_cast<time_t>(m_maxage) * 86400;
+        bool tooBig = m_maxbytes > 0 && total > m_maxbytes;
+        if(!tooOld && !tooBig) {
+            break;
+        }
+        unlink(f.path.c_str());
+        unlink((f.path + ".idx").c_str());
+        total -= f.size;
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef __LOGARCHIVER_HPP
+#define __LOGARCHIVER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include "blockqueue.hpp"
+
+/*
+轮转下来的日志在低优先级后台线程里压缩 并按时间和总大小清理
+压缩格式: 按约CHUNK_SIZE切成若干块 每块是一个独立的gzip member 整个文件仍然能直接zcat
+旁边的.idx记录每块的偏移和首尾时间 tools/logreader按时间范围只解压需要的块
+*/
+
+//.idx文件: "TWSIDX01" 之后是若干LogChunkIndex
+struct LogChunkIndex {
+    uint64_t offset; //在.gz中的偏移
+    uint32_t csize; //压缩后长度
+    uint32_t usize; //原始长度
+    uint64_t firstus; //块内第一行的时间 微秒 二进制日志为0
+    uint64_t lastus;
+};
+
+class LogArchiver {
+public:
+    //maxAgeDays/maxTotalBytes为0表示不按该条件清理
+    LogArchiver(const std::string& dir, const std::string& suffix, bool compress,
+                int maxAgeDays, uint64_t maxTotalBytes, int level = 6);
+    ~LogArchiver();
+
+    //文件轮转后交给后台处理
+    void Submit(const std::string& path);
+
+    //当前正在写的文件 不会被压缩或清理
+    void SetActive(const std::string& path);
+
+    //排队等待压缩的文件数
+    size_t Backlog() { return m_jobs.size(); }
+
+    //压缩一个文件 成功后删除原文件 同名的.gz已经存在时不覆盖 返回false 给后台线程和测试用
+    static bool CompressFile(const std::string& path, int level);
+
+    //解析行首的 "YYYY-MM-DD HH:MM:SS.uuuuuu" 失败返回0
+    static uint64_t ParseLineTime(const char* line, size_t len);
+
+    static const size_t CHUNK_SIZE = 1 << 20;
+
+private:
+    void Run();
+
+    //压缩遗留的未压缩日志 再按时间和大小清理
+    void Scan();
+
+    std::string m_dir;
+    std::string m_suffix;
+    bool m_compress;
+    int m_maxage;
+    uint64_t m_maxbytes;
+    int m_level;
+
+    std::mutex m_mtx;
+    std::string m_active;
+
+    std::atomic<bool> m_stop;
+
+    BlockDeque<std::string> m_jobs;
+    std::thread m_thread;
+};
+
+
+#endif
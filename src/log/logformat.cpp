@@ -0,0 +1,162 @@
+#include "logformat.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+const char* LogFormat::LevelTitle(int level) {
+    switch(level) {
+    case 0:
+        return "[debug]: ";
+    case 1:
+        return "[info] : ";
+    case 2:
+        return "[warn] : ";
+    case 3:
+        return "[error]: ";
+    default:
+        return "[info] : ";
+    }
+}
+
+uint64_t LogFormat::Tsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+int LogFormat::Prefix(char* dst, size_t size, uint64_t wallUs, int level) {
+    //同一秒内的日期时间只算一次 localtime_r比较慢
+    static thread_local time_t cachedSec = -1;
+    static thread_local char cached[64];
+    time_t sec = wallUs / 1000000;
+    if(sec != cachedSec) {
+        tm t;
+        localtime_r(&sec, &t);
+        snprintf(cached, sizeof(cached), "%d-%02d-%02d %02d:%02d:%02d",
+                 t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+        cachedSec = sec;
+    }
+    int n = snprintf(dst, size, "%s.%06ld %s", cached, static_cast<long>(wallUs % 1000000), LevelTitle(level));
+    return std::min(n, static_cast<int>(size) - 1);
+}
+
+size_t LogFormat::Format(const LogSite& site, const char* args, size_t len, char* dst, size_t size) {
+    const char* fmt = site.format.c_str();
+    const char* end = args + len;
+    size_t out = 0;
+    size_t argi = 0;
+    char spec[32];
+
+    auto put = [&](const char* s, size_t n) {
+        n = std::min(n, size - 1 - out);
+        memcpy(dst + out, s, n);
+        out += n;
+    };
+    auto putf = [&](int n) {
+        if(n > 0) out += std::min(static_cast<size_t>(n), size - 1 - out);
+    };
+
+    while(*fmt && out + 1 < size) {
+        const char* pct = strchr(fmt, '%');
+        if(!pct) {
+            put(fmt, strlen(fmt));
+            break;
+        }
+        put(fmt, pct - fmt);
+        if(pct[1] == '%') {
+            put("%", 1);
+            fmt = pct + 2;
+            continue;
+        }
+
+        //取出一个完整的转换说明 去掉长度修饰 按参数实际类型重新加
+        const char* p = pct + 1;
+        size_t speclen = 0;
+        spec[speclen++] = '%';
+        while(*p && strchr("-+ #0123456789.", *p) && speclen < sizeof(spec) - 4) {
+            spec[speclen++] = *p++;
+        }
+        while(*p && strchr("hlLqjzt", *p)) p++;
+        char conv = *p;
+        if(!conv) break;
+        fmt = p + 1;
+
+        if(argi >= site.tags.size()) {
+            put(pct, fmt - pct);
+            continue;
+        }
+        uint8_t tag = site.tags[argi++];
+        int64_t ival = 0;
+        double dval = 0;
+        const char* sval = "";
+        uint32_t slen = 0;
+        size_t need = (tag == LOG_ARG_I32 || tag == LOG_ARG_U32) ? 4 : (tag == LOG_ARG_STR ? 4 : 8);
+        if(static_cast<size_t>(end - args) < need) break;
+        switch(tag) {
+        case LOG_ARG_I32: { int32_t v; memcpy(&v, args, 4); ival = v; } break;
+        case LOG_ARG_U32: { uint32_t v; memcpy(&v, args, 4); ival = v; } break;
+        case LOG_ARG_I64:
+        case LOG_ARG_U64:
+        case LOG_ARG_PTR: memcpy(&ival, args, 8); break;
+        case LOG_ARG_DOUBLE: memcpy(&dval, args, 8); break;
+        case LOG_ARG_STR:
+            memcpy(&slen, args, 4);
+            if(static_cast<size_t>(end - args) < 4 + slen) slen = end - args - 4;
+            sval = args + 4;
+            need += slen;
+            break;
+        default: return out;
+        }
+        args += need;
+
+        bool is32 = (tag == LOG_ARG_I32 || tag == LOG_ARG_U32);
+        switch(conv) {
+        case 'd': case 'i':
+            spec[speclen++] = 'l'; spec[speclen++] = 'l'; spec[speclen++] = conv; spec[speclen] = '\0';
+            putf(snprintf(dst + out, size - out, spec, static_cast<long long>(tag == LOG_ARG_DOUBLE ? dval : ival)));
+            break;
+        case 'u': case 'x': case 'X': case 'o': {
+            unsigned long long u = tag == LOG_ARG_DOUBLE ? static_cast<unsigned long long>(dval) : static_cast<uint64_t>(ival);
+            if(is32) u &= 0xFFFFFFFFull;
+            spec[speclen++] = 'l'; spec[speclen++] = 'l'; spec[speclen++] = conv; spec[speclen] = '\0';
+            putf(snprintf(dst + out, size - out, spec, u));
+        } break;
+        case 'c':
+            spec[speclen++] = 'c'; spec[speclen] = '\0';
+            putf(snprintf(dst + out, size - out, spec, static_cast<int>(ival)));
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            spec[speclen++] = conv; spec[speclen] = '\0';
+            putf(snprintf(dst + out, size - out, spec, tag == LOG_ARG_DOUBLE ? dval : static_cast<double>(ival)));
+            break;
+        case 's':
+            if(tag == LOG_ARG_STR) {
+                spec[speclen++] = '.'; spec[speclen++] = '*'; spec[speclen++] = 's'; spec[speclen] = '\0';
+                //精度只用来限制长度 格式串里已有精度时以较小者为准
+                if(memchr(spec, '.', speclen - 3)) {
+                    speclen -= 3;
+                    spec[speclen++] = 's'; spec[speclen] = '\0';
+                    std::string tmp(sval, slen);
+                    putf(snprintf(dst + out, size - out, spec, tmp.c_str()));
+                }else {
+                    putf(snprintf(dst + out, size - out, spec, static_cast<int>(slen), sval));
+                }
+            }else {
+                put("(?)", 3);
+            }
+            break;
+        case 'p':
+            putf(snprintf(dst + out, size - out, "%p", reinterpret_cast<void*>(static_cast<uintptr_t>(ival))));
+            break;
+        default:
+            put(pct, fmt - pct);
+            break;
+        }
+    }
+    dst[out] = '\0';
+    return out;
+}
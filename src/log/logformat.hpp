@@ -0,0 +1,141 @@
+#ifndef __LOGFORMAT_HPP
+#define __LOGFORMAT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+二进制日志的参数编码和延迟格式化 Log的写线程和离线解码工具共用
+调用点只记录 站点id + 时间戳 + 原始参数字节 格式化推迟到后台
+*/
+
+//参数类型标记 整数按宽度和符号区分 格式化时按格式串的转换符输出
+enum LogArgTag : uint8_t {
+    LOG_ARG_I32 = 1,
+    LOG_ARG_U32,
+    LOG_ARG_I64,
+    LOG_ARG_U64,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STR,
+    LOG_ARG_PTR,
+};
+
+template<typename T, typename Enable = void>
+struct LogArgTrait;
+
+template<typename T>
+struct LogArgTrait<T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type> {
+    using Int = typename std::conditional<std::is_enum<T>::value, int, T>::type;
+    static constexpr bool SIGNED = std::is_signed<Int>::value || sizeof(Int) < sizeof(int); //小整数会提升为int
+    static constexpr uint8_t TAG = sizeof(Int) <= 4 ? (SIGNED ? LOG_ARG_I32 : LOG_ARG_U32)
+                                                : (SIGNED ? LOG_ARG_I64 : LOG_ARG_U64);
+    static size_t Size(T) { return sizeof(Int) <= 4 ? 4 : 8; }
+    static char* Encode(char* dst, T v) {
+        if(sizeof(Int) <= 4) {
+            uint32_t raw = static_cast<uint32_t>(static_cast<Int>(v));
+            memcpy(dst, &raw, 4);
+            return dst + 4;
+        }
+        uint64_t raw = static_cast<uint64_t>(static_cast<Int>(v));
+        memcpy(dst, &raw, 8);
+        return dst + 8;
+    }
+};
+
+template<typename T>
+struct LogArgTrait<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    static constexpr uint8_t TAG = LOG_ARG_DOUBLE;
+    static size_t Size(T) { return sizeof(double); }
+    static char* Encode(char* dst, T v) {
+        double d = v;
+        memcpy(dst, &d, sizeof(d));
+        return dst + sizeof(d);
+    }
+};
+
+//字符串必须拷贝内容 调用返回后指针可能已经失效
+struct LogStrArg {
+    static constexpr uint8_t TAG = LOG_ARG_STR;
+    static constexpr uint32_t MAX_LEN = 1024; //超长截断
+    static size_t Size(const char* s) { return 4 + Len(s); }
+    static uint32_t Len(const char* s) { return s ? static_cast<uint32_t>(strnlen(s, MAX_LEN)) : 0; }
+    static char* Encode(char* dst, const char* s) {
+        uint32_t len = Len(s);
+        memcpy(dst, &len, 4);
+        if(len) memcpy(dst + 4, s, len);
+        return dst + 4 + len;
+    }
+};
+
+template<> struct LogArgTrait<const char*> : LogStrArg {};
+template<> struct LogArgTrait<char*> : LogStrArg {};
+
+template<typename T>
+struct LogArgTrait<T*, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type> {
+    static constexpr uint8_t TAG = LOG_ARG_PTR;
+    static size_t Size(const T*) { return 8; }
+    static char* Encode(char* dst, const T* p) {
+        uint64_t raw = reinterpret_cast<uintptr_t>(p);
+        memcpy(dst, &raw, 8);
+        return dst + 8;
+    }
+};
+
+//在decltype里使用 只为了拿到参数类型列表 不会求值
+template<typename... Args>
+struct LogArgTags {
+    static std::vector<uint8_t> Get() {
+        return {LogArgTrait<typename std::decay<Args>::type>::TAG...};
+    }
+};
+
+template<typename... Args>
+LogArgTags<Args...> LogArgTypes(const Args&...);
+
+//一个LOG_*调用点
+struct LogSite {
+    int level;
+    int line;
+    std::string format;
+    std::string file;
+    std::vector<uint8_t> tags;
+};
+
+/*
+二进制日志文件(BINARY模式) 用tools/logdecoder解码
+文件头 LogFileHeader
+站点定义 'S' site(u32) level(u32) line(u32) ntags(u16) fmtlen(u16) filelen(u16) tags fmt file
+二进制记录 'B' tsc(u64) level(u32) site(u32) arglen(u32) args
+文本记录 'T' tsc(u64) level(u32) len(u32) text
+站点定义在每个文件里第一次用到该站点前写出 每个文件都能单独解码
+*/
+struct LogFileHeader {
+    char magic[8]; // "TWSBLOG1"
+    uint64_t tsc0; //校准点
+    uint64_t wall0; //校准点对应的墙上时间 微秒
+    double ticksperus;
+};
+
+class LogFormat {
+public:
+    //时间和等级前缀 "2024-01-01 00:00:00.000000 [info] : "
+    static int Prefix(char* dst, size_t size, uint64_t wallUs, int level);
+
+    static const char* LevelTitle(int level);
+
+    //时间戳计数器 x86上是rdtsc 其他平台退化成单调时钟纳秒
+    static uint64_t Tsc();
+
+    //按站点的格式串把原始参数格式化到dst 返回长度(不含\0 超出size时截断)
+    static size_t Format(const LogSite& site, const char* args, size_t len, char* dst, size_t size);
+};
+
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef __LOGRING_HPP
+#define __LOGRING_HPP
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+/*
+单生产者单消费者的无锁字节环 每个写日志的线程独占一个
+记录格式: [Record头 16字节][内容] 按16字节对齐
+尾部放不下一整条记录时写一个WRAP标记 下一条从环的开头开始 保证内容总是连续的
+*/
+class LogRing {
+public:
+    explicit LogRing(size_t capacity = 1 << 18) {
+        m_cap = 1024;
+        while(m_cap < capacity) m_cap <<= 1;
+        m_data.reset(new char[m_cap]);
+        m_head = m_tail = 0;
+        m_cachedtail = 0;
+        m_reserved = m_skip = 0;
+        m_dropped = 0;
+        m_retired = false;
+    }
+
+    //生产者: 申请最多maxlen字节的连续空间 满了返回nullptr 不会阻塞
+    char* Reserve(size_t maxlen) {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        size_t pos = head & (m_cap - 1);
+        size_t need = Align(sizeof(Record) + maxlen);
+        size_t skip = (m_cap - pos < need) ? m_cap - pos : 0;
+        if(need + skip > m_cap) {
+            return nullptr;
+        }
+        if(head + skip + need - m_cachedtail > m_cap) {
+            m_cachedtail = m_tail.load(std::memory_order_acquire);
+            if(head + skip + need - m_cachedtail > m_cap) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+        }
+        m_skip = skip;
+        m_reserved = need;
+        return m_data.get() + ((head + skip) & (m_cap - 1)) + sizeof(Record);
+    }
+
+    //生产者: 提交Reserve得到的空间 len不能超过申请的长度
+    void Commit(uint64_t ts, uint32_t level, size_t len) {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        assert(Align(sizeof(Record) + len) <= m_reserved);
+        if(m_skip) {
+            Record wrap = {WRAP, 0, 0};
+            memcpy(m_data.get() + (head & (m_cap - 1)), &wrap, sizeof(wrap));
+            head += m_skip;
+        }
+        Record rec = {static_cast<uint32_t>(len), level, ts};
+        memcpy(m_data.get() + (head & (m_cap - 1)), &rec, sizeof(rec));
+        m_reserved = m_skip = 0;
+        m_head.store(head + Align(sizeof(Record) + len), std::memory_order_release);
+    }
+
+    //消费者: 查看最早的一条 没有返回false
+    bool Peek(uint64_t& ts, uint32_t& level, const char*& data, size_t& len) {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        while(tail != m_head.load(std::memory_order_acquire)) {
+            Record rec;
+            memcpy(&rec, m_data.get() + (tail & (m_cap - 1)), sizeof(rec));
+            if(rec.len == WRAP) {
+                tail += m_cap - (tail & (m_cap - 1));
+                m_tail.store(tail, std::memory_order_release);
+                continue;
+            }
+            ts = rec.ts;
+            level = rec.level;
+            data = m_data.get() + (tail & (m_cap - 1)) + sizeof(Record);
+            len = rec.len;
+            return true;
+        }
+        return false;
+    }
+
+    //消费者: 丢弃Peek到的那一条
+    void Pop() {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        Record rec;
+        memcpy(&rec, m_data.get() + (tail & (m_cap - 1)), sizeof(rec));
+        m_tail.store(tail + Align(sizeof(Record) + rec.len), std::memory_order_release);
+    }
+
+    //生产者: 已用字节数的上界 用的是缓存的读位置 不访问消费者的缓存行
+    size_t Used() const {
+        return m_head.load(std::memory_order_relaxed) - m_cachedtail;
+    }
+
+    size_t Capacity() const { return m_cap; }
+
+    bool Empty() const {
+        return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_acquire);
+    }
+
+    uint64_t Dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    //所属线程退出后标记 消费者读空后可以回收
+    void Retire() { m_retired.store(true, std::memory_order_release); }
+    bool Retired() const { return m_retired.load(std::memory_order_acquire); }
+
+private:
+    struct Record {
+        uint32_t len;
+        uint32_t level;
+        uint64_t ts;
+    };
+    static const uint32_t WRAP = 0xFFFFFFFF;
+
+    static size_t Align(size_t n) { return (n + 15) & ~static_cast<size_t>(15); }
+
+    std::unique_ptr<char[]> m_data;
+    size_t m_cap;
+
+    //生产者和消费者各自改的字段放在不同缓存行
+    alignas(64) std::atomic<uint64_t> m_head;
+    uint64_t m_cachedtail;
+    size_t m_reserved;
+    size_t m_skip;
+    std::atomic<uint64_t> m_dropped;
+
+    alignas(64) std::atomic<uint64_t> m_tail;
+    std::atomic<bool> m_retired;
+};
+
+
+#endif
@@ -0,0 +1,154 @@
+#include "logsegment.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+LogSegment::LogSegment() {
+    m_fd = -1;
+    m_addr = nullptr;
+    m_size = m_used = m_step = 0;
+}
+
+LogSegment::~LogSegment() {
+    Close();
+}
+
+//预分配磁盘块 不支持fallocate的文件系统退化为ftruncate
+static bool Allocate(int fd, size_t size) {
+    if(fallocate(fd, 0, 0, size) == 0) {
+        return true;
+    }
+    return ftruncate(fd, size) == 0;
+}
+
+bool LogSegment::Map(size_t size) {
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if(addr == MAP_FAILED) {
+        return false;
+    }
+    m_addr = static_cast<char*>(addr);
+    m_size = size;
+    return true;
+}
+
+bool LogSegment::Prepare(const std::string& tmpPath, size_t size) {
+    Close();
+    m_fd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(m_fd < 0) {
+        return false;
+    }
+    m_path = tmpPath;
+    m_step = size;
+    m_used = 0;
+    if(!Allocate(m_fd, size) || !Map(size)) {
+        close(m_fd);
+        unlink(tmpPath.c_str());
+        m_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool LogSegment::Open(const std::string& path, size_t size, LogSegment* spare, bool trimZeros) {
+    Close();
+    if(spare && spare->IsOpen() && spare->m_used == 0 && access(path.c_str(), F_OK) != 0
+        && rename(spare->m_path.c_str(), path.c_str()) == 0) {
+        //直接接管准备好的段 只是一次改名
+        m_fd = spare->m_fd;
+        m_addr = spare->m_addr;
+        m_size = spare->m_size;
+        m_step = spare->m_step;
+        m_used = 0;
+        m_path = path;
+        spare->m_fd = -1;
+        spare->m_addr = nullptr;
+        spare->m_size = spare->m_used = 0;
+        spare->m_path.clear();
+        return true;
+    }
+
+    m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(m_fd < 0) {
+        return false;
+    }
+    struct stat st = {};
+    fstat(m_fd, &st);
+    m_path = path;
+    m_step = size;
+    m_used = st.st_size;
+    size_t mapsize = m_used + size;
+    if(!Allocate(m_fd, mapsize) || !Map(mapsize)) {
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    while(trimZeros && m_used > 0 && m_addr[m_used - 1] == '\0') {
+        m_used--;
+    }
+    return true;
+}
+
+bool LogSegment::Grow(size_t need) {
+    size_t newsize = m_size;
+    while(newsize < m_used + need) {
+        newsize += m_step;
+    }
+    if(!Allocate(m_fd, newsize)) {
+        return false;
+    }
+    void* addr = mremap(m_addr, m_size, newsize, MREMAP_MAYMOVE);
+    if(addr == MAP_FAILED) {
+        return false;
+    }
+    m_addr = static_cast<char*>(addr);
+    m_size = newsize;
+    return true;
+}
+
+size_t LogSegment::Append(const char* data, size_t len) {
+    if(!m_addr) {
+        return 0;
+    }
+    if(m_used + len > m_size && !Grow(len)) {
+        return 0;
+    }
+    memcpy(m_addr + m_used, data, len);
+    m_used += len;
+    return len;
+}
+
+void LogSegment::Sync() {
+    if(m_addr) {
+        msync(m_addr, m_used, MS_ASYNC);
+    }
+}
+
+void LogSegment::Close() {
+    if(m_addr) {
+        munmap(m_addr, m_size);
+        m_addr = nullptr;
+    }
+    if(m_fd >= 0) {
+        //去掉预分配但没用到的部分
+        if(ftruncate(m_fd, m_used) < 0) {
+            perror("LogSegment ftruncate");
+        }
+        close(m_fd);
+        m_fd = -1;
+    }
+    m_size = m_used = 0;
+}
+
+void LogSegment::Discard() {
+    std::string path = m_path;
+    m_used = 0;
+    Close();
+    if(!path.empty()) {
+        unlink(path.c_str());
+    }
+    m_path.clear();
+}
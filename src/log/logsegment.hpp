@@ -0,0 +1,55 @@
+#ifndef __LOGSEGMENT_HPP
+#define __LOGSEGMENT_HPP
+
+#include <cstddef>
+#include <string>
+
+/*
+预分配并mmap映射的日志文件段
+写入就是一次memcpy 没有系统调用 写满了按段大小扩展
+关闭时把文件截断到实际写入的长度
+*/
+class LogSegment {
+public:
+    LogSegment();
+    ~LogSegment();
+    LogSegment(const LogSegment&) = delete;
+    LogSegment& operator=(const LogSegment&) = delete;
+
+    //创建临时文件并预分配 之后用Open的rename把它变成正式文件
+    bool Prepare(const std::string& tmpPath, size_t size);
+
+    //打开path 已存在就接着写 spare不为空且path不存在时直接改名使用预先准备好的段
+    //trimZeros: 文本日志上次异常退出时尾部留有预分配的0 从最后一个非0字节之后接着写
+    bool Open(const std::string& path, size_t size, LogSegment* spare = nullptr, bool trimZeros = true);
+
+    size_t Append(const char* data, size_t len);
+
+    //异步把脏页刷到磁盘
+    void Sync();
+
+    void Close();
+
+    //关闭并删除文件 用于没用上的预备段
+    void Discard();
+
+    bool IsOpen() const { return m_addr != nullptr; }
+
+    size_t Used() const { return m_used; }
+
+    const std::string& Path() const { return m_path; }
+
+private:
+    bool Map(size_t size);
+    bool Grow(size_t need);
+
+    int m_fd;
+    char* m_addr;
+    size_t m_size; //映射长度
+    size_t m_used; //已写入长度
+    size_t m_step; //每次扩展的长度
+    std::string m_path;
+};
+
+
+#endif
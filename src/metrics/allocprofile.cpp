@@ -0,0 +1,200 @@
+#include "allocprofile.hpp"
+#include <cstdio>
+
+static const char* TAG_NAME[AT_COUNT] = {"other", "parse", "response", "log", "pool"};
+
+const char* AllocProfiler::TagName(ALLOC_TAG tag) {
+    return tag < AT_COUNT ? TAG_NAME[tag] : "?";
+}
+
+#ifdef PROFILE_ALLOCS
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include "metrics.hpp"
+
+/*
+计数器在静态初始化时创建 之前发生的分配只记进线程累计值
+计数本身(第一次分配分片等)可能再分配 t_busy防止递归
+*/
+static Counter* s_allocs[AT_COUNT];
+static Counter* s_bytes[AT_COUNT];
+static Counter* s_frees;
+static Counter* s_requests;
+static Counter* s_reqallocs;
+static Counter* s_reqbytes;
+static std::atomic<uint64_t> s_maxallocs(0);
+static std::atomic<uint64_t> s_maxbytes(0);
+static std::atomic<bool> s_ready(false);
+static thread_local bool t_busy = false;
+
+//比Metrics后构造 先析构 之后退出过程中的分配和释放不再碰已经销毁的计数器
+struct CounterGuard {
+    ~CounterGuard() { s_ready.store(false, std::memory_order_relaxed); }
+};
+
+static bool InitCounters() {
+    t_busy = true;
+    Metrics* metrics = Metrics::Instance();
+    static CounterGuard guard;
+    for(int i = 0; i < AT_COUNT; i++) {
+        std::string label = std::string("{tag=\"") + TAG_NAME[i] + "\"}";
+        s_allocs[i] = metrics->NewCounter("webserver_alloc_total" + label, "Heap allocations by subsystem tag");
+        s_bytes[i] = metrics->NewCounter("webserver_alloc_bytes_total" + label, "Bytes requested from operator new by subsystem tag");
+    }
+    s_frees = metrics->NewCounter("webserver_free_total", "Calls to operator delete");
+    s_requests = metrics->NewCounter("webserver_alloc_requests_total", "Requests with allocation accounting");
+    s_reqallocs = metrics->NewCounter("webserver_request_allocs_total", "Heap allocations attributed to requests");
+    s_reqbytes = metrics->NewCounter("webserver_request_alloc_bytes_total", "Heap bytes attributed to requests");
+    t_busy = false;
+    s_ready.store(true, std::memory_order_release);
+    return true;
+}
+static const bool s_inited = InitCounters();
+
+static void CountAlloc(size_t size) {
+    AllocCount& count = AllocProfiler::t_count;
+    count.allocs++;
+    count.bytes += size;
+    if(!t_busy && s_ready.load(std::memory_order_relaxed)) {
+        t_busy = true;
+        s_allocs[AllocProfiler::t_tag]->Inc();
+        s_bytes[AllocProfiler::t_tag]->Inc(size);
+        t_busy = false;
+    }
+}
+
+static void CountFree(void* ptr) {
+    if(ptr && !t_busy && s_ready.load(std::memory_order_relaxed)) {
+        t_busy = true;
+        s_frees->Inc();
+        t_busy = false;
+    }
+}
+
+static void* Allocate(size_t size, size_t align) {
+    if(size == 0) size = 1;
+    void* ptr = nullptr;
+    if(align > alignof(std::max_align_t)) {
+        if(posix_memalign(&ptr, align, size) != 0) ptr = nullptr;
+    }else {
+        ptr = malloc(size);
+    }
+    if(ptr) {
+        CountAlloc(size);
+    }
+    return ptr;
+}
+
+static void* AllocateOrThrow(size_t size, size_t align) {
+    while(true) {
+        void* ptr = Allocate(size, align);
+        if(ptr) return ptr;
+        std::new_handler handler = std::get_new_handler();
+        if(!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+static void Deallocate(void* ptr) {
+    CountFree(ptr);
+    free(ptr);
+}
+
+void* operator new(size_t size) { return AllocateOrThrow(size, 0); }
+void* operator new[](size_t size) { return AllocateOrThrow(size, 0); }
+void* operator new(size_t size, std::align_val_t align) { return AllocateOrThrow(size, static_cast<size_t>(align)); }
+void* operator new[](size_t size, std::align_val_t align) { return AllocateOrThrow(size, static_cast<size_t>(align)); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return Allocate(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return Allocate(size, 0); }
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return Allocate(size, static_cast<size_t>(align));
+}
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return Allocate(size, static_cast<size_t>(align));
+}
+
+void operator delete(void* ptr) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { Deallocate(ptr); }
+void operator delete(void* ptr, size_t) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { Deallocate(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { Deallocate(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { Deallocate(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { Deallocate(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { Deallocate(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { Deallocate(ptr); }
+
+static void UpdateMax(std::atomic<uint64_t>& max, uint64_t v) {
+    uint64_t cur = max.load(std::memory_order_relaxed);
+    while(v > cur && !max.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {}
+}
+
+AllocCount AllocProfiler::ThisThread() {
+    return t_count;
+}
+
+void AllocProfiler::RequestDone(const AllocCount& count) {
+    s_requests->Inc();
+    s_reqallocs->Inc(count.allocs);
+    s_reqbytes->Inc(count.bytes);
+    UpdateMax(s_maxallocs, count.allocs);
+    UpdateMax(s_maxbytes, count.bytes);
+}
+
+AllocReport AllocProfiler::Report() {
+    AllocReport report;
+    for(int i = 0; i < AT_COUNT; i++) {
+        report.tags[i] = {s_allocs[i]->Value(), s_bytes[i]->Value()};
+    }
+    report.frees = s_frees->Value();
+    report.requests = s_requests->Value();
+    report.perRequest = {s_reqallocs->Value(), s_reqbytes->Value()};
+    report.maxRequest = {s_maxallocs.load(), s_maxbytes.load()};
+    return report;
+}
+
+#else
+
+AllocCount AllocProfiler::ThisThread() {
+    return AllocCount();
+}
+
+void AllocProfiler::RequestDone(const AllocCount&) {}
+
+AllocReport AllocProfiler::Report() {
+    return AllocReport();
+}
+
+#endif
+
+std::string AllocProfiler::Format() {
+    if(!ENABLED) {
+        return "allocation profiling disabled (build with -DPROFILE_ALLOCS)\n";
+    }
+    AllocReport report = Report();
+    std::string out;
+    char line[256];
+    snprintf(line, sizeof(line), "%-10s %14s %16s %10s\n", "tag", "allocs", "bytes", "avg");
+    out += line;
+    for(int i = 0; i < AT_COUNT; i++) {
+        const AllocCount& c = report.tags[i];
+        snprintf(line, sizeof(line), "%-10s %14llu %16llu %10.1f\n", TAG_NAME[i], (unsigned long long)c.allocs,
+                 (unsigned long long)c.bytes, c.allocs ? static_cast<double>(c.bytes) / c.allocs : 0.0);
+        out += line;
+    }
+    snprintf(line, sizeof(line), "frees %llu\n", (unsigned long long)report.frees);
+    out += line;
+    if(report.requests > 0) {
+        snprintf(line, sizeof(line), "per request (%llu): %.1f allocs %.0f bytes avg, %llu allocs %llu bytes max\n",
+                 (unsigned long long)report.requests, static_cast<double>(report.perRequest.allocs) / report.requests,
+                 static_cast<double>(report.perRequest.bytes) / report.requests,
+                 (unsigned long long)report.maxRequest.allocs, (unsigned long long)report.maxRequest.bytes);
+        out += line;
+    }
+    return out;
+}
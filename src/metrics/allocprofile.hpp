@@ -0,0 +1,101 @@
+#ifndef __ALLOCPROFILE_HPP
+#define __ALLOCPROFILE_HPP
+
+#include <cstdint>
+#include <string>
+
+/*
+堆分配统计 编译时定义PROFILE_ALLOCS才替换全局operator new/delete
+每次分配按当前线程的标签(AllocScope设置)计数 计数器就是Metrics里按线程分片的Counter 在/metrics里输出
+另外每个线程有一份普通的累计值 AllocScope可以把一段代码里的分配加到一个请求上 请求结束时交给RequestDone汇总
+没有定义PROFILE_ALLOCS时AllocScope是空的 ThisThread永远是0
+*/
+
+enum ALLOC_TAG : uint8_t {
+    AT_OTHER,
+    AT_PARSE, //解析请求 包括同步的用户校验
+    AT_RESPONSE, //生成响应头和内容
+    AT_LOG,
+    AT_POOL, //往线程池投任务
+    AT_COUNT
+};
+
+struct AllocCount {
+    uint64_t allocs = 0;
+    uint64_t bytes = 0;
+
+    AllocCount operator-(const AllocCount& other) const { return {allocs - other.allocs, bytes - other.bytes}; }
+    AllocCount& operator+=(const AllocCount& other) {
+        allocs += other.allocs;
+        bytes += other.bytes;
+        return *this;
+    }
+};
+
+struct AllocReport {
+    AllocCount tags[AT_COUNT];
+    uint64_t frees;
+    uint64_t requests; //经过RequestDone的请求
+    AllocCount perRequest; //这些请求的合计
+    AllocCount maxRequest; //单个请求的最大值 两项分别取最大
+};
+
+class AllocProfiler {
+public:
+#ifdef PROFILE_ALLOCS
+    static constexpr bool ENABLED = true;
+#else
+    static constexpr bool ENABLED = false;
+#endif
+
+    //当前线程到现在为止的分配 压测里前后相减就是一段代码的分配次数
+    static AllocCount ThisThread();
+
+    //一个请求的分配计入统计
+    static void RequestDone(const AllocCount& count);
+
+    static AllocReport Report();
+
+    //按标签的表格和每请求的平均/最大值
+    static std::string Format();
+
+    static const char* TagName(ALLOC_TAG tag);
+
+#ifdef PROFILE_ALLOCS
+    static inline thread_local ALLOC_TAG t_tag = AT_OTHER;
+    static inline thread_local AllocCount t_count;
+#endif
+};
+
+//作用域内的分配记在tag下 给了request的话作用域内的分配还加到它上面 带request的作用域不要嵌套
+class AllocScope {
+public:
+#ifdef PROFILE_ALLOCS
+    explicit AllocScope(ALLOC_TAG tag, AllocCount* request = nullptr)
+        : m_prev(AllocProfiler::t_tag), m_request(request), m_begin(AllocProfiler::t_count) {
+        AllocProfiler::t_tag = tag;
+    }
+
+    ~AllocScope() {
+        AllocProfiler::t_tag = m_prev;
+        if(m_request) {
+            *m_request += AllocProfiler::t_count - m_begin;
+        }
+    }
+#else
+    explicit AllocScope(ALLOC_TAG, AllocCount* = nullptr) {}
+#endif
+
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+
+#ifdef PROFILE_ALLOCS
+private:
+    ALLOC_TAG m_prev;
+    AllocCount* m_request;
+    AllocCount m_begin;
+#endif
+};
+
+
+#endif
@@ -0,0 +1,219 @@
+#include "metrics.hpp"
+#include <cinttypes>
+#include <cstdio>
+
+//已分配出去的分片
+static std::mutex s_shardmtx;
+static bool s_shardused[MetricShard::SLOTS];
+
+MetricShard::Releaser::~Releaser() {
+    if(t_shard < SHARED) {
+        std::lock_guard<std::mutex> locker(s_shardmtx);
+        s_shardused[t_shard] = false;
+    }
+    t_shard = SHARED;
+}
+
+unsigned MetricShard::Acquire() {
+    static thread_local Releaser releaser;
+    (void)releaser;
+    unsigned shard = SHARED;
+    {
+        std::lock_guard<std::mutex> locker(s_shardmtx);
+        for(unsigned i = 0; i < SLOTS; i++) {
+            if(!s_shardused[i]) {
+                s_shardused[i] = true;
+                shard = i;
+                break;
+            }
+        }
+    }
+    t_shard = shard;
+    return shard;
+}
+
+uint64_t Counter::Value() const {
+    uint64_t total = 0;
+    for(auto& cell: m_cells) {
+        total += cell.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t Histogram::UpperBound(unsigned idx) {
+    if(idx < SUB_COUNT) {
+        return idx;
+    }
+    unsigned shift = idx / SUB_COUNT - 1;
+    uint64_t lower = static_cast<uint64_t>(SUB_COUNT + idx % SUB_COUNT) << shift;
+    return lower + (1ull << shift) - 1;
+}
+
+void Histogram::Collect(Snapshot* snap) const {
+    snap->count = snap->sum = 0;
+    for(unsigned i = 0; i < BUCKETS; i++) {
+        uint64_t n = 0;
+        for(auto& shard: m_shards) {
+            n += shard.buckets[i].load(std::memory_order_relaxed);
+        }
+        snap->counts[i] = n;
+        snap->count += n;
+    }
+    for(auto& shard: m_shards) {
+        snap->sum += shard.sum.load(std::memory_order_relaxed);
+    }
+}
+
+uint64_t Histogram::Snapshot::Quantile(double q) const {
+    if(count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(q * count);
+    if(rank >= count) rank = count - 1;
+    uint64_t seen = 0;
+    for(unsigned i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        if(seen > rank) {
+            return UpperBound(i);
+        }
+    }
+    return UpperBound(BUCKETS - 1);
+}
+
+Metrics* Metrics::Instance() {
+    static Metrics metrics;
+    return &metrics;
+}
+
+Metrics::Entry* Metrics::Find(const std::string& name) {
+    for(auto& entry: m_entries) {
+        if(entry->name == name) return entry.get();
+    }
+    return nullptr;
+}
+
+Metrics::Entry* Metrics::Add(const std::string& name, const std::string& help, TYPE type) {
+    m_entries.emplace_back(new Entry);
+    Entry* entry = m_entries.back().get();
+    entry->name = name;
+    entry->family = name.substr(0, name.find('{'));
+    entry->help = help;
+    entry->type = type;
+    return entry;
+}
+
+Counter* Metrics::NewCounter(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> locker(m_mtx);
+    Entry* entry = Find(name);
+    if(!entry) {
+        entry = Add(name, help, COUNTER);
+        entry->counter.reset(new Counter);
+    }
+    return entry->counter.get();
+}
+
+Gauge* Metrics::NewGauge(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> locker(m_mtx);
+    Entry* entry = Find(name);
+    if(!entry) {
+        entry = Add(name, help, GAUGE);
+        entry->gauge.reset(new Gauge);
+    }
+    return entry->gauge.get();
+}
+
+Histogram* Metrics::NewHistogram(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> locker(m_mtx);
+    Entry* entry = Find(name);
+    if(!entry) {
+        entry = Add(name, help, HISTOGRAM);
+        entry->histogram.reset(new Histogram);
+    }
+    return entry->histogram.get();
+}
+
+void Metrics::AddCallback(const std::string& name, const std::string& help, TYPE type, std::function<double()> fn) {
+    std::lock_guard<std::mutex> locker(m_mtx);
+    Entry* entry = Find(name);
+    if(!entry) {
+        entry = Add(name, help, type);
+    }
+    entry->callback = std::move(fn);
+}
+
+void Metrics::RemoveCallback(const std::string& name) {
+    std::lock_guard<std::mutex> locker(m_mtx);
+    for(auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if((*it)->name == name && (*it)->callback) {
+            m_entries.erase(it);
+            return;
+        }
+    }
+}
+
+std::string Metrics::Render() {
+    static const char* TYPE_NAME[] = {"counter", "gauge", "histogram"};
+    std::lock_guard<std::mutex> locker(m_mtx);
+    std::string out;
+    out.reserve(m_entries.size() * 128);
+    std::vector<bool> done(m_entries.size(), false);
+    char line[256];
+    //同一族的放在一起 按第一次注册的顺序
+    for(size_t i = 0; i < m_entries.size(); i++) {
+        if(done[i]) continue;
+        const Entry& head = *m_entries[i];
+        out += "# HELP " + head.family + " " + head.help + "\n";
+        out += "# TYPE " + head.family + " " + TYPE_NAME[head.type] + "\n";
+        for(size_t j = i; j < m_entries.size(); j++) {
+            const Entry& entry = *m_entries[j];
+            if(done[j] || entry.family != head.family) continue;
+            done[j] = true;
+            if(entry.callback) {
+                snprintf(line, sizeof(line), "%s %.17g\n", entry.name.c_str(), entry.callback());
+                out += line;
+            }else if(entry.counter) {
+                snprintf(line, sizeof(line), "%s %" PRIu64 "\n", entry.name.c_str(), entry.counter->Value());
+                out += line;
+            }else if(entry.gauge) {
+                snprintf(line, sizeof(line), "%s %" PRId64 "\n", entry.name.c_str(), entry.gauge->Value());
+                out += line;
+            }else if(entry.histogram) {
+                RenderHistogram(entry, out);
+            }
+        }
+    }
+    return out;
+}
+
+void Metrics::RenderHistogram(const Entry& entry, std::string& out) {
+    //1us到约137s 之外的只进+Inf
+    static const unsigned FIRST_EXP = 9, LAST_EXP = 36;
+    std::unique_ptr<Histogram::Snapshot> snap(new Histogram::Snapshot);
+    entry.histogram->Collect(snap.get());
+
+    //标签原样保留 再加上le
+    size_t brace = entry.name.find('{');
+    std::string labels = brace == std::string::npos ? "" : entry.name.substr(brace + 1, entry.name.size() - brace - 2);
+    std::string prefix = entry.family + "_bucket{" + labels + (labels.empty() ? "" : ",");
+    std::string suffix = brace == std::string::npos ? "" : entry.name.substr(brace);
+
+    char line[256];
+    uint64_t cumulative = 0;
+    unsigned idx = 0;
+    for(unsigned exp = FIRST_EXP; exp <= LAST_EXP; exp++) {
+        //指数为exp的区间之前(含)的所有桶
+        unsigned end = (exp - Histogram::SUB_BITS + 2) * Histogram::SUB_COUNT;
+        for(; idx < end; idx++) {
+            cumulative += snap->counts[idx];
+        }
+        double le = static_cast<double>(Histogram::UpperBound(end - 1) + 1) / 1e9;
+        snprintf(line, sizeof(line), "%sle=\"%.9g\"} %" PRIu64 "\n", prefix.c_str(), le, cumulative);
+        out += line;
+    }
+    snprintf(line, sizeof(line), "%sle=\"+Inf\"} %" PRIu64 "\n", prefix.c_str(), snap->count);
+    out += line;
+    snprintf(line, sizeof(line), "%s_sum%s %.9f\n", entry.family.c_str(), suffix.c_str(), snap->sum / 1e9);
+    out += line;
+    snprintf(line, sizeof(line), "%s_count%s %" PRIu64 "\n", entry.family.c_str(), suffix.c_str(), snap->count);
+    out += line;
+}
@@ -0,0 +1,187 @@
+#ifndef __METRICS_HPP
+#define __METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+指标注册表 输出Prometheus文本格式
+计数器和直方图按线程分片 每个线程独占一片(独占缓存行) 记录时只是普通的读加写 没有锁也没有原子加 读的时候才把各片加起来
+仪表(gauge)是一个原子量 或者注册一个回调 读的时候去问对应模块(队列长度/连接池空闲数这类本来就有的值)
+名字可以带标签 如 webserver_http_responses_total{code="200"} 同名(不含标签)的归为一族输出一次HELP/TYPE
+指标对象注册后一直存在 返回的指针可以放在静态变量里随便用
+*/
+
+/*
+线程的分片号 第一次记录时分配 线程退出时归还给后来的线程
+同时记录的线程超过SLOTS个时 多出来的共用SHARED那一片 用原子加
+*/
+class MetricShard {
+public:
+    static const unsigned SLOTS = 64;
+    static const unsigned SHARED = SLOTS;
+
+    static unsigned Get() {
+        unsigned shard = t_shard;
+        return shard != UNSET ? shard : Acquire();
+    }
+
+    //同一个分片只有一个线程写 读的线程可能看到旧值但不会撕裂
+    static void Add(std::atomic<uint64_t>& cell, unsigned shard, uint64_t n) {
+        if(shard < SHARED) {
+            cell.store(cell.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }else {
+            cell.fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static const unsigned UNSET = ~0u;
+
+    //线程退出时归还分片 之后这个线程再记录的话走SHARED
+    struct Releaser {
+        ~Releaser();
+    };
+
+    static unsigned Acquire();
+
+    static inline thread_local unsigned t_shard = UNSET;
+};
+
+class Counter {
+public:
+    void Inc(uint64_t n = 1) {
+        unsigned shard = MetricShard::Get();
+        MetricShard::Add(m_cells[shard].value, shard, n);
+    }
+
+    uint64_t Value() const;
+
+private:
+    struct alignas(64) Cell {
+        std::atomic<uint64_t> value{0};
+    };
+    Cell m_cells[MetricShard::SLOTS + 1];
+};
+
+class Gauge {
+public:
+    void Set(int64_t v) { m_value.store(v, std::memory_order_relaxed); }
+    void Add(int64_t n) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    int64_t Value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    alignas(64) std::atomic<int64_t> m_value{0};
+};
+
+/*
+HDR式的对数线性直方图 单位纳秒 每个分片约2.5KB
+小于8的值各占一个桶 之后每个2的幂区间分8个桶 相对误差不超过12.5% 最大到2^40ns(约18分钟) 更大的记进最后一个桶
+*/
+class Histogram {
+public:
+    static const unsigned SUB_BITS = 3;
+    static const unsigned SUB_COUNT = 1 << SUB_BITS;
+    static const unsigned MAX_EXP = 40;
+    static const unsigned BUCKETS = (MAX_EXP - SUB_BITS + 2) * SUB_COUNT;
+
+    void Record(uint64_t ns) {
+        unsigned idx = MetricShard::Get();
+        Shard& shard = m_shards[idx];
+        MetricShard::Add(shard.buckets[Index(ns)], idx, 1);
+        MetricShard::Add(shard.sum, idx, ns);
+    }
+
+    //记录从begin到现在的时间
+    void RecordSince(std::chrono::steady_clock::time_point begin) {
+        Record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+    }
+
+    //各分片合起来的快照
+    struct Snapshot {
+        uint64_t counts[BUCKETS];
+        uint64_t count;
+        uint64_t sum;
+
+        //q分位所在桶的上界 没有数据时为0
+        uint64_t Quantile(double q) const;
+    };
+    void Collect(Snapshot* snap) const;
+
+    static unsigned Index(uint64_t v) {
+        if(v < SUB_COUNT) {
+            return v;
+        }
+        unsigned exp = 63 - __builtin_clzll(v);
+        if(exp > MAX_EXP) {
+            return BUCKETS - 1;
+        }
+        return (exp - SUB_BITS + 1) * SUB_COUNT + ((v >> (exp - SUB_BITS)) & (SUB_COUNT - 1));
+    }
+
+    //桶里最大的值
+    static uint64_t UpperBound(unsigned idx);
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> buckets[BUCKETS] = {};
+        std::atomic<uint64_t> sum{0};
+    };
+    Shard m_shards[MetricShard::SLOTS + 1];
+};
+
+class Metrics {
+public:
+    enum TYPE {
+        COUNTER,
+        GAUGE,
+        HISTOGRAM
+    };
+
+    static Metrics* Instance();
+
+    //同名的指标已存在时返回原来那个
+    Counter* NewCounter(const std::string& name, const std::string& help);
+    Gauge* NewGauge(const std::string& name, const std::string& help);
+    Histogram* NewHistogram(const std::string& name, const std::string& help);
+
+    //读的时候调用fn取值 fn在渲染线程里调用 需要自己保证线程安全 同名的回调会被替换
+    void AddCallback(const std::string& name, const std::string& help, TYPE type, std::function<double()> fn);
+
+    //回调引用的对象销毁前要先移除
+    void RemoveCallback(const std::string& name);
+
+    //Prometheus文本格式 直方图以秒为单位输出 每个2的幂一个le
+    std::string Render();
+
+private:
+    Metrics() = default;
+
+    struct Entry {
+        std::string name;
+        std::string family; //不含标签的名字
+        std::string help;
+        TYPE type;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+        std::function<double()> callback;
+    };
+
+    Entry* Find(const std::string& name);
+    Entry* Add(const std::string& name, const std::string& help, TYPE type);
+
+    static void RenderHistogram(const Entry& entry, std::string& out);
+
+    std::mutex m_mtx; //只在注册和读的时候用
+    std::vector<std::unique_ptr<Entry>> m_entries;
+};
+
+
+#endif
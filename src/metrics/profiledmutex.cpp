@@ -0,0 +1,158 @@
+#include "profiledmutex.hpp"
+#include <algorithm>
+#include <cstdio>
+
+#ifdef PROFILE_LOCKS
+
+#include <atomic>
+#include <memory>
+#include <time.h>
+#include "metrics.hpp"
+
+struct LockSite {
+    std::string name;
+    std::atomic<unsigned long long> acquisitions{0};
+    std::atomic<unsigned long long> contended{0};
+    std::atomic<unsigned long long> waitNs{0};
+    std::atomic<unsigned long long> holdNs{0};
+    std::atomic<unsigned long long> maxWaitNs{0};
+    std::atomic<unsigned long long> maxHoldNs{0};
+};
+
+//调用点只增不减 地址一直有效 故意不释放 退出时其他静态对象析构还可能加锁
+static std::mutex s_sitemtx;
+static std::vector<std::unique_ptr<LockSite>>& Sites() {
+    static auto* sites = new std::vector<std::unique_ptr<LockSite>>;
+    return *sites;
+}
+
+static LockSite* FindSite(const char* name) {
+    std::lock_guard<std::mutex> locker(s_sitemtx);
+    for(auto& site: Sites()) {
+        if(site->name == name) return site.get();
+    }
+    Sites().emplace_back(new LockSite);
+    Sites().back()->name = name;
+    return Sites().back().get();
+}
+
+static unsigned long long NowNS() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void UpdateMax(std::atomic<unsigned long long>& max, unsigned long long v) {
+    unsigned long long cur = max.load(std::memory_order_relaxed);
+    while(v > cur && !max.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {}
+}
+
+ProfiledMutex::ProfiledMutex(): m_site(FindSite("unnamed")), m_lockedat(0) {}
+
+void ProfiledMutex::SetName(const char* name) {
+    m_site = FindSite(name);
+}
+
+void ProfiledMutex::lock() {
+    if(!m_mtx.try_lock()) {
+        unsigned long long begin = NowNS();
+        m_mtx.lock();
+        m_lockedat = NowNS();
+        unsigned long long wait = m_lockedat - begin;
+        m_site->contended.fetch_add(1, std::memory_order_relaxed);
+        m_site->waitNs.fetch_add(wait, std::memory_order_relaxed);
+        UpdateMax(m_site->maxWaitNs, wait);
+    }else {
+        m_lockedat = NowNS();
+    }
+    m_site->acquisitions.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool ProfiledMutex::try_lock() {
+    if(!m_mtx.try_lock()) {
+        return false;
+    }
+    m_lockedat = NowNS();
+    m_site->acquisitions.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void ProfiledMutex::unlock() {
+    unsigned long long hold = NowNS() - m_lockedat;
+    LockSite* site = m_site;
+    m_mtx.unlock();
+    site->holdNs.fetch_add(hold, std::memory_order_relaxed);
+    UpdateMax(site->maxHoldNs, hold);
+}
+
+std::vector<LockReport> LockProfiler::Report() {
+    std::vector<LockReport> reports;
+    {
+        std::lock_guard<std::mutex> locker(s_sitemtx);
+        for(auto& site: Sites()) {
+            if(site->acquisitions.load() == 0) continue;
+            reports.push_back({site->name, site->acquisitions.load(), site->contended.load(), site->waitNs.load(),
+                               site->holdNs.load(), site->maxWaitNs.load(), site->maxHoldNs.load()});
+        }
+    }
+    std::sort(reports.begin(), reports.end(),
+              [](const LockReport& a, const LockReport& b) { return a.waitNs > b.waitNs; });
+    return reports;
+}
+
+void LockProfiler::Reset() {
+    std::lock_guard<std::mutex> locker(s_sitemtx);
+    for(auto& site: Sites()) {
+        site->acquisitions = site->contended = site->waitNs = site->holdNs = 0;
+        site->maxWaitNs = site->maxHoldNs = 0;
+    }
+}
+
+void LockProfiler::ExportMetrics() {
+    Metrics* metrics = Metrics::Instance();
+    std::lock_guard<std::mutex> locker(s_sitemtx);
+    for(auto& ptr: Sites()) {
+        LockSite* site = ptr.get();
+        if(site->name == "unnamed") continue;
+        std::string label = "{site=\"" + site->name + "\"}";
+        metrics->AddCallback("webserver_lock_acquisitions_total" + label, "Lock acquisitions per lock site",
+                             Metrics::COUNTER, [site] { return static_cast<double>(site->acquisitions.load()); });
+        metrics->AddCallback("webserver_lock_contended_total" + label, "Acquisitions that had to wait for the lock",
+                             Metrics::COUNTER, [site] { return static_cast<double>(site->contended.load()); });
+        metrics->AddCallback("webserver_lock_wait_seconds_total" + label, "Time spent waiting for the lock",
+                             Metrics::COUNTER, [site] { return site->waitNs.load() / 1e9; });
+        metrics->AddCallback("webserver_lock_hold_seconds_total" + label, "Time the lock was held",
+                             Metrics::COUNTER, [site] { return site->holdNs.load() / 1e9; });
+    }
+}
+
+#else
+
+std::vector<LockReport> LockProfiler::Report() {
+    return {};
+}
+
+void LockProfiler::Reset() {}
+
+void LockProfiler::ExportMetrics() {}
+
+#endif
+
+std::string LockProfiler::Format() {
+    std::vector<LockReport> reports = Report();
+    if(reports.empty()) {
+        return "lock profiling disabled (build with -DPROFILE_LOCKS)\n";
+    }
+    std::string out;
+    char line[256];
+    snprintf(line, sizeof(line), "%-16s %12s %10s %8s %12s %10s %12s %10s\n", "lock", "acquired", "contended", "rate",
+             "wait(ms)", "maxwait(us)", "hold(ms)", "maxhold(us)");
+    out += line;
+    for(auto& r: reports) {
+        snprintf(line, sizeof(line), "%-16s %12llu %10llu %7.2f%% %12.3f %10.1f %12.3f %10.1f\n", r.name.c_str(),
+                 r.acquisitions, r.contended, r.acquisitions ? 100.0 * r.contended / r.acquisitions : 0.0,
+                 r.waitNs / 1e6, r.maxWaitNs / 1e3, r.holdNs / 1e6, r.maxHoldNs / 1e3);
+        out += line;
+    }
+    return out;
+}
@@ -0,0 +1,78 @@
+#ifndef __PROFILEDMUTEX_HPP
+#define __PROFILEDMUTEX_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+带统计的互斥锁 编译时定义PROFILE_LOCKS才生效
+按锁的名字(调用点)统计 获取次数 发生争用的次数 等锁时间 持锁时间 同名的多个锁实例合在一起算
+没有定义PROFILE_LOCKS时ProfiledMutex就是std::mutex ProfiledCondVar就是std::condition_variable 没有任何额外开销
+用法: 成员声明成ProfiledMutex 构造时NameLock(m_mtx, "log") 加锁照常用lock_guard/unique_lock<ProfiledMutex>
+*/
+
+//一个锁调用点的统计快照
+struct LockReport {
+    std::string name;
+    unsigned long long acquisitions;
+    unsigned long long contended; //第一次try_lock没拿到的次数
+    unsigned long long waitNs; //争用时等锁的总时间
+    unsigned long long holdNs;
+    unsigned long long maxWaitNs;
+    unsigned long long maxHoldNs;
+};
+
+class LockProfiler {
+public:
+    //按等锁总时间从大到小 不含还没加过锁的 没有定义PROFILE_LOCKS时为空
+    static std::vector<LockReport> Report();
+
+    //Report的表格形式 每个锁一行
+    static std::string Format();
+
+    //清零所有计数 比如压测预热之后
+    static void Reset();
+
+    //把已有的锁注册到Metrics 以webserver_lock_*{site="..."}输出 之后才命名的锁不会出现
+    static void ExportMetrics();
+};
+
+#ifdef PROFILE_LOCKS
+
+struct LockSite;
+
+class ProfiledMutex {
+public:
+    ProfiledMutex(); //没有NameLock的锁都算在"unnamed"里
+    ProfiledMutex(const ProfiledMutex&) = delete;
+    ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+    void SetName(const char* name);
+
+private:
+    std::mutex m_mtx;
+    LockSite* m_site;
+    unsigned long long m_lockedat; //持锁期间只有持有者读写
+};
+
+using ProfiledCondVar = std::condition_variable_any;
+
+inline void NameLock(ProfiledMutex& mtx, const char* name) { mtx.SetName(name); }
+
+#else
+
+using ProfiledMutex = std::mutex;
+using ProfiledCondVar = std::condition_variable;
+
+inline void NameLock(std::mutex&, const char*) {}
+
+#endif
+
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef __CONNPOOL_HPP
+#define __CONNPOOL_HPP
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*
+连接对象池 只在一个reactor线程里使用 不加锁
+对象按SLAB_SIZE个一组分配 地址和下标一直不变 关闭后放回空闲栈给下一个连接复用
+空闲栈后进先出 刚释放的对象(缓存和缓冲区都还热)最先被复用
+每个槽位有一个代数 回收时加一 句柄(代数<<32|下标)在槽位复用后就失效
+用句柄代替fd查找连接 旧事件和线程池回调不会落到复用了同一个fd的新连接上
+空闲对象超过warmMax个时调用T::Shrink()把缓冲区还掉 其余的保留着下次直接用
+*/
+template<class T>
+class ConnPool {
+public:
+    static const uint32_t SLAB_SIZE = 64;
+    static const uint32_t GEN_MASK = 0xFFFFFF; //代数只用24位 句柄不超过56位 能和操作码一起放进io_uring的user_data
+
+    explicit ConnPool(uint32_t maxCount, uint32_t warmMax = 1024): m_max(maxCount), m_warmmax(warmMax), m_used(0) {}
+    ConnPool(const ConnPool&) = delete;
+    ConnPool& operator=(const ConnPool&) = delete;
+
+    //取一个空闲对象 达到上限时返回nullptr
+    T* Acquire(uint64_t* handle) {
+        if(m_free.empty() && !Grow()) {
+            return nullptr;
+        }
+        uint32_t idx = m_free.back();
+        m_free.pop_back();
+        Slot& slot = At(idx);
+        slot.used = true;
+        m_used++;
+        *handle = Handle(idx, slot.gen);
+        return &slot.obj;
+    }
+
+    //对象放回池里 之前发出去的句柄全部失效
+    void Recycle(uint64_t handle) {
+        uint32_t idx = static_cast<uint32_t>(handle);
+        Slot& slot = At(idx);
+        assert(slot.used && slot.gen == Gen(handle));
+        slot.used = false;
+        slot.gen = (slot.gen + 1) & GEN_MASK;
+        m_used--;
+        if(m_free.size() >= m_warmmax) {
+            slot.obj.Shrink();
+        }
+        m_free.push_back(idx);
+    }
+
+    //句柄失效(对象已回收或被复用)时返回nullptr
+    T* Find(uint64_t handle) {
+        uint32_t idx = static_cast<uint32_t>(handle);
+        if(idx >= m_slabs.size() * SLAB_SIZE) {
+            return nullptr;
+        }
+        Slot& slot = At(idx);
+        if(!slot.used || slot.gen != Gen(handle)) {
+            return nullptr;
+        }
+        return &slot.obj;
+    }
+
+    //遍历所有正在使用的对象
+    template<class F>
+    void ForEach(F&& fn) {
+        for(auto& slab: m_slabs) {
+            for(uint32_t i = 0; i < SLAB_SIZE; i++) {
+                if(slab[i].used) fn(slab[i].obj);
+            }
+        }
+    }
+
+    size_t Size() const { return m_used; }
+
+    size_t Capacity() const { return m_slabs.size() * SLAB_SIZE; }
+
+private:
+    struct Slot {
+        T obj;
+        uint32_t gen = 0;
+        bool used = false;
+    };
+
+    static uint64_t Handle(uint32_t idx, uint32_t gen) { return (static_cast<uint64_t>(gen) << 32) | idx; }
+    static uint32_t Gen(uint64_t handle) { return static_cast<uint32_t>(handle >> 32) & GEN_MASK; }
+
+    Slot& At(uint32_t idx) { return m_slabs[idx / SLAB_SIZE][idx % SLAB_SIZE]; }
+
+    //再分配一组 下标小的先用
+    bool Grow() {
+        uint32_t base = m_slabs.size() * SLAB_SIZE;
+        if(base >= m_max) {
+            return false;
+        }
+        m_slabs.emplace_back(new Slot[SLAB_SIZE]);
+        for(uint32_t i = SLAB_SIZE; i > 0; i--) {
+            m_free.push_back(base + i - 1);
+        }
+        return true;
+    }
+
+    uint32_t m_max;
+    uint32_t m_warmmax;
+    size_t m_used;
+    std::vector<std::unique_ptr<Slot[]>> m_slabs;
+    std::vector<uint32_t> m_free;
+};
+
+
+#endif
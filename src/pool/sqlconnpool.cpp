@@ -1,10 +1,32 @@
 #include "sqlconnpool.hpp"
 #include <mutex>
 #include <mysql/mysql.h>
+#include <vector>
+#include "../metrics/metrics.hpp"
+
+static Histogram* const s_waitTime = Metrics::Instance()->NewHistogram(
+    "webserver_db_conn_wait_seconds", "Time to get a connection from SqlConnPool, including reconnects");
+static Counter* const s_exhausted = Metrics::Instance()->NewCounter(
+    "webserver_db_conn_exhausted_total", "GetConn calls that returned no connection");
+
+//每个用到客户端库的线程第一次调用时初始化 线程退出时清理
+//线程池的工作线程 并行建连的临时线程和探活线程都一样 不需要各自记得配对调用
+static void ThreadInit() {
+    struct ThreadGuard {
+        ThreadGuard() { mysql_thread_init(); }
+        ~ThreadGuard() { mysql_thread_end(); }
+    };
+    static thread_local ThreadGuard guard;
+    (void)guard;
+}
 
 SqlConnPool::SqlConnPool() {
-    m_usecount = 0;
-    m_freecount = 0;
+    m_port = 0;
+    MIN_CONN = MAX_CONN = 0;
+    m_total = 0;
+    m_pinginterval = std::chrono::seconds(30);
+    m_is_close = true;
+    NameLock(m_mtx, "sqlconnpool");
 }
 
 SqlConnPool* SqlConnPool::Instance() {
@@ -14,67 +36,233 @@ SqlConnPool* SqlConnPool::Instance() {
 
 
 void SqlConnPool::Init(const char *host, int port, const char *user, 
-            const char *pwd, const char *dbName, int connSize) {
+            const char *pwd, const char *dbName, int connSize, int maxConnSize, int pingInterval) {
     assert(connSize > 0);
-    for(int i = 0; i < connSize; i++) {
-        MYSQL *sql = nullptr;
-        sql = mysql_init(sql);
-        if(!sql) {
-            LOG_ERROR("MySQL init error!");
-            assert(0);
-        }
-        sql = mysql_real_connect(sql, host, user, pwd, dbName, port, nullptr, 0);
+    assert(pingInterval > 0);
+    m_host = host;
+    m_port = port;
+    m_user = user;
+    m_pwd = pwd;
+    m_dbname = dbName;
+    MIN_CONN = connSize;
+    MAX_CONN = std::max(connSize, maxConnSize);
+    m_pinginterval = std::chrono::seconds(pingInterval);
+    m_is_close = false;
 
-        if(!sql) {
-            LOG_ERROR("MySQL connect error!");
-        }
-        m_conn_que.push(sql);
+    //mysql_real_connect在多线程下调用前需要先初始化库
+    mysql_library_init(0, nullptr, nullptr);
+
+    //并行建立连接 启动时间不再随连接数线性增长
+    std::vector<std::thread> workers;
+    for(int i = 0; i < connSize; i++) {
+        workers.emplace_back([this] {
+            MYSQL* sql = Connect();
+            if(sql) {
+                std::lock_guard<ProfiledMutex> lck(m_mtx);
+                m_conn_que.push_back({sql, std::chrono::steady_clock::now()});
+                m_total++;
+            }
+        });
+    }
+    for(auto& t: workers) {
+        t.join();
     }
-    MAX_CONN = connSize;
-    sem_init(&m_semid, 0, MAX_CONN); //设置信号量
+    if(m_total < connSize) {
+        LOG_WARN("SqlConnPool: only %d/%d connections established", m_total, connSize);
+    }
+    m_health_thread = std::thread(&SqlConnPool::HealthCheck, this);
+
+    Metrics::Instance()->AddCallback("webserver_db_conns_free", "Idle connections in SqlConnPool", Metrics::GAUGE,
+                                     [this] { return static_cast<double>(GetFreeConnCount()); });
+    Metrics::Instance()->AddCallback("webserver_db_conns_open", "Open connections in SqlConnPool, including busy ones",
+                                     Metrics::GAUGE, [this] { return static_cast<double>(GetConnCount()); });
 }
 
-MYSQL* SqlConnPool::GetConn() {
-    MYSQL* sql = nullptr;
-    if(m_conn_que.empty()) {
-        LOG_WARN("SqlConnPool is busy");
+MYSQL* SqlConnPool::Connect() {
+    ThreadInit();
+    MYSQL *sql = mysql_init(nullptr);
+    if(!sql) {
+        LOG_ERROR("MySQL init error!");
         return nullptr;
     }
-    sem_wait(&m_semid);
-    {
-        std::lock_guard<std::mutex> lck(m_mtx);
-        sql = m_conn_que.front();
-        m_conn_que.pop();
+    if(!mysql_real_connect(sql, m_host.c_str(), m_user.c_str(), m_pwd.c_str(),
+                           m_dbname.c_str(), m_port, nullptr, 0)) {
+        LOG_ERROR("MySQL connect error: %s", mysql_error(sql));
+        mysql_close(sql);
+        return nullptr;
     }
     return sql;
 }
 
+MYSQL* SqlConnPool::Revive(MYSQL* sql) {
+    if(mysql_ping(sql) == 0) {
+        return sql;
+    }
+    LOG_WARN("SqlConnPool: connection lost, reconnecting");
+    mysql_close(sql);
+    return Connect();
+}
+
+MYSQL* SqlConnPool::GetConn(int timeoutMS) {
+    ThreadInit(); //拿到连接的线程接着会用它查询
+    auto begin = std::chrono::steady_clock::now();
+    MYSQL* sql = TakeConn(timeoutMS);
+    s_waitTime->RecordSince(begin);
+    if(!sql) {
+        s_exhausted->Inc();
+    }
+    return sql;
+}
+
+MYSQL* SqlConnPool::TakeConn(int timeoutMS) {
+    std::unique_lock<ProfiledMutex> lck(m_mtx);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMS);
+    while(true) {
+        if(m_is_close) {
+            return nullptr;
+        }
+        if(!m_conn_que.empty()) {
+            Conn conn = m_conn_que.back();
+            m_conn_que.pop_back();
+            if(std::chrono::steady_clock::now() - conn.lastused < m_pinginterval) {
+                return conn.sql;
+            }
+            //空闲太久 检查一下再交出去
+            lck.unlock();
+            MYSQL* sql = Revive(conn.sql);
+            lck.lock();
+            if(sql) {
+                return sql;
+            }
+            m_total--;
+            continue;
+        }
+        if(m_total < MAX_CONN) {
+            //弹性扩容 先占位再解锁建连
+            m_total++;
+            lck.unlock();
+            MYSQL* sql = Connect();
+            lck.lock();
+            if(sql) {
+                return sql;
+            }
+            m_total--;
+            return nullptr;
+        }
+        if(timeoutMS <= 0 || m_cond.wait_until(lck, deadline) == std::cv_status::timeout) {
+            if(m_conn_que.empty()) {
+                LOG_WARN("SqlConnPool is busy");
+                return nullptr;
+            }
+        }
+    }
+}
+
 
 void SqlConnPool::FreeConn(MYSQL* sql) {
     assert(sql != nullptr);
-    std::lock_guard<std::mutex> lck(m_mtx);
-    m_conn_que.push(sql);
-    sem_post(&m_semid);
+    {
+        std::lock_guard<ProfiledMutex> lck(m_mtx);
+        if(m_is_close) {
+            mysql_close(sql);
+            m_total--;
+            m_cond.notify_all(); //ClosePool在等所有连接还回来
+            return;
+        }
+        m_conn_que.push_back({sql, std::chrono::steady_clock::now()});
+    }
+    m_cond.notify_one();
+}
+
+void SqlConnPool::HealthCheck() {
+    ThreadInit();
+    std::unique_lock<ProfiledMutex> lck(m_mtx);
+    while(!m_is_close) {
+        m_cond_health.wait_for(lck, m_pinginterval);
+        if(m_is_close) {
+            break;
+        }
+
+        //把空闲超时的连接取出来 在锁外探活 不挡住GetConn
+        auto now = std::chrono::steady_clock::now();
+        std::vector<MYSQL*> stale, extra;
+        while(!m_conn_que.empty() && now - m_conn_que.front().lastused >= m_pinginterval) {
+            if(m_total - static_cast<int>(extra.size()) > MIN_CONN) {
+                extra.push_back(m_conn_que.front().sql); //多于最小连接数的直接回收
+            }else {
+                stale.push_back(m_conn_que.front().sql);
+            }
+            m_conn_que.pop_front();
+        }
+        m_total -= extra.size();
+        int missing = MIN_CONN - m_total;
+        lck.unlock();
+
+        for(auto sql: extra) {
+            mysql_close(sql);
+        }
+        std::vector<MYSQL*> alive;
+        for(auto sql: stale) {
+            if((sql = Revive(sql))) {
+                alive.push_back(sql);
+            }
+        }
+        //之前建连失败的补上
+        for(int i = 0; i < missing; i++) {
+            if(MYSQL* sql = Connect()) {
+                alive.push_back(sql);
+            }
+        }
+
+        lck.lock();
+        m_total += static_cast<int>(alive.size()) - static_cast<int>(stale.size());
+        now = std::chrono::steady_clock::now();
+        for(auto sql: alive) {
+            m_conn_que.push_back({sql, now});
+        }
+        if(!alive.empty()) {
+            m_cond.notify_all();
+        }
+    }
 }
 
 void SqlConnPool::ClosePool() {
-    std::lock_guard<std::mutex> lck(m_mtx);
+    {
+        std::lock_guard<ProfiledMutex> lck(m_mtx);
+        if(m_is_close && !m_health_thread.joinable()) {
+            return;
+        }
+        m_is_close = true;
+    }
+    m_cond_health.notify_all();
+    m_cond.notify_all();
+    if(m_health_thread.joinable()) {
+        m_health_thread.join();
+    }
+    std::unique_lock<ProfiledMutex> lck(m_mtx);
     while(!m_conn_que.empty()) {
-        auto item = m_conn_que.front();
-        m_conn_que.pop();
-        mysql_close(item);
+        mysql_close(m_conn_que.front().sql);
+        m_conn_que.pop_front();
+        m_total--;
+    }
+    //借出去的连接由FreeConn关闭 都还回来之后才能结束客户端库
+    if(!m_cond.wait_for(lck, std::chrono::seconds(CLOSE_WAIT), [this] { return m_total <= 0; })) {
+        LOG_WARN("SqlConnPool: %d connections still in use, client library left initialized", m_total);
+        return;
     }
     mysql_library_end();
 }
 
 int SqlConnPool::GetFreeConnCount() {
-    std::lock_guard<std::mutex> lck(m_mtx);
+    std::lock_guard<ProfiledMutex> lck(m_mtx);
     return m_conn_que.size();
 }
 
+int SqlConnPool::GetConnCount() {
+    std::lock_guard<ProfiledMutex> lck(m_mtx);
+    return m_total;
+}
+
 SqlConnPool::~SqlConnPool() {
     ClosePool();
 }
-
-
-
@@ -2,25 +2,35 @@
 #define __SQLCONNPOOL_HPP
 
 #include <mysql/mysql.h>
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
-#include <queue>
+#include <deque>
 #include <mutex>
+#include <string>
 #include <thread>
-#include <semaphore.h>
 #include "../log/log.hpp"
+#include "../metrics/profiledmutex.hpp"
 
 class SqlConnPool {
 public:
     static SqlConnPool *Instance();  //单例模式
     
-    MYSQL *GetConn();
+    //timeoutMS为0时没有空闲连接且已到上限就直接返回nullptr
+    MYSQL *GetConn(int timeoutMS = 0);
 
     void FreeConn(MYSQL* conn);
 
     int GetFreeConnCount();
 
-    void Init(const char* host, int port, const char* user, const char* pwd, const char* dbName, int connSize);
+    //当前打开的连接数 包括正在使用的
+    int GetConnCount();
 
+    //connSize个连接并行建立 之后按需增长到maxConnSize 空闲超过pingInterval秒的连接会被探活或回收
+    void Init(const char* host, int port, const char* user, const char* pwd, const char* dbName,
+              int connSize, int maxConnSize = 0, int pingInterval = 30);
+
+    //关闭空闲连接 等借出去的连接还回来(最多CLOSE_WAIT秒)后结束客户端库
     void ClosePool();
 
 private:
@@ -28,20 +38,50 @@ private:
     
     ~SqlConnPool();
 
+    static const int CLOSE_WAIT = 5;
+
+    struct Conn {
+        MYSQL* sql;
+        std::chrono::steady_clock::time_point lastused;
+    };
+
+    //GetConn的实际逻辑 GetConn在外面记录等待时间
+    MYSQL* TakeConn(int timeoutMS);
+
+    //建立一条新连接 失败返回nullptr
+    MYSQL* Connect();
+
+    //空闲较久的连接先ping 断开的话重连 都失败返回nullptr
+    MYSQL* Revive(MYSQL* sql);
+
+    //后台线程 定期探活 回收多余的空闲连接 补足最小连接数
+    void HealthCheck();
+
+    std::string m_host, m_user, m_pwd, m_dbname;
+    int m_port;
+
+    int MIN_CONN;
+
     int MAX_CONN;
-    
-    int m_usecount; //正在使用的
 
-    int m_freecount; // 空闲的
+    int m_total; //已打开的连接 包括正在使用的
+
+    std::chrono::seconds m_pinginterval;
+
+    std::deque<Conn> m_conn_que; //空闲连接 尾部是最近用过的
+
+    ProfiledMutex m_mtx;
+
+    ProfiledCondVar m_cond; //等待空闲连接
 
-    std::queue<MYSQL*> m_conn_que;
+    ProfiledCondVar m_cond_health;
 
-    std::mutex m_mtx;
+    std::thread m_health_thread;
 
-    sem_t m_semid;
+    bool m_is_close;
 
 };
 
 
 
-#endif
\ No newline at end of file
+#endif
@@ -9,14 +9,17 @@
 #include <functional>
 #include <cassert>
 #include <utility>
+#include <vector>
+#include "../metrics/allocprofile.hpp"
+#include "../metrics/profiledmutex.hpp"
 
 class ThreadPool {
 public:
     explicit ThreadPool(size_t ThreadCount = 0): m_pool_ptr(std::make_shared<Pool>()) {
         assert(ThreadCount > 0);
         for(size_t i = 0; i < ThreadCount; i++) {
-            std::thread([pool_ptr = m_pool_ptr]{
-                std::unique_lock<std::mutex> lck(pool_ptr->mtx);
+            m_workers.emplace_back([pool_ptr = m_pool_ptr]{
+                std::unique_lock<ProfiledMutex> lck(pool_ptr->mtx);
                 while(true) {
                     if(!pool_ptr->tasks.empty()) {
                         auto task = std::move(pool_ptr->tasks.front());
@@ -25,47 +28,81 @@ public:
                         task();
                         lck.lock();
                     }else if(pool_ptr->is_close) {
-                        break;
+                        break; //关闭时先把队列里的任务做完再退出
                     }else {
                         pool_ptr->cond.wait(lck);
                         //消费者
                     }
 
                 }
-            }).detach(); //分离线程。当一个分离状态的线程结束时，它的资源会自动被释放，无需显式调用 join() 函数
-            //它们可以在后台运行，执行一些独立的任务，而不会阻塞主线程。
+            });
         };
     }
     ThreadPool() = default;
     ThreadPool(ThreadPool&&) = default;
     ~ThreadPool() {
-        if(static_cast<bool>(m_pool_ptr)) {
-            std::lock_guard<std::mutex> lck(m_pool_ptr->mtx);
+        Shutdown();
+    }
+
+    //不再等新任务 执行完队列里剩下的任务后等所有工作线程退出
+    //任务里引用的对象(reactor 用户存储)必须在这之后才能析构
+    void Shutdown() {
+        if(!m_pool_ptr) return;
+        {
+            std::lock_guard<ProfiledMutex> lck(m_pool_ptr->mtx);
             m_pool_ptr->is_close = true;
         }
         m_pool_ptr->cond.notify_all();
+        for(auto& worker: m_workers) {
+            if(worker.joinable()) worker.join();
+        }
+        m_workers.clear();
     }
 
     //添加函数任务
     template<class F>
     void AddTask(F&& task) {
+        AllocScope scope(AT_POOL);
         {
-            std::lock_guard<std::mutex> lck(m_pool_ptr->mtx);
+            std::lock_guard<ProfiledMutex> lck(m_pool_ptr->mtx);
             m_pool_ptr->tasks.emplace(std::forward<F>(task));
         }
         m_pool_ptr->cond.notify_one();
     }
 
+    //队列里已有maxQueue个任务时不再接收 返回false
+    template<class F>
+    bool TryAddTask(F&& task, size_t maxQueue) {
+        AllocScope scope(AT_POOL);
+        {
+            std::lock_guard<ProfiledMutex> lck(m_pool_ptr->mtx);
+            if(m_pool_ptr->tasks.size() >= maxQueue) {
+                return false;
+            }
+            m_pool_ptr->tasks.emplace(std::forward<F>(task));
+        }
+        m_pool_ptr->cond.notify_one();
+        return true;
+    }
+
+    //排队还没开始执行的任务数
+    size_t QueueSize() {
+        std::lock_guard<ProfiledMutex> lck(m_pool_ptr->mtx);
+        return m_pool_ptr->tasks.size();
+    }
 
 
 private:
     struct Pool {
-        std::mutex mtx;
-        std::condition_variable cond;
+        Pool(): is_close(false) { NameLock(mtx, "threadpool"); }
+
+        ProfiledMutex mtx;
+        ProfiledCondVar cond;
         bool is_close;
         std::queue<std::function<void()>> tasks;
     };
     std::shared_ptr<Pool> m_pool_ptr;
+    std::vector<std::thread> m_workers;
 };
 
 
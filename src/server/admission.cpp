@@ -0,0 +1,73 @@
+#include "admission.hpp"
+#include <cassert>
+#include <ctime>
+#include "../log/log.hpp"
+
+Admission::Admission(ThreadPool* pool, size_t maxQueue, int routeLimit)
+    : m_pool(pool), m_maxqueue(maxQueue), m_firstabove(0), m_overuntil(0), m_rejected(0), m_shed(0) {
+    assert(m_pool);
+    for(int i = 0; i < ROUTE_COUNT; i++) {
+        m_limit[i] = routeLimit;
+        m_inflight[i] = 0;
+    }
+}
+
+int64_t Admission::NowUs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void Admission::SetRouteLimit(ROUTE route, int limit) {
+    m_limit[route].store(limit, std::memory_order_relaxed);
+}
+
+bool Admission::Submit(ROUTE route, std::function<void(bool shed)> task) {
+    int64_t now = NowUs();
+    if(Priority(route) == PRIORITY_LOW && Overloaded(now)) {
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if(m_inflight[route].fetch_add(1, std::memory_order_relaxed) >= m_limit[route].load(std::memory_order_relaxed)) {
+        m_inflight[route].fetch_sub(1, std::memory_order_relaxed);
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    bool ok = m_pool->TryAddTask([this, route, now, task = std::move(task)] {
+        int64_t start = NowUs();
+        bool shed = OnDequeue(route, start - now, start);
+        if(shed) {
+            m_shed.fetch_add(1, std::memory_order_relaxed);
+        }
+        task(shed);
+        m_inflight[route].fetch_sub(1, std::memory_order_relaxed);
+    }, m_maxqueue);
+    if(!ok) {
+        m_inflight[route].fetch_sub(1, std::memory_order_relaxed);
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        LOG_WARN_EVERY_MS(1000, "Admission: thread pool queue is full");
+    }
+    return ok;
+}
+
+bool Admission::OnDequeue(ROUTE route, int64_t sojournUs, int64_t now) {
+    if(sojournUs < TARGET_US) {
+        //队列排空过 立刻退出过载状态
+        m_firstabove.store(0, std::memory_order_relaxed);
+        m_overuntil.store(0, std::memory_order_relaxed);
+        return false;
+    }
+    int64_t first = m_firstabove.load(std::memory_order_relaxed);
+    if(first == 0) {
+        m_firstabove.compare_exchange_strong(first, now + INTERVAL_US, std::memory_order_relaxed);
+        return false;
+    }
+    if(now < first) {
+        return false; //还没持续满一个INTERVAL 可能只是突发
+    }
+    if(!Overloaded(now)) {
+        LOG_WARN("Admission: overloaded, queue delay %lld us", (long long)sojournUs);
+    }
+    m_overuntil.store(now + INTERVAL_US, std::memory_order_relaxed);
+    return Priority(route) == PRIORITY_LOW || sojournUs > INTERVAL_US;
+}
@@ -0,0 +1,77 @@
+#ifndef __ADMISSION_HPP
+#define __ADMISSION_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include "../pool/threadpool.hpp"
+
+/*
+线程池前面的准入控制 所有reactor共用一个 任何线程都可以调用
+过载判断参照CoDel: 任务出队时量它在队列里等了多久 连续INTERVAL都高于TARGET才算过载
+只看等待时间不看队列长度 短暂的突发不会触发 持续积压才会
+过载时: 新的低优先级请求直接拒绝 已经排队的低优先级任务出队时丢掉 高优先级任务排队超过INTERVAL也丢掉
+另外每种路由有并发上限(排队+执行中) 线程池队列有总长度上限
+被拒绝或丢掉的请求由reactor立刻回503和Retry-After 不做任何文件和存储操作
+*/
+class Admission {
+public:
+    enum ROUTE {
+        ROUTE_LOGIN,
+        ROUTE_REGISTER,
+        ROUTE_COUNT
+    };
+
+    enum PRIORITY {
+        PRIORITY_LOW,
+        PRIORITY_HIGH
+    };
+
+    //routeLimit为每种路由同时排队加执行的上限 maxQueue为线程池队列长度上限
+    Admission(ThreadPool* pool, size_t maxQueue, int routeLimit);
+    Admission(const Admission&) = delete;
+    Admission& operator=(const Admission&) = delete;
+
+    //把阻塞任务交给线程池 当场被拒绝时返回false 调用者直接回503
+    //task(shed)在线程池里执行 shed为true表示排队期间过载了 任务应该放弃工作直接回503
+    bool Submit(ROUTE route, std::function<void(bool shed)> task);
+
+    void SetRouteLimit(ROUTE route, int limit);
+
+    bool Overloaded() const { return Overloaded(NowUs()); }
+
+    //建议客户端隔多少秒重试
+    int RetryAfter() const { return RETRY_AFTER; }
+
+    uint64_t Rejected() const { return m_rejected.load(std::memory_order_relaxed); }
+    uint64_t Shed() const { return m_shed.load(std::memory_order_relaxed); }
+
+    //登录的是老用户 优先保证 注册可以晚点再来
+    static PRIORITY Priority(ROUTE route) { return route == ROUTE_LOGIN ? PRIORITY_HIGH : PRIORITY_LOW; }
+
+private:
+    static const int64_t TARGET_US = 5000;
+    static const int64_t INTERVAL_US = 100000;
+    static const int RETRY_AFTER = 1;
+
+    static int64_t NowUs();
+
+    bool Overloaded(int64_t now) const { return now < m_overuntil.load(std::memory_order_relaxed); }
+
+    //出队时更新过载状态 返回这个任务是否应该丢掉
+    bool OnDequeue(ROUTE route, int64_t sojournUs, int64_t now);
+
+    ThreadPool* m_pool;
+    size_t m_maxqueue;
+    std::atomic<int> m_limit[ROUTE_COUNT];
+    std::atomic<int> m_inflight[ROUTE_COUNT];
+
+    std::atomic<int64_t> m_firstabove; //等待时间开始高于TARGET的时刻加INTERVAL 0表示低于TARGET
+    std::atomic<int64_t> m_overuntil; //过载状态持续到这个时刻 每次确认过载都往后延一个INTERVAL
+
+    std::atomic<uint64_t> m_rejected;
+    std::atomic<uint64_t> m_shed;
+};
+
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef __EVENTLOOP_HPP
+#define __EVENTLOOP_HPP
+
+#include <cstddef>
+#include <functional>
+#include "../metrics/metrics.hpp"
+
+//一个I/O后端的事件循环 epoll(Reactor)和io_uring(UringReactor)都实现这个接口 由WebServer启动时选择
+class EventLoop {
+public:
+    virtual ~EventLoop() = default;
+
+    virtual bool IsValid() const = 0;
+
+    //事件循环 直到Stop
+    virtual void Loop() = 0;
+
+    //任意线程(包括信号处理函数)都可以调用
+    virtual void Stop() = 0;
+
+    //把任务投递到本循环的线程执行 任意线程可调用
+    virtual void Post(std::function<void()> task) = 0;
+
+    virtual int Id() const = 0;
+
+    virtual size_t ConnCount() const = 0;
+
+protected:
+    //两种后端共用的连接指标
+    static inline Counter* const acceptedTotal = Metrics::Instance()->NewCounter(
+        "webserver_connections_accepted_total", "Connections accepted");
+    static inline Counter* const refusedTotal = Metrics::Instance()->NewCounter(
+        "webserver_connections_refused_total", "Connections closed right after accept because the server was full");
+    static inline Counter* const timeoutTotal = Metrics::Instance()->NewCounter(
+        "webserver_connections_timeout_total", "Connections closed by idle/header/body timeouts");
+};
+
+
+#endif
@@ -0,0 +1,214 @@
+#include "iouring.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+IoUring::IoUring()
+    : m_fd(-1), m_sqhead(nullptr), m_sqtail(nullptr), m_sqmask(nullptr), m_sqarray(nullptr), m_sqentries(0),
+      m_sqpending(0), m_sqes(nullptr), m_cqhead(nullptr), m_cqtail(nullptr), m_cqmask(nullptr), m_cqes(nullptr),
+      m_sqptr(nullptr), m_sqsize(0), m_cqptr(nullptr), m_cqsize(0), m_sqessize(0), m_bufring(nullptr),
+      m_bufringsize(0), m_bufbase(nullptr), m_bufcount(0), m_bufsize(0), m_buftail(0), m_enters(0), m_cqecount(0) {
+}
+
+IoUring::~IoUring() {
+    //关闭ring会取消所有未完成的请求 释放固定文件
+    if(m_fd >= 0) close(m_fd);
+    if(m_bufring) munmap(m_bufring, m_bufringsize);
+    if(m_bufbase) munmap(m_bufbase, static_cast<size_t>(m_bufcount) * m_bufsize);
+    if(m_sqes) munmap(m_sqes, m_sqessize);
+    if(m_cqptr && m_cqptr != m_sqptr) munmap(m_cqptr, m_cqsize);
+    if(m_sqptr) munmap(m_sqptr, m_sqsize);
+}
+
+bool IoUring::Init(unsigned entries) {
+    io_uring_params params;
+    //COOP_TASKRUN: 完成事件在下次进入内核时处理 不用IPI打断reactor线程
+    const unsigned tryFlags[] = {IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_CQSIZE,
+                                 IORING_SETUP_CQSIZE};
+    for(unsigned flags: tryFlags) {
+        memset(&params, 0, sizeof(params));
+        params.flags = flags;
+        params.cq_entries = entries * 4;
+        m_fd = syscall(__NR_io_uring_setup, entries, &params);
+        if(m_fd >= 0 || errno != EINVAL) break;
+    }
+    if(m_fd < 0) {
+        return false;
+    }
+
+    m_sqsize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqsize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single) {
+        m_sqsize = m_cqsize = std::max(m_sqsize, m_cqsize);
+    }
+    m_sqptr = mmap(nullptr, m_sqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if(m_sqptr == MAP_FAILED) {
+        m_sqptr = nullptr;
+        return false;
+    }
+    m_cqptr = single ? m_sqptr
+                     : mmap(nullptr, m_cqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+    if(m_cqptr == MAP_FAILED) {
+        m_cqptr = nullptr;
+        return false;
+    }
+    m_sqessize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqessize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED) {
+        return false;
+    }
+    m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(m_sqptr);
+    m_sqhead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    m_sqtail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sqmask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sqarray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    m_sqentries = params.sq_entries;
+    //SQ数组和SQE一一对应 之后不用再填
+    for(unsigned i = 0; i < m_sqentries; i++) {
+        m_sqarray[i] = i;
+    }
+
+    char* cq = static_cast<char*>(m_cqptr);
+    m_cqhead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cqtail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cqmask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+unsigned IoUring::SqSpace() const {
+    unsigned head = __atomic_load_n(m_sqhead, __ATOMIC_ACQUIRE);
+    return m_sqentries - (*m_sqtail + m_sqpending - head);
+}
+
+void IoUring::StashCqes() {
+    unsigned head = *m_cqhead;
+    unsigned tail = __atomic_load_n(m_cqtail, __ATOMIC_ACQUIRE);
+    for(; head != tail; head++) {
+        m_backlog.push_back(m_cqes[head & *m_cqmask]);
+    }
+    __atomic_store_n(m_cqhead, head, __ATOMIC_RELEASE);
+}
+
+bool IoUring::Reserve(unsigned n) {
+    //提交一次一般就够了 内核因为CQ溢出不收时挪走CQE再试
+    for(int i = 0; i < 3 && SqSpace() < n; i++) {
+        int ret = Submit();
+        if(ret == -EBUSY || ret == -EAGAIN) {
+            StashCqes();
+        }
+    }
+    return SqSpace() >= n;
+}
+
+io_uring_sqe* IoUring::GetSqe() {
+    if(!Reserve(1)) {
+        return nullptr;
+    }
+    unsigned tail = *m_sqtail + m_sqpending;
+    io_uring_sqe* sqe = &m_sqes[tail & *m_sqmask];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sqpending++;
+    return sqe;
+}
+
+int IoUring::Submit(unsigned waitNr, int timeoutMS) {
+    if(m_sqpending) {
+        __atomic_store_n(m_sqtail, *m_sqtail + m_sqpending, __ATOMIC_RELEASE);
+        m_sqpending = 0;
+    }
+    //上次被拒绝(EBUSY)或只提交了一部分的SQE还留在环里 一起提交
+    const unsigned toSubmit = *m_sqtail - __atomic_load_n(m_sqhead, __ATOMIC_ACQUIRE);
+    if(toSubmit == 0 && waitNr == 0) {
+        return 0;
+    }
+    unsigned flags = waitNr ? IORING_ENTER_GETEVENTS : 0;
+    const void* arg = nullptr;
+    size_t argSize = 0;
+    __kernel_timespec ts;
+    io_uring_getevents_arg ext;
+    if(waitNr && timeoutMS >= 0) {
+        ts.tv_sec = timeoutMS / 1000;
+        ts.tv_nsec = (timeoutMS % 1000) * 1000000LL;
+        memset(&ext, 0, sizeof(ext));
+        ext.ts = reinterpret_cast<uint64_t>(&ts);
+        flags |= IORING_ENTER_EXT_ARG;
+        arg = &ext;
+        argSize = sizeof(ext);
+    }
+    m_enters++;
+    int ret = syscall(__NR_io_uring_enter, m_fd, toSubmit, waitNr, flags, arg, argSize);
+    return ret < 0 ? -errno : ret;
+}
+
+int IoUring::Register(unsigned opcode, const void* arg, unsigned nrArgs) {
+    int ret = syscall(__NR_io_uring_register, m_fd, opcode, arg, nrArgs);
+    return ret < 0 ? -errno : ret;
+}
+
+int IoUring::RegisterFilesSparse(unsigned nr) {
+    io_uring_rsrc_register reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.nr = nr;
+    reg.flags = IORING_RSRC_REGISTER_SPARSE;
+    return Register(IORING_REGISTER_FILES2, &reg, sizeof(reg));
+}
+
+int IoUring::UnregisterFile(unsigned slot) {
+    int fd = -1;
+    io_uring_files_update update;
+    memset(&update, 0, sizeof(update));
+    update.offset = slot;
+    update.fds = reinterpret_cast<uint64_t>(&fd);
+    return Register(IORING_REGISTER_FILES_UPDATE, &update, 1);
+}
+
+bool IoUring::SetupBufRing(uint16_t bgid, unsigned count, unsigned bufSize) {
+    m_bufringsize = count * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, m_bufringsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ring == MAP_FAILED) {
+        return false;
+    }
+    void* base = mmap(nullptr, static_cast<size_t>(count) * bufSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(base == MAP_FAILED) {
+        munmap(ring, m_bufringsize);
+        return false;
+    }
+    m_bufring = static_cast<io_uring_buf_ring*>(ring);
+    m_bufbase = static_cast<char*>(base);
+    m_bufcount = count;
+    m_bufsize = bufSize;
+
+    //先把所有缓冲区放进环里再注册
+    for(unsigned i = 0; i < count; i++) {
+        io_uring_buf& buf = BufEntry(i);
+        buf.addr = reinterpret_cast<uint64_t>(BufAddr(i));
+        buf.len = bufSize;
+        buf.bid = i;
+    }
+    m_buftail = count;
+    __atomic_store_n(&m_bufring->tail, m_buftail, __ATOMIC_RELEASE);
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(m_bufring);
+    reg.ring_entries = count;
+    reg.bgid = bgid;
+    return Register(IORING_REGISTER_PBUF_RING, &reg, 1) >= 0;
+}
+
+void IoUring::RecycleBuf(uint16_t bid) {
+    io_uring_buf& buf = BufEntry(m_buftail & (m_bufcount - 1));
+    buf.addr = reinterpret_cast<uint64_t>(BufAddr(bid));
+    buf.len = m_bufsize;
+    buf.bid = bid;
+    m_buftail++;
+    __atomic_store_n(&m_bufring->tail, m_buftail, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,132 @@
+#ifndef __IOURING_HPP
+#define __IOURING_HPP
+
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <vector>
+
+//linux/fs.h带进来的宏 会和ChainBuffer::BLOCK_SIZE冲突
+#undef BLOCK_SIZE
+
+/*
+直接用系统调用的io_uring封装(不依赖liburing) 只在一个线程里使用
+SQ/CQ通过mmap共享 提交时一次io_uring_enter同时提交并等待完成
+另外管理一个provided buffer ring: 多次recv由内核自己从环里挑缓冲区 用完后归还
+*/
+class IoUring {
+public:
+    IoUring();
+    ~IoUring();
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    //entries为SQ大小 CQ为它的4倍 内核不支持的setup标志会自动去掉重试
+    bool Init(unsigned entries);
+
+    bool IsValid() const { return m_fd >= 0; }
+
+    //取一个清零的SQE SQ满了会先提交 提交后还是满的(内核暂时不收)返回nullptr
+    io_uring_sqe* GetSqe();
+
+    //保证接下来能连续取n个SQE 链接在一起的请求要先保证都放得下 做不到返回false
+    bool Reserve(unsigned n);
+
+    //提交所有填好的SQE 并等待至少waitNr个完成 timeoutMS小于0时一直等 返回负的errno表示失败
+    int Submit(unsigned waitNr = 0, int timeoutMS = -1);
+
+    //依次处理已完成的CQE(先处理之前挪出来的) 返回处理的个数
+    template<class F>
+    unsigned ForEachCqe(F&& func) {
+        unsigned cnt = 0;
+        if(!m_backlog.empty()) {
+            std::vector<io_uring_cqe> backlog;
+            backlog.swap(m_backlog);
+            for(auto& cqe: backlog) {
+                func(cqe);
+                cnt++;
+            }
+        }
+        while(true) {
+            //回调里的GetSqe可能把CQ挪空 每次都重新读head
+            unsigned head = *m_cqhead;
+            if(head == __atomic_load_n(m_cqtail, __ATOMIC_ACQUIRE)) break;
+            //先拷贝出来再推进head 回调里可能继续GetSqe
+            io_uring_cqe cqe = m_cqes[head & *m_cqmask];
+            __atomic_store_n(m_cqhead, head + 1, __ATOMIC_RELEASE);
+            func(cqe);
+            cnt++;
+        }
+        m_cqecount += cnt;
+        return cnt;
+    }
+
+    //有挪出来还没处理的CQE时不能在Submit里等
+    bool HasBacklog() const { return !m_backlog.empty(); }
+
+    //注册nr个空的固定文件槽位 accept时由内核分配
+    int RegisterFilesSparse(unsigned nr);
+
+    //同步清空一个固定文件槽位 拿不到SQE发IORING_OP_CLOSE时用
+    int UnregisterFile(unsigned slot);
+
+    //注册一个provided buffer ring count必须是2的幂
+    bool SetupBufRing(uint16_t bgid, unsigned count, unsigned bufSize);
+
+    char* BufAddr(uint16_t bid) const { return m_bufbase + static_cast<size_t>(bid) * m_bufsize; }
+    unsigned BufSize() const { return m_bufsize; }
+
+    //用完的缓冲区还给内核
+    void RecycleBuf(uint16_t bid);
+
+    //io_uring_enter调用次数和处理过的CQE数 用来和epoll比较系统调用次数
+    uint64_t Enters() const { return m_enters; }
+    uint64_t Cqes() const { return m_cqecount; }
+
+private:
+    //C++下头文件里的__DECLARE_FLEX_ARRAY会让bufs偏移8字节 直接按数组访问 tail和第0项的resv重叠
+    io_uring_buf& BufEntry(unsigned idx) { return reinterpret_cast<io_uring_buf*>(m_bufring)[idx]; }
+
+    int Register(unsigned opcode, const void* arg, unsigned nrArgs);
+
+    //SQ里还能放的SQE数
+    unsigned SqSpace() const;
+
+    //CQ满时内核拒绝提交(EBUSY) 把CQE挪到m_backlog腾出地方 下次ForEachCqe再处理
+    void StashCqes();
+
+    int m_fd;
+
+    unsigned* m_sqhead;
+    unsigned* m_sqtail;
+    unsigned* m_sqmask;
+    unsigned* m_sqarray;
+    unsigned m_sqentries;
+    unsigned m_sqpending; //已经填好还没提交的SQE
+    io_uring_sqe* m_sqes;
+
+    unsigned* m_cqhead;
+    unsigned* m_cqtail;
+    unsigned* m_cqmask;
+    io_uring_cqe* m_cqes;
+    std::vector<io_uring_cqe> m_backlog;
+
+    void* m_sqptr;
+    size_t m_sqsize;
+    void* m_cqptr;
+    size_t m_cqsize;
+    size_t m_sqessize;
+
+    io_uring_buf_ring* m_bufring;
+    size_t m_bufringsize;
+    char* m_bufbase;
+    unsigned m_bufcount;
+    unsigned m_bufsize;
+    uint16_t m_buftail;
+
+    uint64_t m_enters;
+    uint64_t m_cqecount;
+};
+
+
+#endif
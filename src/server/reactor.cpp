@@ -0,0 +1,326 @@
+#include "reactor.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+Reactor::Reactor(int id, int listenFd, bool exclusive, Admission* admission, const SocketProfile& profile)
+    : m_id(id), m_epfd(-1), m_wakefd(-1), m_listenfd(listenFd), m_idlefd(-1), m_exclusive(exclusive),
+      m_acceptpending(false), m_admission(admission), m_profile(profile), m_stop(false), m_conncount(0), m_conns(HttpConn::MAX_CONN),
+      m_events(MAX_EVENTS) {
+    m_epfd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_idlefd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if(m_epfd < 0 || m_wakefd < 0) {
+        LOG_ERROR("Reactor[%d] create epoll/eventfd error!", m_id);
+        return;
+    }
+    epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.u64 = WAKE_KEY;
+    epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_wakefd, &ev);
+
+    //独占监听socket用边缘触发 共享的用水平触发加EPOLLEXCLUSIVE 每次只唤醒一个reactor
+    ev.events = m_exclusive ? (EPOLLIN | EPOLLEXCLUSIVE) : (EPOLLIN | EPOLLET);
+    ev.data.u64 = LISTEN_KEY;
+    if(epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_listenfd, &ev) < 0) {
+        LOG_ERROR("Reactor[%d] add listen fd error: %d", m_id, errno);
+    }
+}
+
+Reactor::~Reactor() {
+    m_conns.ForEach([](HttpConn& conn) { conn.Close(); });
+    if(!m_exclusive && m_listenfd >= 0) close(m_listenfd);
+    if(m_idlefd >= 0) close(m_idlefd);
+    if(m_wakefd >= 0) close(m_wakefd);
+    if(m_epfd >= 0) close(m_epfd);
+}
+
+void Reactor::Loop() {
+    LOG_INFO("Reactor[%d] start, listen fd %d, %s", m_id, m_listenfd, m_exclusive ? "exclusive" : "reuseport");
+    while(!m_stop.load(std::memory_order_acquire)) {
+        int timeout = m_timers.NextTimeoutMS();
+        if(m_acceptpending) {
+            timeout = 0;
+        }else if(!m_throttled.empty() && (timeout < 0 || timeout > RETRY_MS)) {
+            timeout = RETRY_MS;
+        }
+        int n = epoll_wait(m_epfd, m_events.data(), MAX_EVENTS, timeout);
+        if(n < 0 && errno != EINTR) {
+            LOG_ERROR("Reactor[%d] epoll_wait error: %d", m_id, errno);
+            break;
+        }
+        for(int i = 0; i < n; i++) {
+            uint64_t key = m_events[i].data.u64;
+            if(key == LISTEN_KEY) {
+                HandleListen();
+            }else if(key == WAKE_KEY) {
+                HandleWakeup();
+            }else {
+                HandleConn(key, m_events[i].events);
+            }
+        }
+        if(m_acceptpending) {
+            HandleListen();
+        }
+        if(!m_throttled.empty()) {
+            RetryThrottled();
+        }
+        //到期的连接一个槽一批处理 空闲连接平时不产生任何开销
+        m_timers.Advance([this](TimerNode* node) {
+            HttpConn* conn = static_cast<HttpConn*>(node->data);
+            LOG_DEBUG("Client[%d] timeout", conn->GetFd());
+            timeoutTotal->Inc();
+            CloseConn(conn);
+        });
+    }
+    LOG_INFO("Reactor[%d] quit", m_id);
+}
+
+void Reactor::Stop() {
+    m_stop.store(true, std::memory_order_release);
+    uint64_t one = 1;
+    ssize_t ret = write(m_wakefd, &one, sizeof(one));
+    (void)ret;
+}
+
+void Reactor::Post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        m_tasks.push_back(std::move(task));
+    }
+    uint64_t one = 1;
+    ssize_t ret = write(m_wakefd, &one, sizeof(one));
+    (void)ret;
+}
+
+void Reactor::HandleWakeup() {
+    uint64_t cnt;
+    ssize_t ret = read(m_wakefd, &cnt, sizeof(cnt));
+    (void)ret;
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        tasks.swap(m_tasks);
+    }
+    for(auto& task: tasks) {
+        task();
+    }
+}
+
+void Reactor::HandleListen() {
+    m_acceptpending = false;
+    for(int i = 0; i < ACCEPT_BATCH; i++) {
+        sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        int fd = accept4(m_listenfd, (sockaddr*)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            if(errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if((errno == EMFILE || errno == ENFILE) && m_idlefd >= 0) {
+                //fd用完了 腾出备用fd把这个连接接下来直接关掉 否则边缘触发下它会一直卡在队列里
+                close(m_idlefd);
+                fd = accept4(m_listenfd, nullptr, nullptr, SOCK_CLOEXEC);
+                if(fd >= 0) close(fd);
+                m_idlefd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                LOG_WARN_EVERY_MS(1000, "Reactor[%d] out of fds!", m_id);
+                continue;
+            }
+            LOG_ERROR_EVERY_MS(1000, "Reactor[%d] accept error: %d", m_id, errno);
+            return;
+        }
+        if(HttpConn::userCount >= HttpConn::MAX_CONN) {
+            static const char info[] = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\n"
+                                       "Content-length: 0\r\nConnection: close\r\n\r\n";
+            ssize_t ret = send(fd, info, sizeof(info) - 1, MSG_NOSIGNAL);
+            (void)ret;
+            close(fd);
+            refusedTotal->Inc();
+            LOG_WARN_EVERY_MS(1000, "Clients is full!");
+            continue;
+        }
+        acceptedTotal->Inc();
+        AddConn(fd, addr);
+    }
+    //这一批没取完 边缘触发不会再通知 下一轮接着取
+    m_acceptpending = !m_exclusive;
+}
+
+void Reactor::AddConn(int fd, const sockaddr_in& addr) {
+    uint64_t key;
+    HttpConn* conn = m_conns.Acquire(&key);
+    if(!conn) {
+        close(fd);
+        LOG_WARN_EVERY_MS(1000, "Reactor[%d] connection pool is full!", m_id);
+        return;
+    }
+    conn->Init(fd, addr, key);
+    m_conncount.fetch_add(1, std::memory_order_relaxed);
+    epoll_event ev = {0};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+    ev.data.u64 = key;
+    if(epoll_ctl(m_epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        LOG_ERROR("Reactor[%d] add conn %d error: %d", m_id, fd, errno);
+        CloseConn(conn);
+        return;
+    }
+    Touch(conn);
+}
+
+//对象回到池里但内存还在 调用栈上层持有的指针看到的是IsClosed accept不会在连接事件的调用栈里发生 所以不会被中途复用
+void Reactor::CloseConn(HttpConn* conn) {
+    if(conn->IsClosed()) return;
+    epoll_ctl(m_epfd, EPOLL_CTL_DEL, conn->GetFd(), nullptr);
+    m_timers.Cancel(&conn->Timer());
+    conn->Close();
+    m_conns.Recycle(conn->GetId());
+    m_conncount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+HttpConn* Reactor::FindConn(uint64_t key) {
+    HttpConn* conn = m_conns.Find(key);
+    return conn && !conn->IsClosed() ? conn : nullptr;
+}
+
+void Reactor::HandleConn(uint64_t key, uint32_t events) {
+    HttpConn* conn = FindConn(key);
+    if(!conn) return; //同一批里已经关闭的连接 fd可能已经被新连接复用
+    if(events & (EPOLLHUP | EPOLLERR)) {
+        CloseConn(conn);
+        return;
+    }
+    if(events & EPOLLIN) {
+        if(!OnRead(conn)) return;
+    }
+    if((events & EPOLLOUT) && conn->ToWriteBytes() > 0) {
+        if(Flush(conn)) {
+            Serve(conn);
+        }
+    }
+    Touch(conn);
+}
+
+bool Reactor::OnRead(HttpConn* conn) {
+    int readErrno = 0;
+    ssize_t ret = conn->Read(&readErrno);
+    if(ret < 0 && readErrno == ENOBUFS) {
+        //超出内存预算或单个连接的上限 先把已有数据处理掉 稍后再读
+        m_throttled.push_back(conn->GetId());
+    }else if(ret < 0 && readErrno != EAGAIN && readErrno != EWOULDBLOCK) {
+        CloseConn(conn);
+        return false;
+    }
+    bool peerClosed = (ret == 0);
+    Serve(conn);
+    if(peerClosed && !conn->IsClosed() && !conn->IsBusy() && conn->ToWriteBytes() == 0) {
+        CloseConn(conn);
+        return false;
+    }
+    return !conn->IsClosed();
+}
+
+void Reactor::Serve(HttpConn* conn) {
+    while(!conn->IsClosed() && !conn->IsBusy() && conn->ToWriteBytes() == 0) {
+        if(!conn->Process()) {
+            if(conn->NeedsVerify()) {
+                DispatchVerify(conn);
+            }
+            return;
+        }
+        if(!Flush(conn)) {
+            return;
+        }
+    }
+}
+
+bool Reactor::Flush(HttpConn* conn) {
+    int writeErrno = 0;
+    conn->Write(&writeErrno);
+    if(conn->ToWriteBytes() > 0) {
+        if(writeErrno != EAGAIN && writeErrno != EWOULDBLOCK) {
+            CloseConn(conn);
+            return false;
+        }
+        if(m_profile.cork && !conn->IsCorked()) {
+            SocketProfile::SetCork(conn->GetFd(), true);
+            conn->SetCorked(true);
+        }
+        return false; //等EPOLLOUT
+    }
+    if(conn->IsCorked()) {
+        SocketProfile::SetCork(conn->GetFd(), false);
+        conn->SetCorked(false);
+    }
+    bool keepAlive = conn->IsKeepAlive();
+    conn->ResetForNext();
+    if(!keepAlive) {
+        CloseConn(conn);
+        return false;
+    }
+    return true;
+}
+
+void Reactor::DispatchVerify(HttpConn* conn) {
+    const HttpRequest& request = conn->Request();
+    if(!m_admission) {
+        conn->FinishVerify(HttpRequest::UserVerify(request.GetPost("username"), request.GetPost("password"),
+                                                   request.IsLogin()));
+        conn->Respond();
+        if(Flush(conn)) Serve(conn);
+        return;
+    }
+    //线程池里只碰拷贝出来的参数 连接可能在此期间被关闭 回来时用句柄确认还是同一个连接
+    uint64_t key = conn->GetId();
+    Admission::ROUTE route = request.IsLogin() ? Admission::ROUTE_LOGIN : Admission::ROUTE_REGISTER;
+    bool admitted = m_admission->Submit(route, [this, key, name = request.GetPost("username"),
+                                                pwd = request.GetPost("password"), islogin = request.IsLogin()](bool shed) {
+        bool ok = !shed && HttpRequest::UserVerify(name, pwd, islogin);
+        Post([this, key, ok, shed] {
+            HttpConn* conn = FindConn(key);
+            if(!conn) return;
+            conn->SetBusy(false);
+            if(shed) {
+                conn->Reject(m_admission->RetryAfter());
+            }else {
+                conn->FinishVerify(ok);
+                conn->Respond();
+            }
+            if(Flush(conn)) Serve(conn);
+            Touch(conn);
+        });
+    });
+    if(!admitted) {
+        conn->Reject(m_admission->RetryAfter());
+        if(Flush(conn)) Serve(conn);
+        return;
+    }
+    conn->SetBusy(true);
+}
+
+void Reactor::RetryThrottled() {
+    std::vector<uint64_t> throttled;
+    throttled.swap(m_throttled);
+    for(uint64_t key: throttled) {
+        HttpConn* conn = FindConn(key);
+        if(conn && OnRead(conn)) {
+            Touch(conn);
+        }
+    }
+}
+
+void Reactor::Touch(HttpConn* conn) {
+    uint32_t timeoutMS = 0;
+    if(conn->IsClosed() || !conn->NextDeadline(&timeoutMS)) {
+        return;
+    }
+    if(timeoutMS > 0) {
+        m_timers.Schedule(&conn->Timer(), timeoutMS);
+    }else {
+        m_timers.Cancel(&conn->Timer());
+    }
+}
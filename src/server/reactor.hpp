@@ -0,0 +1,106 @@
+#ifndef __REACTOR_HPP
+#define __REACTOR_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sys/epoll.h>
+#include <vector>
+#include "eventloop.hpp"
+#include "../http/httpconn.hpp"
+#include "../pool/connpool.hpp"
+#include "admission.hpp"
+#include "socketprofile.hpp"
+
+/*
+一个epoll事件循环 跑在自己的线程里 拥有自己的连接 连接之间不共享任何锁
+REUSEPORT模式下每个reactor有自己的监听socket 内核按四元组哈希分发连接
+EXCLUSIVE模式下所有reactor共用一个监听socket 用EPOLLEXCLUSIVE避免惊群
+连接注册一次EPOLLIN|EPOLLOUT|EPOLLET 之后不再epoll_ctl修改
+连接对象从池里取 epoll_data里放的是带代数的句柄而不是fd 关闭后才到的旧事件会被丢掉
+线程池只用来跑会阻塞的处理(查用户存储) 经过准入控制 结果通过eventfd投递回本reactor
+*/
+class Reactor : public EventLoop {
+public:
+    //listenFd由调用者创建 REUSEPORT模式下归reactor所有 析构时关闭
+    //admission为空时阻塞处理直接在reactor线程里做
+    //profile里连接级的选项已经设在监听socket上由accept继承 这里只管cork
+    Reactor(int id, int listenFd, bool exclusive, Admission* admission, const SocketProfile& profile);
+    ~Reactor() override;
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    bool IsValid() const override { return m_epfd >= 0 && m_wakefd >= 0; }
+
+    void Loop() override;
+
+    void Stop() override;
+
+    void Post(std::function<void()> task) override;
+
+    int Id() const override { return m_id; }
+
+    size_t ConnCount() const override { return m_conncount.load(std::memory_order_relaxed); }
+
+private:
+    static const int MAX_EVENTS = 1024;
+    static const int ACCEPT_BATCH = 64; //一轮最多accept这么多个 剩下的下一轮再取 避免饿死已有连接
+    static const int RETRY_MS = 5; //超出内存预算的连接隔这么久重试读
+    //监听socket和eventfd在epoll_data里的标记 连接句柄不超过56位 不会和它们冲突
+    static const uint64_t LISTEN_KEY = ~0ull;
+    static const uint64_t WAKE_KEY = ~0ull - 1;
+
+    void HandleListen();
+    void HandleWakeup();
+    void HandleConn(uint64_t key, uint32_t events);
+
+    void AddConn(int fd, const sockaddr_in& addr);
+    void CloseConn(HttpConn* conn);
+    //连接已关闭或槽位已被复用时返回nullptr
+    HttpConn* FindConn(uint64_t key);
+
+    //读到EAGAIN 返回false表示连接已关闭
+    bool OnRead(HttpConn* conn);
+
+    //把读到的请求一个个处理完 遇到写不完/要等线程池/没有完整请求时返回
+    void Serve(HttpConn* conn);
+
+    //写出响应 写完且保持连接时返回true
+    //一次写不完时按profile打开cork 剩下的部分攒成整段再发 写完时拔掉把尾巴推出去
+    bool Flush(HttpConn* conn);
+
+    //把阻塞的验证交给线程池 完成后回到本线程继续 过载时直接回503
+    void DispatchVerify(HttpConn* conn);
+
+    void RetryThrottled();
+
+    //处理完连接上的事件后按所处阶段重新设定超时
+    void Touch(HttpConn* conn);
+
+    int m_id;
+    int m_epfd;
+    int m_wakefd;
+    int m_listenfd;
+    int m_idlefd; //fd耗尽时腾出来接受并立刻关闭新连接
+    bool m_exclusive;
+    bool m_acceptpending;
+    Admission* m_admission;
+    SocketProfile m_profile;
+
+    std::atomic<bool> m_stop;
+    std::atomic<size_t> m_conncount;
+
+    TimerWheel m_timers;
+
+    ConnPool<HttpConn> m_conns;
+    std::vector<uint64_t> m_throttled; //读缓冲超预算或到了单连接上限 暂停读的连接
+    std::vector<epoll_event> m_events;
+
+    std::mutex m_mtx;
+    std::vector<std::function<void()>> m_tasks;
+};
+
+
+#endif
@@ -0,0 +1,89 @@
+#include "socketprofile.hpp"
+#include <cstdlib>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "../log/log.hpp"
+
+static void SetOpt(int fd, int level, int name, int value, const char* what) {
+    if(setsockopt(fd, level, name, &value, sizeof(value)) < 0) {
+        LOG_WARN("setsockopt %s=%d on fd %d error: %d", what, value, fd, errno);
+    }
+}
+
+bool SocketProfile::Parse(const std::string& spec, SocketProfile* profile) {
+    SocketProfile p;
+    size_t pos = 0;
+    bool first = true;
+    while(pos <= spec.size()) {
+        size_t comma = spec.find(',', pos);
+        if(comma == std::string::npos) comma = spec.size();
+        std::string item = spec.substr(pos, comma - pos);
+        pos = comma + 1;
+        if(first) {
+            first = false;
+            if(item == "latency" || item == "throughput") {
+                p.nodelay = true;
+                p.deferAccept = 1;
+                p.fastOpen = 256;
+                p.cork = (item == "throughput");
+                continue;
+            }
+            if(item == "default" || item.empty()) {
+                continue;
+            }
+        }
+        size_t eq = item.find('=');
+        if(eq == std::string::npos) {
+            return false;
+        }
+        std::string key = item.substr(0, eq);
+        char* end = nullptr;
+        long value = strtol(item.c_str() + eq + 1, &end, 10);
+        if(*end != '\0' || value < 0) {
+            return false;
+        }
+        if(key == "nodelay") p.nodelay = value != 0;
+        else if(key == "cork") p.cork = value != 0;
+        else if(key == "deferaccept") p.deferAccept = value;
+        else if(key == "fastopen") p.fastOpen = value;
+        else if(key == "sndbuf") p.sndbuf = value;
+        else if(key == "rcvbuf") p.rcvbuf = value;
+        else return false;
+    }
+    *profile = p;
+    return true;
+}
+
+void SocketProfile::ApplyListen(int fd) const {
+    //缓冲区大小要在listen之前设 窗口缩放因子是握手时定的
+    ApplyConn(fd);
+    if(deferAccept > 0) {
+        SetOpt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, deferAccept, "TCP_DEFER_ACCEPT");
+    }
+    if(fastOpen > 0) {
+        SetOpt(fd, IPPROTO_TCP, TCP_FASTOPEN, fastOpen, "TCP_FASTOPEN");
+    }
+}
+
+void SocketProfile::ApplyConn(int fd) const {
+    if(nodelay) {
+        SetOpt(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+    }
+    if(sndbuf > 0) {
+        SetOpt(fd, SOL_SOCKET, SO_SNDBUF, sndbuf, "SO_SNDBUF");
+    }
+    if(rcvbuf > 0) {
+        SetOpt(fd, SOL_SOCKET, SO_RCVBUF, rcvbuf, "SO_RCVBUF");
+    }
+}
+
+void SocketProfile::SetCork(int fd, bool on) {
+    SetOpt(fd, IPPROTO_TCP, TCP_CORK, on ? 1 : 0, "TCP_CORK");
+}
+
+std::string SocketProfile::ToString() const {
+    return "nodelay=" + std::to_string(nodelay) + ",cork=" + std::to_string(cork)
+           + ",deferaccept=" + std::to_string(deferAccept) + ",fastopen=" + std::to_string(fastOpen)
+           + ",sndbuf=" + std::to_string(sndbuf) + ",rcvbuf=" + std::to_string(rcvbuf);
+}
@@ -0,0 +1,37 @@
+#ifndef __SOCKETPROFILE_HPP
+#define __SOCKETPROFILE_HPP
+
+#include <string>
+
+/*
+一组socket选项 按名字选一套 再用key=value覆盖单项 比如"throughput,sndbuf=262144"
+default: 只开TCP_NODELAY 小响应和流水线上的后续响应不等ACK(否则撞上Nagle加对端延迟ACK 一次卡40ms) 其余用内核默认值
+         nodelay=0回到全用内核默认值
+latency: 在default基础上开Fast Open和DEFER_ACCEPT
+throughput: 在latency基础上一个响应要分多次写时用TCP_CORK攒满整段再发
+nodelay和收发缓冲区设在监听socket上 accept出来的连接直接继承 每个连接不用再调setsockopt
+*/
+struct SocketProfile {
+    bool nodelay = true;
+    bool cork = false;
+    int deferAccept = 0; //秒 连接上有数据了才让accept返回
+    int fastOpen = 0; //TFO队列长度 0为关闭
+    int sndbuf = 0; //0为内核自动调整
+    int rcvbuf = 0;
+
+    //解析失败返回false
+    static bool Parse(const std::string& spec, SocketProfile* profile);
+
+    //在bind/listen之前对监听socket调用 失败的选项记日志后忽略
+    void ApplyListen(int fd) const;
+
+    //对单个连接设置(不是从监听socket继承来的时候用)
+    void ApplyConn(int fd) const;
+
+    static void SetCork(int fd, bool on);
+
+    std::string ToString() const;
+};
+
+
+#endif
@@ -0,0 +1,595 @@
+#include "uringreactor.hpp"
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "../buffer/bufferpool.hpp"
+
+UringReactor::UringReactor(int id, int listenFd, bool shared, Admission* admission)
+    : m_id(id), m_listenfd(listenFd), m_shared(shared), m_valid(false), m_acceptarmed(false),
+      m_acceptretry(false), m_acceptpaused(false), m_acceptresume(0), m_wakearmed(false), m_wakefd(-1),
+      m_wakeval(0), m_admission(admission), m_slots(0), m_stop(false), m_conncount(0), m_conns(HttpConn::MAX_CONN) {
+    m_wakefd = eventfd(0, EFD_CLOEXEC);
+    if(m_wakefd < 0 || !m_ring.Init(RING_ENTRIES)) {
+        LOG_ERROR("UringReactor[%d] io_uring setup error: %d", m_id, errno);
+        return;
+    }
+    //固定文件槽位数受RLIMIT_NOFILE限制
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    m_slots = std::min<rlim_t>(limit.rlim_cur, HttpConn::MAX_CONN);
+    int ret = m_ring.RegisterFilesSparse(m_slots);
+    if(ret < 0) {
+        LOG_ERROR("UringReactor[%d] register files error: %d", m_id, -ret);
+        return;
+    }
+    if(!m_ring.SetupBufRing(BUF_GROUP, BUF_COUNT, BUF_SIZE)) {
+        LOG_ERROR("UringReactor[%d] register buffer ring error: %d", m_id, errno);
+        return;
+    }
+    m_valid = true;
+}
+
+UringReactor::~UringReactor() {
+    m_conns.ForEach([](Conn& conn) { conn.http.Close(); });
+    if(!m_shared && m_listenfd >= 0) close(m_listenfd);
+    if(m_wakefd >= 0) close(m_wakefd);
+}
+
+void UringReactor::Loop() {
+    LOG_INFO("UringReactor[%d] start, listen fd %d, %u slots", m_id, m_listenfd, m_slots);
+    ArmWake();
+    ArmAccept();
+    while(!m_stop.load(std::memory_order_acquire)) {
+        //上一轮因为拿不到SQE没发出去的请求
+        if(!m_wakearmed) {
+            ArmWake();
+        }
+        if(m_acceptretry || (m_acceptpaused && TimerWheel::NowMS() >= m_acceptresume)) {
+            ArmAccept();
+        }
+        RetryClose();
+        if(!m_throttled.empty()) {
+            RetryThrottled();
+        }
+        //等待时间不超过时间轮的下一个刻度 有暂停的连接或accept时也要按时醒来重试 有挪出来的完成事件时不等
+        int timeout = m_timers.NextTimeoutMS();
+        int retry = !m_throttled.empty() ? RETRY_MS : m_acceptpaused ? ACCEPT_BACKOFF_MS : -1;
+        if(retry >= 0 && (timeout < 0 || timeout > retry)) {
+            timeout = retry;
+        }
+        int ret = m_ring.Submit(m_ring.HasBacklog() ? 0 : 1, timeout);
+        if(ret < 0 && ret != -EINTR && ret != -ETIME && ret != -EBUSY) {
+            LOG_ERROR("UringReactor[%d] io_uring_enter error: %d", m_id, -ret);
+            break;
+        }
+        m_ring.ForEachCqe([this](const io_uring_cqe& cqe) { HandleCqe(cqe); });
+        m_timers.Advance([this](TimerNode* node) {
+            Conn* conn = static_cast<Conn*>(node->data);
+            LOG_DEBUG("Client[%d] timeout", conn->slot);
+            timeoutTotal->Inc();
+            CloseConn(conn);
+        });
+    }
+    LOG_INFO("UringReactor[%d] quit, %llu enters, %llu cqes", m_id,
+             (unsigned long long)m_ring.Enters(), (unsigned long long)m_ring.Cqes());
+}
+
+void UringReactor::Stop() {
+    m_stop.store(true, std::memory_order_release);
+    uint64_t one = 1;
+    ssize_t ret = write(m_wakefd, &one, sizeof(one));
+    (void)ret;
+}
+
+void UringReactor::Post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        m_tasks.push_back(std::move(task));
+    }
+    uint64_t one = 1;
+    ssize_t ret = write(m_wakefd, &one, sizeof(one));
+    (void)ret;
+}
+
+UringReactor::Conn* UringReactor::FindConn(uint64_t key) {
+    return m_conns.Find(key);
+}
+
+void UringReactor::HandleCqe(const io_uring_cqe& cqe) {
+    OP op = static_cast<OP>(cqe.user_data >> 56);
+    uint64_t key = cqe.user_data & KEY_MASK;
+    switch(op) {
+        case OP_ACCEPT: OnAccept(cqe.res, cqe.flags); return;
+        case OP_WAKE: HandleWakeup(); return;
+        case OP_IGNORE: return;
+        default: break;
+    }
+    Conn* conn = FindConn(key);
+    if(!conn) {
+        //连接已经释放(槽位可能已被新连接复用) 只需要归还缓冲区
+        if(cqe.flags & IORING_CQE_F_BUFFER) {
+            m_ring.RecycleBuf(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+        return;
+    }
+    switch(op) {
+        case OP_RECV: OnRecv(conn, cqe.res, cqe.flags); break;
+        case OP_SEND: OnSend(conn, cqe.res); break;
+        case OP_OPEN:
+        case OP_STATX: OnFile(conn, op, cqe.res); break;
+        case OP_CLOSE: conn->inflight--; break;
+        default: break;
+    }
+    Touch(conn);
+    Release(conn);
+}
+
+void UringReactor::ArmWake() {
+    io_uring_sqe* sqe = m_ring.GetSqe();
+    m_wakearmed = (sqe != nullptr);
+    if(!sqe) return;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_wakefd;
+    sqe->addr = reinterpret_cast<uint64_t>(&m_wakeval);
+    sqe->len = sizeof(m_wakeval);
+    sqe->user_data = Pack(OP_WAKE, 0);
+}
+
+void UringReactor::HandleWakeup() {
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        tasks.swap(m_tasks);
+    }
+    for(auto& task: tasks) {
+        task();
+    }
+    m_wakearmed = false;
+    ArmWake();
+}
+
+void UringReactor::ArmAccept() {
+    //一个请求持续产生新连接 连接直接放进内核分配的固定文件槽位
+    io_uring_sqe* sqe = m_ring.GetSqe();
+    m_acceptretry = (sqe == nullptr);
+    if(!sqe) return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = m_listenfd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT; //固定文件不进进程fd表 不能带SOCK_CLOEXEC
+    sqe->file_index = IORING_FILE_INDEX_ALLOC;
+    sqe->user_data = Pack(OP_ACCEPT, 0);
+    m_acceptarmed = true;
+    m_acceptpaused = false;
+}
+
+void UringReactor::PauseAccept() {
+    m_acceptpaused = true;
+    m_acceptresume = TimerWheel::NowMS() + ACCEPT_BACKOFF_MS;
+}
+
+void UringReactor::OnAccept(int res, uint32_t flags) {
+    if(!(flags & IORING_CQE_F_MORE)) {
+        m_acceptarmed = false;
+    }
+    uint64_t key;
+    if(res < 0) {
+        if(res == -ENFILE) {
+            //槽位用完 有连接关闭时在Release里重新接受 没有连接可关时退避后再试
+            LOG_WARN_EVERY_MS(1000, "UringReactor[%d] out of file slots!", m_id);
+            if(!m_acceptarmed) PauseAccept();
+            return;
+        }
+        if(res != -EINTR && res != -ECONNABORTED && res != -EAGAIN) {
+            //其他错误(比如进程fd或内存用完)马上重试也一样 退避一会再挂上
+            LOG_ERROR_EVERY_MS(1000, "UringReactor[%d] accept error: %d", m_id, -res);
+            if(!m_acceptarmed) PauseAccept();
+            return;
+        }
+    }else if(HttpConn::userCount >= HttpConn::MAX_CONN) {
+        CloseSlot(res, nullptr);
+        refusedTotal->Inc();
+        LOG_WARN_EVERY_MS(1000, "Clients is full!");
+    }else if(Conn* conn = m_conns.Acquire(&key)) {
+        acceptedTotal->Inc();
+        conn->key = key;
+        conn->slot = res;
+        conn->inflight = 0;
+        conn->recving = conn->throttled = conn->recvcancel = false;
+        conn->sending = conn->linkclose = conn->closing = conn->closewait = false;
+        conn->filepending = 0;
+        conn->filefd = -1;
+        conn->statok = false;
+        conn->http.Timer().data = conn;
+        //多次accept不返回对端地址 固定文件也没法getpeername 留空(内部路由因此不对这些连接开放)
+        sockaddr_in addr = {0};
+        conn->http.Init(res, addr, key, false);
+        m_conncount.fetch_add(1, std::memory_order_relaxed);
+        ResumeRecv(conn);
+        Touch(conn);
+    }else {
+        CloseSlot(res, nullptr);
+        LOG_WARN_EVERY_MS(1000, "UringReactor[%d] connection pool is full!", m_id);
+    }
+    if(!m_acceptarmed && !m_stop.load(std::memory_order_relaxed)) {
+        ArmAccept();
+    }
+}
+
+void UringReactor::ArmRecv(Conn* conn) {
+    io_uring_sqe* sqe = m_ring.GetSqe();
+    if(!sqe) {
+        CloseConn(conn);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->slot;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = Pack(OP_RECV, conn->key);
+    conn->recving = true;
+    conn->inflight++;
+}
+
+void UringReactor::ResumeRecv(Conn* conn) {
+    if(conn->closing || conn->linkclose) return;
+    if(BufferPool::OverBudget() || conn->http.ToReadBytes() >= HttpConn::MAX_READ) {
+        Throttle(conn);
+        return;
+    }
+    if(!conn->recving) {
+        ArmRecv(conn);
+    }
+}
+
+void UringReactor::Throttle(Conn* conn) {
+    if(!conn->throttled) {
+        conn->throttled = true;
+        m_throttled.push_back(conn->key);
+    }
+    //多次recv会一直往缓冲区里收 要取消掉 取消生效前已经收到的数据照常Feed
+    if(conn->recving && !conn->recvcancel) {
+        io_uring_sqe* sqe = m_ring.GetSqe();
+        if(!sqe) return; //RetryThrottled会再试
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = Pack(OP_RECV, conn->key);
+        sqe->user_data = Pack(OP_IGNORE, 0);
+        conn->recvcancel = true;
+    }
+}
+
+void UringReactor::RetryThrottled() {
+    std::vector<uint64_t> keys;
+    keys.swap(m_throttled);
+    for(uint64_t key: keys) {
+        Conn* conn = FindConn(key);
+        if(!conn || conn->closing) continue;
+        conn->throttled = false;
+        ResumeRecv(conn); //还是超出时会重新放回m_throttled
+    }
+}
+
+void UringReactor::OnRecv(Conn* conn, int res, uint32_t flags) {
+    bool fed = true;
+    if(flags & IORING_CQE_F_BUFFER) {
+        uint16_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        if(res > 0 && !conn->closing) {
+            fed = conn->http.Feed(m_ring.BufAddr(bid), res);
+        }
+        m_ring.RecycleBuf(bid);
+    }
+    bool canceled = (res == -ECANCELED && conn->recvcancel);
+    if(!(flags & IORING_CQE_F_MORE)) {
+        conn->recving = false;
+        conn->recvcancel = false;
+        conn->inflight--;
+    }
+    if(conn->closing) return;
+    if(!fed || (res < 0 && res != -ENOBUFS && !canceled)) {
+        CloseConn(conn);
+        return;
+    }
+    Serve(conn);
+    if(res == 0) {
+        //对端关闭 没有待处理的响应就关掉
+        if(!conn->http.IsBusy() && !conn->sending && !conn->filepending) {
+            CloseConn(conn);
+        }
+        return;
+    }
+    //缓冲区环暂时用完或被暂停取消时多次recv会停下 处理完已有数据后按预算重新挂上
+    ResumeRecv(conn);
+}
+
+void UringReactor::Serve(Conn* conn) {
+    while(!conn->closing && !conn->linkclose && !conn->http.IsBusy() && !conn->sending && !conn->filepending) {
+        switch(conn->http.Parse()) {
+            case HttpConn::PARSE_AGAIN:
+                return;
+            case HttpConn::PARSE_BAD:
+                conn->http.Respond(conn->http.Request().ErrorCode());
+                StartSend(conn);
+                return;
+            case HttpConn::PARSE_VERIFY:
+                DispatchVerify(conn);
+                return;
+            case HttpConn::PARSE_OK:
+                if(conn->http.RespondInternal()) {
+                    StartSend(conn);
+                }else {
+                    StartOpen(conn);
+                }
+                return;
+        }
+    }
+}
+
+void UringReactor::DispatchVerify(Conn* conn) {
+    const HttpRequest& request = conn->http.Request();
+    if(!m_admission) {
+        conn->http.FinishVerify(HttpRequest::UserVerify(request.GetPost("username"), request.GetPost("password"),
+                                                        request.IsLogin()));
+        StartOpen(conn);
+        return;
+    }
+    uint64_t key = conn->key;
+    Admission::ROUTE route = request.IsLogin() ? Admission::ROUTE_LOGIN : Admission::ROUTE_REGISTER;
+    bool admitted = m_admission->Submit(route, [this, key, name = request.GetPost("username"),
+                                                pwd = request.GetPost("password"), islogin = request.IsLogin()](bool shed) {
+        bool ok = !shed && HttpRequest::UserVerify(name, pwd, islogin);
+        Post([this, key, ok, shed] {
+            Conn* conn = FindConn(key);
+            if(!conn) return;
+            conn->http.SetBusy(false);
+            if(conn->closing) {
+                Release(conn);
+                return;
+            }
+            if(shed) {
+                conn->http.Reject(m_admission->RetryAfter());
+                StartSend(conn);
+            }else {
+                conn->http.FinishVerify(ok);
+                StartOpen(conn);
+            }
+            Touch(conn);
+        });
+    });
+    if(!admitted) {
+        //被拒绝的请求不打开任何文件 直接发503
+        conn->http.Reject(m_admission->RetryAfter());
+        StartSend(conn);
+        return;
+    }
+    conn->http.SetBusy(true);
+}
+
+//statx和openat同时发出 两个都完成后再mmap
+void UringReactor::StartOpen(Conn* conn) {
+    TRACE_MARK(conn->http.Trace(), TP_OPEN_BEGIN, open_begin, conn->key);
+    conn->path = conn->http.Target();
+    conn->filefd = -1;
+    conn->statok = false;
+    if(!m_ring.Reserve(2)) {
+        //SQ放不下 在当前线程同步打开
+        conn->http.Respond();
+        StartSend(conn);
+        return;
+    }
+
+    io_uring_sqe* sqe = m_ring.GetSqe();
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uint64_t>(conn->path.c_str());
+    sqe->len = STATX_TYPE | STATX_MODE | STATX_SIZE;
+    sqe->off = reinterpret_cast<uint64_t>(&conn->stx);
+    sqe->user_data = Pack(OP_STATX, conn->key);
+
+    sqe = m_ring.GetSqe();
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uint64_t>(conn->path.c_str());
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    sqe->user_data = Pack(OP_OPEN, conn->key);
+
+    conn->filepending = 2;
+    conn->inflight += 2;
+}
+
+void UringReactor::OnFile(Conn* conn, OP op, int res) {
+    conn->inflight--;
+    conn->filepending--;
+    if(op == OP_OPEN) {
+        conn->filefd = res;
+    }else {
+        conn->statok = (res == 0);
+    }
+    if(conn->filepending > 0) return;
+
+    if(!conn->closing) {
+        struct stat st = {0};
+        if(conn->statok) {
+            st.st_mode = conn->stx.stx_mode;
+            st.st_size = conn->stx.stx_size;
+        }
+        conn->http.Respond(conn->statok ? conn->filefd : -1, st);
+    }
+    if(conn->filefd >= 0) {
+        //mmap之后文件描述符就没用了 异步关闭
+        if(io_uring_sqe* sqe = m_ring.GetSqe()) {
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = conn->filefd;
+            sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+            sqe->user_data = Pack(OP_IGNORE, 0);
+        }else {
+            close(conn->filefd);
+        }
+        conn->filefd = -1;
+    }
+    if(!conn->closing) {
+        StartSend(conn);
+    }
+}
+
+void UringReactor::StartSend(Conn* conn) {
+    ChainBuffer& buff = conn->http.WriteBuffer();
+    int cnt = buff.PeekIov(conn->iov, SEND_IOV);
+    size_t total = 0;
+    for(int i = 0; i < cnt; i++) total += conn->iov[i].iov_len;
+    memset(&conn->msg, 0, sizeof(conn->msg));
+    conn->msg.msg_iov = conn->iov;
+    conn->msg.msg_iovlen = cnt;
+
+    //最后一段响应 关闭链接在发送后面 省一轮往返 两个SQE要放在同一批里
+    bool link = !conn->http.IsKeepAlive() && total == buff.ReadableBytes() && m_ring.Reserve(2);
+    io_uring_sqe* sqe = m_ring.GetSqe();
+    if(!sqe) {
+        CloseConn(conn);
+        return;
+    }
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn->slot;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = reinterpret_cast<uint64_t>(&conn->msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL; //内核负责把短写补完
+    sqe->user_data = Pack(OP_SEND, conn->key);
+    conn->sending = true;
+    conn->inflight++;
+
+    if(link) {
+        sqe->flags |= IOSQE_IO_LINK;
+        sqe = m_ring.GetSqe();
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->file_index = conn->slot + 1;
+        sqe->user_data = Pack(OP_CLOSE, conn->key);
+        conn->linkclose = true;
+        conn->inflight++;
+    }
+}
+
+void UringReactor::OnSend(Conn* conn, int res) {
+    conn->inflight--;
+    conn->sending = false;
+    if(res < 0 && conn->linkclose) {
+        //发送失败时链接的close会被取消 槽位要另外关闭
+        conn->linkclose = false;
+        if(conn->closing) {
+            SubmitClose(conn);
+        }
+    }
+    if(conn->closing) return;
+    if(res < 0) {
+        CloseConn(conn);
+        return;
+    }
+    ChainBuffer& buff = conn->http.WriteBuffer();
+    buff.Retrieve(std::min(static_cast<size_t>(res), buff.ReadableBytes()));
+    if(buff.ReadableBytes() > 0) {
+        if(conn->linkclose) {
+            //没发完 链接的close会被取消 重新发
+            conn->linkclose = false;
+        }
+        StartSend(conn);
+        return;
+    }
+    bool keepAlive = conn->http.IsKeepAlive();
+    conn->http.ResetForNext();
+    if(!keepAlive) {
+        CloseConn(conn);
+        return;
+    }
+    Serve(conn);
+    ResumeRecv(conn);
+}
+
+void UringReactor::CloseSlot(int slot, Conn* conn) {
+    io_uring_sqe* sqe = m_ring.GetSqe();
+    if(!sqe) {
+        m_ring.UnregisterFile(slot); //同步关闭 没有完成事件
+        return;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = slot + 1;
+    sqe->user_data = conn ? Pack(OP_CLOSE, conn->key) : Pack(OP_IGNORE, 0);
+    if(conn) {
+        conn->inflight++;
+    }
+}
+
+void UringReactor::CloseConn(Conn* conn) {
+    if(conn->closing) return;
+    //HttpConn等所有请求完成后在Release里关闭 进行中的send还在读它的缓冲区和文件映射
+    conn->closing = true;
+    m_conncount.fetch_sub(1, std::memory_order_relaxed);
+    m_timers.Cancel(&conn->http.Timer());
+    SubmitClose(conn);
+}
+
+void UringReactor::SubmitClose(Conn* conn) {
+    if(conn->closewait) return; //下一轮会按当时的状态重新提交
+    unsigned need = conn->recving + conn->sending + !conn->linkclose;
+    if(!m_ring.Reserve(need)) {
+        conn->closewait = true;
+        conn->inflight++; //推迟期间不能被Release回收
+        m_closeretry.push_back(conn->key);
+        return;
+    }
+    //进行中的recv/send持有socket的引用 不取消的话关闭槽位后对端也收不到FIN 卡住的send也永远不会完成
+    if(conn->recving) {
+        io_uring_sqe* sqe = m_ring.GetSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = Pack(OP_RECV, conn->key);
+        sqe->user_data = Pack(OP_IGNORE, 0);
+    }
+    if(conn->sending) {
+        io_uring_sqe* sqe = m_ring.GetSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = Pack(OP_SEND, conn->key);
+        sqe->user_data = Pack(OP_IGNORE, 0);
+    }
+    if(!conn->linkclose) {
+        CloseSlot(conn->slot, conn);
+    }
+}
+
+void UringReactor::RetryClose() {
+    if(m_closeretry.empty()) return;
+    std::vector<uint64_t> keys;
+    keys.swap(m_closeretry);
+    for(uint64_t key: keys) {
+        Conn* conn = FindConn(key);
+        if(!conn) continue;
+        conn->closewait = false;
+        conn->inflight--;
+        SubmitClose(conn);
+        Release(conn);
+    }
+}
+
+void UringReactor::Touch(Conn* conn) {
+    uint32_t timeoutMS = 0;
+    if(conn->closing || !conn->http.NextDeadline(&timeoutMS)) {
+        return;
+    }
+    if(timeoutMS > 0) {
+        m_timers.Schedule(&conn->http.Timer(), timeoutMS);
+    }else {
+        m_timers.Cancel(&conn->http.Timer());
+    }
+}
+
+void UringReactor::Release(Conn* conn) {
+    if(conn->closing && conn->inflight == 0 && !conn->http.IsBusy()) {
+        conn->http.Close();
+        m_conns.Recycle(conn->key);
+        //槽位已经还给内核 之前因为槽位用完停下的accept可以继续了
+        if(!m_acceptarmed && !m_stop.load(std::memory_order_relaxed)) {
+            ArmAccept();
+        }
+    }
+}
@@ -0,0 +1,160 @@
+#ifndef __URINGREACTOR_HPP
+#define __URINGREACTOR_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <vector>
+#include "eventloop.hpp"
+#include "iouring.hpp"
+#include "../http/httpconn.hpp"
+#include "../pool/connpool.hpp"
+#include "admission.hpp"
+
+/*
+io_uring后端的事件循环 和Reactor一样一个线程一个环 连接只属于这个线程
+多次accept直接把连接放进固定文件表(不占进程fd) 多次recv从provided buffer ring取缓冲区
+静态文件用异步statx/openat 响应用sendmsg一次发出 不保持连接时把close链接在send后面
+每轮循环只进一次内核: 提交所有新请求并等待完成
+连接对象从池里取 user_data里带着句柄的代数 槽位复用后才到的旧完成事件会被丢掉
+*/
+class UringReactor : public EventLoop {
+public:
+    //admission为空时阻塞处理直接在reactor线程里做
+    UringReactor(int id, int listenFd, bool shared, Admission* admission);
+    ~UringReactor() override;
+    UringReactor(const UringReactor&) = delete;
+    UringReactor& operator=(const UringReactor&) = delete;
+
+    bool IsValid() const override { return m_valid; }
+
+    void Loop() override;
+
+    void Stop() override;
+
+    void Post(std::function<void()> task) override;
+
+    int Id() const override { return m_id; }
+
+    size_t ConnCount() const override { return m_conncount.load(std::memory_order_relaxed); }
+
+private:
+    enum OP : uint8_t {
+        OP_ACCEPT = 1,
+        OP_RECV,
+        OP_SEND,
+        OP_CLOSE,
+        OP_OPEN,
+        OP_STATX,
+        OP_WAKE,
+        OP_IGNORE //完成事件不需要处理(取消 异步关闭文件)
+    };
+
+    static const unsigned RING_ENTRIES = 1024;
+    static const unsigned BUF_COUNT = 512;
+    static const unsigned BUF_SIZE = 4096;
+    static const uint16_t BUF_GROUP = 0;
+    static const int SEND_IOV = 64;
+    static const int RETRY_MS = 5; //超出内存预算的连接隔这么久重试读
+    static const int ACCEPT_BACKOFF_MS = 100; //accept出错后隔这么久再挂上
+
+    struct Conn {
+        HttpConn http;
+        uint64_t key; //ConnPool的句柄
+        int slot; //固定文件表里的下标
+        int inflight; //还没完成的请求数 为0且已关闭时才能释放
+        bool recving;
+        bool throttled; //超出内存预算或读缓冲满 暂停recv 等RetryThrottled恢复
+        bool recvcancel; //暂停时已经提交了取消多次recv的请求
+        bool sending;
+        bool linkclose; //close已经链接在send后面 之后不能再对这个槽位发请求
+        bool closing;
+        bool closewait; //拿不到SQE 关闭推迟到下一轮循环 期间占一个inflight
+        int filepending;
+        int filefd;
+        bool statok;
+        struct statx stx;
+        std::string path;
+        msghdr msg;
+        iovec iov[SEND_IOV];
+
+        void Shrink() {
+            http.Shrink();
+            std::string().swap(path);
+        }
+    };
+
+    static const uint64_t KEY_MASK = (1ull << 56) - 1;
+
+    static uint64_t Pack(OP op, uint64_t key) { return (static_cast<uint64_t>(op) << 56) | key; }
+
+    void HandleCqe(const io_uring_cqe& cqe);
+    void OnAccept(int res, uint32_t flags);
+    void OnRecv(Conn* conn, int res, uint32_t flags);
+    void OnSend(Conn* conn, int res);
+    void OnFile(Conn* conn, OP op, int res);
+    void HandleWakeup();
+
+    void ArmAccept();
+    void ArmWake();
+    void ArmRecv(Conn* conn);
+    //按内存预算和读缓冲上限决定是重新挂上recv还是暂停
+    void ResumeRecv(Conn* conn);
+    void Throttle(Conn* conn);
+    void RetryThrottled();
+    //accept出错后停一会再挂上 不让同一个错误忙转
+    void PauseAccept();
+    void StartOpen(Conn* conn);
+    void StartSend(Conn* conn);
+    //conn为空时不关心完成结果 否则把关闭计入conn的inflight
+    void CloseSlot(int slot, Conn* conn);
+    void CloseConn(Conn* conn);
+    //取消进行中的recv/send并关闭槽位 SQ放不下时推迟到下一轮
+    void SubmitClose(Conn* conn);
+    void RetryClose();
+    void Release(Conn* conn);
+
+    //处理完连接上的事件后按所处阶段重新设定超时
+    void Touch(Conn* conn);
+
+    //把读到的请求一个个处理 遇到要等文件/发送/线程池时返回
+    void Serve(Conn* conn);
+    void DispatchVerify(Conn* conn);
+
+    Conn* FindConn(uint64_t key);
+
+    int m_id;
+    int m_listenfd;
+    bool m_shared;
+    bool m_valid;
+    bool m_acceptarmed;
+    bool m_acceptretry; //拿不到SQE没挂上accept
+    bool m_acceptpaused; //accept出错暂停中 到m_acceptresume后重新挂上
+    uint64_t m_acceptresume;
+    bool m_wakearmed;
+    int m_wakefd;
+    uint64_t m_wakeval;
+    Admission* m_admission;
+    unsigned m_slots;
+
+    IoUring m_ring;
+    TimerWheel m_timers;
+
+    std::atomic<bool> m_stop;
+    std::atomic<size_t> m_conncount;
+
+    ConnPool<Conn> m_conns;
+    std::vector<uint64_t> m_closeretry;
+    std::vector<uint64_t> m_throttled;
+
+    std::mutex m_mtx;
+    std::vector<std::function<void()>> m_tasks;
+};
+
+
+#endif
@@ -0,0 +1,187 @@
+#include "webserver.hpp"
+#include <csignal>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../buffer/bufferpool.hpp"
+#include "../metrics/metrics.hpp"
+#include "../metrics/profiledmutex.hpp"
+
+WebServer::WebServer(int port, int reactorNum, int threadNum, ACCEPT_MODE mode,
+                     const std::string& srcDir, UserStore* store, BACKEND backend,
+                     const SocketProfile& profile)
+    : m_port(port), m_mode(mode), m_backend(backend), m_profile(profile), m_isclose(false), m_sharedfd(-1) {
+    signal(SIGPIPE, SIG_IGN); //对端关闭后继续写不要杀掉进程
+    HttpConn::srcDir = srcDir;
+    HttpConn::userCount = 0;
+    HttpRequest::SetUserStore(store);
+    if(threadNum > 0) {
+        m_threadpool.reset(new ThreadPool(threadNum));
+        m_admission.reset(new Admission(m_threadpool.get(), threadNum * QUEUE_PER_THREAD, threadNum * ROUTE_PER_THREAD));
+        //注册要写存储 比登录重 并发上限给小一些
+        m_admission->SetRouteLimit(Admission::ROUTE_REGISTER, threadNum * ROUTE_PER_THREAD / 4);
+    }
+    if(reactorNum <= 0) {
+        reactorNum = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    if(m_mode == EXCLUSIVE) {
+        m_sharedfd = CreateListenFd(port, false, m_profile);
+        if(m_sharedfd < 0) {
+            m_isclose = true;
+            return;
+        }
+    }
+    for(int i = 0; i < reactorNum; i++) {
+        int listenFd = m_sharedfd;
+        if(m_mode == REUSEPORT) {
+            listenFd = CreateListenFd(port, true, m_profile);
+            if(listenFd < 0) {
+                m_isclose = true;
+                return;
+            }
+        }
+        if(m_backend == URING) {
+            m_reactors.emplace_back(new UringReactor(i, listenFd, m_mode == EXCLUSIVE, m_admission.get()));
+            if(!m_reactors.back()->IsValid() && i == 0) {
+                LOG_WARN("io_uring unavailable, fall back to epoll");
+                m_reactors.clear(); //独占的监听socket随之关闭 重新创建
+                m_backend = EPOLL;
+                if(m_mode == REUSEPORT && (listenFd = CreateListenFd(port, true, m_profile)) < 0) {
+                    m_isclose = true;
+                    return;
+                }
+            }else if(!m_reactors.back()->IsValid()) {
+                m_isclose = true;
+                return;
+            }
+        }
+        if(m_backend == EPOLL) {
+            m_reactors.emplace_back(new Reactor(i, listenFd, m_mode == EXCLUSIVE, m_admission.get(), m_profile));
+        }
+        if(!m_reactors.back()->IsValid()) {
+            m_isclose = true;
+            return;
+        }
+    }
+    RegisterMetrics();
+    if(m_backend == URING && !HttpConn::metricsPath.empty()) {
+        LOG_WARN("%s is not served on io_uring: peer addresses are unknown", HttpConn::metricsPath.c_str());
+    }
+    LOG_INFO("========== Server init ==========");
+    LOG_INFO("Port:%d, Reactors:%d, Threads:%d, Mode:%s, Backend:%s", port, reactorNum, threadNum,
+             m_mode == REUSEPORT ? "reuseport" : "exclusive", m_backend == URING ? "io_uring" : "epoll");
+    LOG_INFO("srcDir: %s", srcDir.c_str());
+    LOG_INFO("Socket: %s", m_profile.ToString().c_str());
+}
+
+WebServer::~WebServer() {
+    Metrics::Instance()->RemoveCallback("webserver_threadpool_queue_depth");
+    Metrics::Instance()->RemoveCallback("webserver_admission_rejected_total");
+    Metrics::Instance()->RemoveCallback("webserver_admission_shed_total");
+    Stop();
+    for(auto& thread: m_threads) {
+        if(thread.joinable()) thread.join();
+    }
+    //线程池里的任务会Post回reactor 还会用到用户存储 先做完并等工作线程退出再释放reactor
+    if(m_threadpool) m_threadpool->Shutdown();
+    m_reactors.clear();
+    m_admission.reset();
+    m_threadpool.reset();
+    if(m_sharedfd >= 0) close(m_sharedfd);
+}
+
+void WebServer::Start() {
+    if(m_isclose) {
+        LOG_ERROR("========== Server init error!==========");
+        return;
+    }
+    LOG_INFO("========== Server start ==========");
+    int ncpu = std::max(1u, std::thread::hardware_concurrency());
+    for(size_t i = 0; i < m_reactors.size(); i++) {
+        EventLoop* reactor = m_reactors[i].get();
+        m_threads.emplace_back([reactor] { reactor->Loop(); });
+        //每个reactor固定在一个核上 连接的数据留在这个核的缓存里
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(i % ncpu, &cpuset);
+        pthread_setaffinity_np(m_threads.back().native_handle(), sizeof(cpuset), &cpuset);
+    }
+    for(auto& thread: m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+}
+
+void WebServer::Stop() {
+    for(auto& reactor: m_reactors) {
+        reactor->Stop();
+    }
+}
+
+size_t WebServer::ConnCount() const {
+    size_t count = 0;
+    for(auto& reactor: m_reactors) {
+        count += reactor->ConnCount();
+    }
+    return count;
+}
+
+void WebServer::RegisterMetrics() {
+    Metrics* metrics = Metrics::Instance();
+    metrics->AddCallback("webserver_connections", "Open client connections", Metrics::GAUGE,
+                         [] { return static_cast<double>(HttpConn::userCount.load()); });
+    metrics->AddCallback("webserver_buffer_resident_bytes", "Bytes held by Buffers", Metrics::GAUGE,
+                         [] { return static_cast<double>(BufferPool::ResidentBytes()); });
+    metrics->AddCallback("webserver_buffer_pooled_bytes", "Bytes cached in BufferPool free lists", Metrics::GAUGE,
+                         [] { return static_cast<double>(BufferPool::PooledBytes()); });
+    if(m_threadpool) {
+        ThreadPool* pool = m_threadpool.get();
+        metrics->AddCallback("webserver_threadpool_queue_depth", "Tasks waiting in the thread pool queue",
+                             Metrics::GAUGE, [pool] { return static_cast<double>(pool->QueueSize()); });
+    }
+    if(m_admission) {
+        Admission* admission = m_admission.get();
+        metrics->AddCallback("webserver_admission_rejected_total", "Requests refused at admission with 503",
+                             Metrics::COUNTER, [admission] { return static_cast<double>(admission->Rejected()); });
+        metrics->AddCallback("webserver_admission_shed_total", "Queued requests shed by CoDel with 503",
+                             Metrics::COUNTER, [admission] { return static_cast<double>(admission->Shed()); });
+    }
+    LockProfiler::ExportMetrics();
+}
+
+int WebServer::CreateListenFd(int port, bool reuseport, const SocketProfile& profile) {
+    if(port > 65535 || port < 1024) {
+        LOG_ERROR("Port:%d error!", port);
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0) {
+        LOG_ERROR("Create socket error!");
+        return -1;
+    }
+    int optval = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+    if(reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0) {
+        LOG_ERROR("set SO_REUSEPORT error!");
+        close(fd);
+        return -1;
+    }
+    profile.ApplyListen(fd);
+    sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if(bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        LOG_ERROR("Bind Port:%d error!", port);
+        close(fd);
+        return -1;
+    }
+    if(listen(fd, SOMAXCONN) < 0) {
+        LOG_ERROR("Listen port:%d error!", port);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
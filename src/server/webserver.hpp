@@ -0,0 +1,70 @@
+#ifndef __WEBSERVER_HPP
+#define __WEBSERVER_HPP
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "reactor.hpp"
+#include "uringreactor.hpp"
+#include "socketprofile.hpp"
+#include "../pool/threadpool.hpp"
+#include "../store/userstore.hpp"
+
+/*
+多reactor服务器 每个reactor一个线程 绑定到一个CPU上
+REUSEPORT: 每个reactor各自创建SO_REUSEPORT监听socket 接受连接没有共享的锁
+EXCLUSIVE: 共用一个监听socket 各reactor用EPOLLEXCLUSIVE注册 内核只唤醒其中一个
+I/O后端可以选epoll或io_uring 内核不支持io_uring时退回epoll
+*/
+class WebServer {
+public:
+    enum ACCEPT_MODE {
+        REUSEPORT,
+        EXCLUSIVE
+    };
+
+    enum BACKEND {
+        EPOLL,
+        URING
+    };
+
+    //reactorNum为0时取CPU核数 threadNum为0时阻塞处理直接在reactor线程里做
+    WebServer(int port, int reactorNum, int threadNum, ACCEPT_MODE mode,
+              const std::string& srcDir, UserStore* store, BACKEND backend = EPOLL,
+              const SocketProfile& profile = SocketProfile());
+    ~WebServer();
+
+    //启动所有reactor并阻塞到Stop
+    void Start();
+
+    //任意线程和信号处理函数里都可以调用
+    void Stop();
+
+    size_t ConnCount() const;
+
+    //创建非阻塞监听socket 并设置profile里的选项 失败返回-1
+    static int CreateListenFd(int port, bool reuseport, const SocketProfile& profile);
+
+private:
+    //注册读的时候才取值的指标 析构时移除引用本对象的那些
+    void RegisterMetrics();
+
+    static const int QUEUE_PER_THREAD = 64; //线程池队列长度上限 按线程数算
+    static const int ROUTE_PER_THREAD = 32; //每种路由排队加执行的上限
+
+    int m_port;
+    ACCEPT_MODE m_mode;
+    BACKEND m_backend;
+    SocketProfile m_profile;
+    bool m_isclose;
+    int m_sharedfd; //EXCLUSIVE模式下共用的监听socket
+
+    std::unique_ptr<ThreadPool> m_threadpool;
+    std::unique_ptr<Admission> m_admission;
+    std::vector<std::unique_ptr<EventLoop>> m_reactors;
+    std::vector<std::thread> m_threads;
+};
+
+
+#endif
@@ -0,0 +1,141 @@
+#include "sessionstore.hpp"
+#include <cerrno>
+#include <functional>
+#include <sys/random.h>
+
+SessionStore::SessionStore() {
+    m_ttl = 1800;
+    m_sweepinterval = 0;
+    m_is_close = false;
+}
+
+SessionStore::~SessionStore() {
+    Close();
+}
+
+SessionStore* SessionStore::Instance() {
+    static SessionStore store;
+    return &store;
+}
+
+void SessionStore::Init(int ttlSec, int sweepIntervalSec) {
+    assert(ttlSec > 0);
+    m_ttl = ttlSec;
+    m_sweepinterval = sweepIntervalSec;
+    if(m_sweepinterval > 0 && !m_sweep_thread.joinable()) {
+        m_is_close = false;
+        m_sweep_thread = std::thread(&SessionStore::SweepThread, this);
+    }
+}
+
+SessionStore::Shard& SessionStore::GetShard(const std::string& token) {
+    return m_shards[std::hash<std::string>()(token) % SHARD_NUM];
+}
+
+bool SessionStore::NewToken(std::string& token) {
+    unsigned char bytes[TOKEN_BYTES];
+    size_t got = 0;
+    while(got < TOKEN_BYTES) {
+        ssize_t n = getrandom(bytes + got, TOKEN_BYTES - got, 0);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        got += n;
+    }
+    static const char HEX[] = "0123456789abcdef";
+    token.resize(TOKEN_BYTES * 2);
+    for(size_t i = 0; i < TOKEN_BYTES; i++) {
+        token[2 * i] = HEX[bytes[i] >> 4];
+        token[2 * i + 1] = HEX[bytes[i] & 0xf];
+    }
+    return true;
+}
+
+std::string SessionStore::Create(const std::string& user) {
+    std::string token;
+    if(!NewToken(token)) {
+        LOG_ERROR("SessionStore: getrandom failed, errno %d", errno);
+        return "";
+    }
+    Shard& shard = GetShard(token);
+    auto expire = std::chrono::steady_clock::now() + std::chrono::seconds(m_ttl);
+    std::lock_guard<std::mutex> lck(shard.mtx);
+    shard.sessions[token] = {user, expire};
+    return token;
+}
+
+bool SessionStore::Lookup(const std::string& token, std::string& user) {
+    if(token.size() != TOKEN_BYTES * 2) {
+        return false;
+    }
+    Shard& shard = GetShard(token);
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lck(shard.mtx);
+    auto it = shard.sessions.find(token);
+    if(it == shard.sessions.end()) {
+        return false;
+    }
+    if(it->second.expire <= now) {
+        shard.sessions.erase(it);
+        return false;
+    }
+    it->second.expire = now + std::chrono::seconds(m_ttl); //滑动过期
+    user = it->second.user;
+    return true;
+}
+
+void SessionStore::Remove(const std::string& token) {
+    Shard& shard = GetShard(token);
+    std::lock_guard<std::mutex> lck(shard.mtx);
+    shard.sessions.erase(token);
+}
+
+size_t SessionStore::Sweep() {
+    size_t removed = 0;
+    auto now = std::chrono::steady_clock::now();
+    for(auto& shard: m_shards) {
+        std::lock_guard<std::mutex> lck(shard.mtx);
+        for(auto it = shard.sessions.begin(); it != shard.sessions.end();) {
+            if(it->second.expire <= now) {
+                it = shard.sessions.erase(it);
+                removed++;
+            }else {
+                ++it;
+            }
+        }
+    }
+    return removed;
+}
+
+size_t SessionStore::Size() {
+    size_t total = 0;
+    for(auto& shard: m_shards) {
+        std::lock_guard<std::mutex> lck(shard.mtx);
+        total += shard.sessions.size();
+    }
+    return total;
+}
+
+void SessionStore::SweepThread() {
+    std::unique_lock<std::mutex> lck(m_mtx);
+    while(!m_is_close) {
+        m_cond.wait_for(lck, std::chrono::seconds(m_sweepinterval));
+        if(m_is_close) break;
+        lck.unlock();
+        size_t removed = Sweep();
+        if(removed) {
+            LOG_DEBUG("SessionStore: swept %lu sessions", (unsigned long)removed);
+        }
+        lck.lock();
+    }
+}
+
+void SessionStore::Close() {
+    {
+        std::lock_guard<std::mutex> lck(m_mtx);
+        m_is_close = true;
+    }
+    m_cond.notify_all();
+    if(m_sweep_thread.joinable()) {
+        m_sweep_thread.join();
+    }
+}
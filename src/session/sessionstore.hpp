@@ -0,0 +1,77 @@
+#ifndef __SESSIONSTORE_HPP
+#define __SESSIONSTORE_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "../log/log.hpp"
+
+/*
+登录成功后发放的会话 token -> 用户名
+按token哈希分片 每个分片一把锁 查询只锁一个分片
+每次命中都会把过期时间往后推(滑动过期) 后台线程定期清理过期会话
+*/
+class SessionStore {
+public:
+    static SessionStore* Instance();
+
+    //ttlSec 会话空闲多久过期  sweepIntervalSec 清理间隔 0表示不启动清理线程
+    void Init(int ttlSec = 1800, int sweepIntervalSec = 60);
+
+    //为用户创建会话 返回随机token 失败返回空串
+    std::string Create(const std::string& user);
+
+    //查找会话 命中时刷新过期时间
+    bool Lookup(const std::string& token, std::string& user);
+
+    void Remove(const std::string& token);
+
+    //清理过期会话 返回清理的个数
+    size_t Sweep();
+
+    size_t Size();
+
+    int Ttl() const { return m_ttl; }
+
+    void Close();
+
+private:
+    SessionStore();
+    ~SessionStore();
+
+    static const int SHARD_NUM = 16;
+    static const size_t TOKEN_BYTES = 16;
+
+    struct Session {
+        std::string user;
+        std::chrono::steady_clock::time_point expire;
+    };
+
+    //每个分片独占缓存行 避免不同分片的锁伪共享
+    struct alignas(64) Shard {
+        std::mutex mtx;
+        std::unordered_map<std::string, Session> sessions;
+    };
+
+    Shard& GetShard(const std::string& token);
+
+    static bool NewToken(std::string& token);
+
+    void SweepThread();
+
+    Shard m_shards[SHARD_NUM];
+
+    int m_ttl;
+    int m_sweepinterval;
+
+    std::mutex m_mtx;
+    std::condition_variable m_cond;
+    std::thread m_sweep_thread;
+    bool m_is_close;
+};
+
+
+#endif
@@ -0,0 +1,281 @@
+#include "mmapuserstore.hpp"
+#include "../log/log.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+MmapUserStore::MmapUserStore(const std::string& dir, size_t initCapacity, bool syncEveryInsert)
+    : m_dir(dir), m_idxfd(-1), m_logfd(-1), m_sync(syncEveryInsert),
+      m_header(nullptr), m_table(nullptr), m_mapsize(0) {
+    mkdir(m_dir.c_str(), 0777);
+    m_idxfd = open((m_dir + "/users.idx").c_str(), O_RDWR | O_CREAT, 0644);
+    m_logfd = open((m_dir + "/users.log").c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if(m_idxfd < 0 || m_logfd < 0) {
+        LOG_ERROR("MmapUserStore: open %s failed, errno %d", m_dir.c_str(), errno);
+        return;
+    }
+
+    size_t capacity = 16;
+    while(capacity < initCapacity) capacity <<= 1;
+
+    struct stat idxStat = {}, logStat = {};
+    fstat(m_idxfd, &idxStat);
+    fstat(m_logfd, &logStat);
+
+    //先看旧表能否直接使用
+    bool reuse = false;
+    if(static_cast<size_t>(idxStat.st_size) >= sizeof(Header)) {
+        Header old;
+        if(pread(m_idxfd, &old, sizeof(old), 0) == sizeof(old)
+            && old.magic == MAGIC && old.version == VERSION && old.clean == 1
+            && old.capacity >= 16 && (old.capacity & (old.capacity - 1)) == 0
+            && static_cast<size_t>(idxStat.st_size) == sizeof(Header) + old.capacity * sizeof(Slot)
+            && old.logoffset == static_cast<uint64_t>(logStat.st_size)) {
+            capacity = old.capacity;
+            reuse = true;
+        }
+    }
+
+    if(!MapTable(capacity, !reuse)) {
+        return;
+    }
+    if(!reuse && !Rebuild()) {
+        UnmapTable();
+        return;
+    }
+    //运行期间标记为不干净 异常退出后下次启动会重建
+    m_header->clean = 0;
+    msync(m_header, sizeof(Header), MS_SYNC);
+    LOG_INFO("MmapUserStore: %s, %s, %lu users",
+             m_dir.c_str(), reuse ? "reuse index" : "rebuilt index", (unsigned long)m_header->count);
+}
+
+MmapUserStore::~MmapUserStore() {
+    if(m_table) {
+        if(m_sync) {
+            fdatasync(m_logfd);
+        }
+        msync(m_header, m_mapsize, MS_SYNC);
+        m_header->clean = 1;
+        msync(m_header, sizeof(Header), MS_SYNC);
+    }
+    UnmapTable();
+    if(m_idxfd >= 0) close(m_idxfd);
+    if(m_logfd >= 0) close(m_logfd);
+}
+
+size_t MmapUserStore::Count() const {
+    std::shared_lock<std::shared_mutex> lck(m_mtx);
+    return m_header ? m_header->count : 0;
+}
+
+//FNV-1a
+uint32_t MmapUserStore::Hash(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < len; i++) {
+        h ^= static_cast<unsigned char>(s[i]);
+        h *= 16777619u;
+    }
+    return h ? h : 1; //0留给空槽
+}
+
+uint32_t MmapUserStore::Checksum(const LogRecord& rec, const char* payload) {
+    uint32_t h = 2166136261u;
+    h = (h ^ rec.nlen) * 16777619u;
+    h = (h ^ rec.plen) * 16777619u;
+    for(size_t i = 0; i < static_cast<size_t>(rec.nlen) + rec.plen; i++) {
+        h ^= static_cast<unsigned char>(payload[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+bool MmapUserStore::MapTable(size_t capacity, bool reset) {
+    UnmapTable();
+    size_t size = sizeof(Header) + capacity * sizeof(Slot);
+    if(ftruncate(m_idxfd, size) < 0) {
+        LOG_ERROR("MmapUserStore: ftruncate failed, errno %d", errno);
+        return false;
+    }
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_idxfd, 0);
+    if(addr == MAP_FAILED) {
+        LOG_ERROR("MmapUserStore: mmap failed, errno %d", errno);
+        return false;
+    }
+    m_mapsize = size;
+    m_header = static_cast<Header*>(addr);
+    m_table = reinterpret_cast<Slot*>(static_cast<char*>(addr) + sizeof(Header));
+    if(reset) {
+        memset(addr, 0, size);
+        m_header->magic = MAGIC;
+        m_header->version = VERSION;
+        m_header->capacity = capacity;
+    }
+    return true;
+}
+
+void MmapUserStore::UnmapTable() {
+    if(m_header) {
+        munmap(m_header, m_mapsize);
+    }
+    m_header = nullptr;
+    m_table = nullptr;
+    m_mapsize = 0;
+}
+
+//从头重放日志 遇到写了一半的尾记录就截断
+bool MmapUserStore::Rebuild() {
+    struct stat logStat = {};
+    fstat(m_logfd, &logStat);
+    std::vector<char> data(logStat.st_size);
+    size_t total = 0;
+    while(total < data.size()) {
+        ssize_t n = pread(m_logfd, data.data() + total, data.size() - total, total);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) break;
+        total += n;
+    }
+
+    size_t off = 0;
+    while(off + sizeof(LogRecord) <= total) {
+        LogRecord rec;
+        memcpy(&rec, data.data() + off, sizeof(rec));
+        const char* payload = data.data() + off + sizeof(rec);
+        size_t len = sizeof(rec) + rec.nlen + rec.plen;
+        if(rec.nlen == 0 || rec.nlen > NAME_MAX_LEN || rec.plen > PWD_MAX_LEN
+            || off + len > total || Checksum(rec, payload) != rec.checksum) {
+            break;
+        }
+        uint32_t hash = Hash(payload, rec.nlen);
+        if(Probe(payload, rec.nlen, hash)->hash == 0) {
+            if((m_header->count + 1) * 10 > m_header->capacity * 7 && !Grow()) {
+                return false;
+            }
+            PutSlot(payload, rec.nlen, payload + rec.nlen, rec.plen);
+        }
+        off += len;
+    }
+    if(off != static_cast<size_t>(logStat.st_size)) {
+        LOG_WARN("MmapUserStore: truncate torn log tail at %lu", (unsigned long)off);
+        if(ftruncate(m_logfd, off) < 0) {
+            return false;
+        }
+    }
+    m_header->logoffset = off;
+    return true;
+}
+
+//容量翻倍后重新插入 过程中崩溃的话clean为0 下次启动从日志重建
+bool MmapUserStore::Grow() {
+    size_t capacity = m_header->capacity;
+    uint64_t logoffset = m_header->logoffset;
+    std::vector<Slot> used;
+    used.reserve(m_header->count);
+    for(size_t i = 0; i < capacity; i++) {
+        if(m_table[i].hash != 0) {
+            used.push_back(m_table[i]);
+        }
+    }
+    if(!MapTable(capacity * 2, true)) {
+        return false;
+    }
+    m_header->logoffset = logoffset;
+    for(auto& slot: used) {
+        PutSlot(slot.name, slot.nlen, slot.pwd, slot.plen);
+    }
+    return true;
+}
+
+MmapUserStore::Slot* MmapUserStore::Probe(const char* name, size_t nlen, uint32_t hash) const {
+    size_t mask = m_header->capacity - 1;
+    for(size_t i = hash & mask; ; i = (i + 1) & mask) {
+        Slot* slot = &m_table[i];
+        if(slot->hash == 0) {
+            return slot;
+        }
+        if(slot->hash == hash && slot->nlen == nlen && memcmp(slot->name, name, nlen) == 0) {
+            return slot;
+        }
+    }
+}
+
+void MmapUserStore::PutSlot(const char* name, size_t nlen, const char* pwd, size_t plen) {
+    uint32_t hash = Hash(name, nlen);
+    Slot* slot = Probe(name, nlen, hash);
+    assert(slot->hash == 0);
+    memcpy(slot->name, name, nlen);
+    memcpy(slot->pwd, pwd, plen);
+    slot->nlen = nlen;
+    slot->plen = plen;
+    slot->hash = hash;
+    m_header->count++;
+}
+
+bool MmapUserStore::AppendLog(const std::string& name, const std::string& pwd) {
+    char record[sizeof(LogRecord) + NAME_MAX_LEN + PWD_MAX_LEN];
+    LogRecord rec;
+    rec.nlen = name.size();
+    rec.plen = pwd.size();
+    memcpy(record + sizeof(rec), name.data(), name.size());
+    memcpy(record + sizeof(rec) + name.size(), pwd.data(), pwd.size());
+    rec.checksum = Checksum(rec, record + sizeof(rec));
+    memcpy(record, &rec, sizeof(rec));
+
+    size_t len = sizeof(rec) + name.size() + pwd.size();
+    size_t done = 0;
+    while(done < len) {
+        ssize_t n = write(m_logfd, record + done, len - done);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) {
+            LOG_ERROR("MmapUserStore: append log failed, errno %d", errno);
+            if(ftruncate(m_logfd, m_header->logoffset) < 0) {
+                LOG_ERROR("MmapUserStore: rollback log failed, errno %d", errno);
+            }
+            return false;
+        }
+        done += n;
+    }
+    if(m_sync && fdatasync(m_logfd) < 0) {
+        LOG_ERROR("MmapUserStore: fdatasync failed, errno %d", errno);
+        return false;
+    }
+    m_header->logoffset += len;
+    return true;
+}
+
+bool MmapUserStore::Find(const std::string& name, std::string& pwd) {
+    if(name.empty() || name.size() > NAME_MAX_LEN) return false;
+    std::shared_lock<std::shared_mutex> lck(m_mtx);
+    if(!m_table) return false;
+    Slot* slot = Probe(name.data(), name.size(), Hash(name.data(), name.size()));
+    if(slot->hash == 0) {
+        return false;
+    }
+    pwd.assign(slot->pwd, slot->plen);
+    return true;
+}
+
+bool MmapUserStore::Insert(const std::string& name, const std::string& pwd) {
+    if(name.empty() || name.size() > NAME_MAX_LEN || pwd.size() > PWD_MAX_LEN) {
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> lck(m_mtx);
+    if(!m_table) return false;
+    uint32_t hash = Hash(name.data(), name.size());
+    if(Probe(name.data(), name.size(), hash)->hash != 0) {
+        return false; //用户名已被使用
+    }
+    if((m_header->count + 1) * 10 > m_header->capacity * 7 && !Grow()) {
+        return false;
+    }
+    if(!AppendLog(name, pwd)) {
+        return false;
+    }
+    PutSlot(name.data(), name.size(), pwd.data(), pwd.size());
+    return true;
+}
@@ -0,0 +1,86 @@
+#ifndef __MMAPUSERSTORE_HPP
+#define __MMAPUSERSTORE_HPP
+
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include "userstore.hpp"
+
+/*
+进程内的用户存储 不依赖数据库
+dir/users.idx: mmap映射的开放寻址哈希表(线性探测) 查询只访问内存
+dir/users.log: 追加写日志 每次Insert先写日志再改表 日志是唯一可信来源
+正常关闭时表头标记clean 启动时表头不干净或与日志长度不符就从日志整体重建
+*/
+class MmapUserStore : public UserStore {
+public:
+    static const size_t NAME_MAX_LEN = 60;
+    static const size_t PWD_MAX_LEN = 60;
+
+    //syncEveryInsert为true时每次插入后fdatasync日志
+    explicit MmapUserStore(const std::string& dir, size_t initCapacity = 1024, bool syncEveryInsert = false);
+    ~MmapUserStore() override;
+
+    bool IsOpen() const { return m_table != nullptr; }
+    size_t Count() const;
+
+    bool Find(const std::string& name, std::string& pwd) override;
+    bool Insert(const std::string& name, const std::string& pwd) override;
+    bool IsBlocking() const override { return false; } //只访问内存
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t capacity;
+        uint64_t count;
+        uint64_t logoffset; //已经反映到表中的日志长度
+        uint32_t clean; //正常关闭时置1
+        char pad[28];
+    };
+
+    struct Slot {
+        uint32_t hash; //0表示空槽
+        uint8_t nlen;
+        uint8_t plen;
+        uint16_t pad;
+        char name[NAME_MAX_LEN];
+        char pwd[PWD_MAX_LEN];
+    };
+
+    struct LogRecord {
+        uint32_t checksum; //覆盖nlen plen和负载 用于识别写了一半的尾记录
+        uint8_t nlen;
+        uint8_t plen;
+    };
+
+    static const uint32_t MAGIC = 0x55534552; // "USER"
+    static const uint32_t VERSION = 1;
+
+    static uint32_t Hash(const char* s, size_t len);
+    static uint32_t Checksum(const LogRecord& rec, const char* payload);
+
+    bool MapTable(size_t capacity, bool reset);
+    void UnmapTable();
+    bool Rebuild();
+    bool Grow();
+
+    //不加锁 调用者持有写锁
+    Slot* Probe(const char* name, size_t nlen, uint32_t hash) const;
+    void PutSlot(const char* name, size_t nlen, const char* pwd, size_t plen);
+    bool AppendLog(const std::string& name, const std::string& pwd);
+
+    std::string m_dir;
+    int m_idxfd;
+    int m_logfd;
+    bool m_sync;
+
+    Header* m_header;
+    Slot* m_table;
+    size_t m_mapsize;
+
+    mutable std::shared_mutex m_mtx;
+};
+
+
+#endif
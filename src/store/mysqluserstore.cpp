@@ -0,0 +1,69 @@
+#include "mysqluserstore.hpp"
+#include "../pool/sqlconnRAII.hpp"
+#include <cstdio>
+
+MysqlUserStore::MysqlUserStore(SqlConnPool* connpool): m_connpool(connpool) {
+    assert(m_connpool);
+}
+
+std::string MysqlUserStore::Escape(MYSQL* sql, const std::string& str) {
+    std::string out(str.size() * 2 + 1, '\0');
+    unsigned long n = mysql_real_escape_string(sql, &out[0], str.data(), str.size());
+    out.resize(n);
+    return out;
+}
+
+bool MysqlUserStore::Find(const std::string& name, std::string& pwd) {
+    MYSQL* sql = nullptr;
+    SqlConnRAII raii(&sql, m_connpool);
+    if(!sql) {
+        LOG_WARN("MysqlUserStore: no free connection");
+        return false;
+    }
+    return Lookup(sql, name, &pwd);
+}
+
+bool MysqlUserStore::Lookup(MYSQL* sql, const std::string& name, std::string* pwd) {
+    std::string order = "SELECT username, password FROM user WHERE username='"
+                        + Escape(sql, name) + "' LIMIT 1";
+    LOG_DEBUG("%s", order.c_str());
+    if(mysql_query(sql, order.c_str())) { //Zero for success. Nonzero if an error occurred.
+        LOG_ERROR("MySQL query error: %s", mysql_error(sql));
+        return false;
+    }
+    MYSQL_RES* res = mysql_store_result(sql);
+    if(!res) {
+        return false;
+    }
+    bool found = false;
+    if(MYSQL_ROW row = mysql_fetch_row(res)) {
+        LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
+        if(pwd) *pwd = row[1] ? row[1] : "";
+        found = true;
+    }
+    mysql_free_result(res);
+    return found;
+}
+
+bool MysqlUserStore::Insert(const std::string& name, const std::string& pwd) {
+    MYSQL* sql = nullptr;
+    SqlConnRAII raii(&sql, m_connpool);
+    if(!sql) {
+        LOG_WARN("MysqlUserStore: no free connection");
+        return false;
+    }
+    //默认的user表没有唯一键 先查一遍 用户名已存在就不插
+    if(Lookup(sql, name, nullptr)) {
+        LOG_DEBUG("user %s exists", name.c_str());
+        return false;
+    }
+
+    std::string order = "INSERT INTO user(username, password) VALUES('"
+                        + Escape(sql, name) + "','" + Escape(sql, pwd) + "')";
+    LOG_DEBUG("%s", order.c_str());
+    if(mysql_query(sql, order.c_str())) {
+        LOG_DEBUG("Insert error: %s", mysql_error(sql));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,26 @@
+#ifndef __MYSQLUSERSTORE_HPP
+#define __MYSQLUSERSTORE_HPP
+
+#include "userstore.hpp"
+#include "../pool/sqlconnpool.hpp"
+
+//基于SqlConnPool的用户存储 表结构 user(username, password)
+class MysqlUserStore : public UserStore {
+public:
+    explicit MysqlUserStore(SqlConnPool* connpool = SqlConnPool::Instance());
+    ~MysqlUserStore() override = default;
+
+    bool Find(const std::string& name, std::string& pwd) override;
+    bool Insert(const std::string& name, const std::string& pwd) override;
+
+private:
+    //转义字符串 防止拼接sql时注入
+    static std::string Escape(MYSQL* sql, const std::string& str);
+    //用已经拿到的连接查用户 pwd可以为空
+    static bool Lookup(MYSQL* sql, const std::string& name, std::string* pwd);
+
+    SqlConnPool* m_connpool;
+};
+
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef __USERSTORE_HPP
+#define __USERSTORE_HPP
+
+#include <string>
+
+//用户存储接口 UserVerify只依赖这个接口
+class UserStore {
+public:
+    virtual ~UserStore() = default;
+
+    //查询用户 找到则把密码写入pwd并返回true
+    virtual bool Find(const std::string& name, std::string& pwd) = 0;
+
+    //插入新用户 用户名已存在或写入失败返回false
+    virtual bool Insert(const std::string& name, const std::string& pwd) = 0;
+
+    //Find/Insert是否可能阻塞(网络/磁盘) 阻塞的实现要放到线程池里调用
+    virtual bool IsBlocking() const { return true; }
+};
+
+
+#endif
@@ -0,0 +1,124 @@
+#include "timerwheel.hpp"
+#include <ctime>
+
+static void InitHead(TimerNode* head) {
+    head->prev = head->next = head;
+}
+
+TimerWheel::TimerWheel(uint32_t tickMS): m_tickms(tickMS ? tickMS : 1), m_current(0), m_size(0) {
+    m_current = NowTick();
+    for(auto& head: m_level0) InitHead(&head);
+    for(auto& level: m_levels) {
+        for(auto& head: level) InitHead(&head);
+    }
+}
+
+uint64_t TimerWheel::NowMS() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+void TimerWheel::Schedule(TimerNode* node, uint32_t timeoutMS) {
+    //从当前时间算起并向上取整 不会提前到期 m_current可能因为长时间阻塞等待而落后
+    uint64_t deadline = (NowMS() + timeoutMS + m_tickms - 1) / m_tickms;
+    if(deadline <= m_current) deadline = m_current + 1;
+    if(node->IsLinked()) {
+        node->deadline = deadline;
+        if(deadline >= node->expire) {
+            return; //续期 到了原来的槽再挪
+        }
+        Unlink(node); //提前了 需要马上换槽
+    }else {
+        m_size++;
+        node->deadline = deadline;
+    }
+    Link(node, deadline);
+}
+
+void TimerWheel::Cancel(TimerNode* node) {
+    if(node->IsLinked()) {
+        Unlink(node);
+        m_size--;
+    }
+}
+
+void TimerWheel::Link(TimerNode* node, uint64_t expire) {
+    uint64_t delta = expire - m_current;
+    if(delta > MAX_TICKS) {
+        delta = MAX_TICKS;
+        expire = m_current + delta;
+    }
+    TimerNode* head;
+    if(delta < LEVEL0_SIZE) {
+        head = &m_level0[expire & LEVEL0_MASK];
+    }else {
+        unsigned level = 0;
+        unsigned shift = LEVEL0_BITS;
+        while(level + 1 < LEVELS && delta >= (1ull << (shift + LEVEL_BITS))) {
+            level++;
+            shift += LEVEL_BITS;
+        }
+        head = &m_levels[level][(expire >> shift) & LEVEL_MASK];
+    }
+    node->expire = expire;
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void TimerWheel::Unlink(TimerNode* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = nullptr;
+}
+
+void TimerWheel::Splice(TimerNode* from, TimerNode* to) {
+    if(from->next == from) {
+        InitHead(to);
+        return;
+    }
+    to->next = from->next;
+    to->prev = from->prev;
+    to->next->prev = to;
+    to->prev->next = to;
+    InitHead(from);
+}
+
+void TimerWheel::Cascade() {
+    unsigned shift = LEVEL0_BITS;
+    for(unsigned level = 0; level < LEVELS; level++) {
+        unsigned idx = (m_current >> shift) & LEVEL_MASK;
+        TimerNode pending;
+        Splice(&m_levels[level][idx], &pending);
+        while(pending.next != &pending) {
+            TimerNode* node = pending.next;
+            Unlink(node);
+            Link(node, node->expire);
+        }
+        //这一层也转完一圈才继续往上
+        if(idx != 0) break;
+        shift += LEVEL_BITS;
+    }
+}
+
+int TimerWheel::NextTimeoutMS() const {
+    if(m_size == 0) {
+        return -1;
+    }
+    const uint64_t now = NowMS();
+    const uint64_t base = m_current * m_tickms;
+    //第0层里最近的非空槽 没有就等到第0层转完一圈(下次Cascade)
+    uint64_t ticks = LEVEL0_SIZE - (m_current & LEVEL0_MASK);
+    for(unsigned i = 1; i < LEVEL0_SIZE; i++) {
+        const TimerNode& head = m_level0[(m_current + i) & LEVEL0_MASK];
+        if(head.next != &head) {
+            ticks = i;
+            break;
+        }
+        if(((m_current + i) & LEVEL0_MASK) == 0) break;
+    }
+    const uint64_t at = base + ticks * m_tickms;
+    return at > now ? static_cast<int>(at - now) : 0;
+}
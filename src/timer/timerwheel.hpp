@@ -0,0 +1,104 @@
+#ifndef __TIMERWHEEL_HPP
+#define __TIMERWHEEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+//侵入式定时器节点 嵌在连接对象里 不需要单独分配
+struct TimerNode {
+    TimerNode* prev = nullptr;
+    TimerNode* next = nullptr;
+    uint64_t expire = 0; //挂在哪个tick的槽里
+    uint64_t deadline = 0; //真正的到期tick 只会晚于等于expire 到了expire再按它重新挂
+    void* data = nullptr;
+
+    bool IsLinked() const { return prev != nullptr; }
+};
+
+/*
+分层时间轮 只在一个线程(reactor)里使用
+第0层256个槽 每槽一个tick 往上每层64个槽 每槽是下一层转一圈的时间 共4层
+Schedule/Cancel都是O(1)的链表操作 活动时重新计时只改deadline不动链表(惰性续期)
+到期时整个槽一次摘下来处理 deadline被推后的节点重新挂到新位置
+*/
+class TimerWheel {
+public:
+    explicit TimerWheel(uint32_t tickMS = 100);
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    //设置或重置定时器 timeoutMS后到期
+    void Schedule(TimerNode* node, uint32_t timeoutMS);
+
+    void Cancel(TimerNode* node);
+
+    //推进到当前时间 对每个到期节点调用expire(node) 回调里可以Schedule/Cancel任意节点
+    template<class F>
+    size_t Advance(F&& expire) {
+        const uint64_t target = NowTick();
+        size_t count = 0;
+        while(m_current < target) {
+            m_current++;
+            const unsigned idx = m_current & LEVEL0_MASK;
+            if(idx == 0) {
+                Cascade();
+            }
+            //整个槽摘下来 逐个处理
+            TimerNode& head = m_level0[idx];
+            if(head.next == &head) continue;
+            TimerNode pending;
+            Splice(&head, &pending);
+            while(pending.next != &pending) {
+                TimerNode* node = pending.next;
+                Unlink(node);
+                if(node->deadline > m_current) {
+                    Link(node, node->deadline); //期间被续期过
+                    continue;
+                }
+                m_size--;
+                count++;
+                expire(node);
+            }
+        }
+        return count;
+    }
+
+    //距离下一个可能到期的tick还有多少毫秒 没有定时器返回-1 给epoll_wait/io_uring_enter当超时用
+    int NextTimeoutMS() const;
+
+    size_t Size() const { return m_size; }
+
+    uint32_t TickMS() const { return m_tickms; }
+
+    //单调时钟毫秒数 用粗粒度时钟 足够定时器用
+    static uint64_t NowMS();
+
+private:
+    static const unsigned LEVEL0_BITS = 8;
+    static const unsigned LEVEL_BITS = 6;
+    static const unsigned LEVELS = 3; //第0层之外的层数
+    static const unsigned LEVEL0_SIZE = 1u << LEVEL0_BITS;
+    static const unsigned LEVEL_SIZE = 1u << LEVEL_BITS;
+    static const unsigned LEVEL0_MASK = LEVEL0_SIZE - 1;
+    static const unsigned LEVEL_MASK = LEVEL_SIZE - 1;
+    static const uint64_t MAX_TICKS = (1ull << (LEVEL0_BITS + LEVELS * LEVEL_BITS)) - 1;
+
+    uint64_t NowTick() const { return NowMS() / m_tickms; }
+
+    //按到期tick放进对应层的槽
+    void Link(TimerNode* node, uint64_t expire);
+    static void Unlink(TimerNode* node);
+    static void Splice(TimerNode* from, TimerNode* to);
+
+    //第0层转完一圈 把上一层当前槽里的节点重新分配下来
+    void Cascade();
+
+    uint32_t m_tickms;
+    uint64_t m_current;
+    size_t m_size;
+    TimerNode m_level0[LEVEL0_SIZE];
+    TimerNode m_levels[LEVELS][LEVEL_SIZE];
+};
+
+
+#endif
@@ -0,0 +1,122 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "../log/log.hpp"
+
+Tracer* Tracer::Instance() {
+    static Tracer tracer;
+    return &tracer;
+}
+
+Tracer::~Tracer() {
+    Close();
+}
+
+bool Tracer::Init(const std::string& name, size_t slots, int sampleEvery) {
+    Close();
+    if(sampleEvery <= 0) {
+        return true;
+    }
+    size_t count = 1;
+    while(count < slots) count <<= 1;
+    size_t len = sizeof(TraceRingHeader) + count * sizeof(TraceSlot);
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if(fd < 0) {
+        LOG_ERROR("Tracer: shm_open %s error: %d", name.c_str(), errno);
+        return false;
+    }
+    if(ftruncate(fd, len) < 0) {
+        LOG_ERROR("Tracer: ftruncate %s error: %d", name.c_str(), errno);
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    void* addr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED) {
+        LOG_ERROR("Tracer: mmap %s error: %d", name.c_str(), errno);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    //新建的共享内存全是0 头部最后写magic 读的一方看到magic时其他字段已经就绪
+    m_header = static_cast<TraceRingHeader*>(addr);
+    m_header->recordSize = sizeof(TraceRecord);
+    m_header->slots = count;
+    m_slots = reinterpret_cast<TraceSlot*>(static_cast<char*>(addr) + sizeof(TraceRingHeader));
+    m_mask = count - 1;
+    m_maplen = len;
+    m_name = name;
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(m_header->magic, TraceRingHeader::MAGIC, sizeof(m_header->magic));
+    m_every.store(sampleEvery, std::memory_order_release);
+    LOG_INFO("Tracer: %s, %zu slots, sample 1/%d", name.c_str(), count, sampleEvery);
+    return true;
+}
+
+void Tracer::Close() {
+    //调用时各reactor应该已经停了
+    m_every.store(0, std::memory_order_release);
+    if(m_header) {
+        munmap(m_header, m_maplen);
+        shm_unlink(m_name.c_str());
+        m_header = nullptr;
+        m_slots = nullptr;
+    }
+}
+
+bool Tracer::Sample() {
+    static thread_local int countdown = 0;
+    int every = m_every.load(std::memory_order_relaxed);
+    if(every <= 0) {
+        return false;
+    }
+    if(--countdown > 0) {
+        return false;
+    }
+    countdown = every;
+    return true;
+}
+
+void Tracer::Submit(const TraceRecord& rec) {
+    if(!m_slots) return;
+    uint64_t pos = m_header->head.fetch_add(1, std::memory_order_relaxed);
+    TraceSlot& slot = m_slots[pos & m_mask];
+    slot.seq.store(pos * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&slot.rec, &rec, sizeof(rec));
+    slot.seq.store(pos * 2 + 2, std::memory_order_release);
+}
+
+void RequestTrace::Begin(uint64_t id) {
+    if(m_state != IDLE) return;
+    if(!Tracer::Instance()->Sample()) {
+        m_state = SKIPPED;
+        return;
+    }
+    m_state = ACTIVE;
+    m_rec.id = id;
+    m_rec.startns = Tracer::NowNS();
+    for(auto& at: m_rec.at) {
+        at = TraceRecord::UNSET;
+    }
+    m_rec.at[TP_START] = 0;
+    m_rec.code = 0;
+    m_rec.pad = 0;
+    m_rec.bytes = 0;
+}
+
+void RequestTrace::End(int code, const std::string& path) {
+    if(m_state == ACTIVE) {
+        Mark(TP_WRITE_END);
+        m_rec.code = static_cast<uint16_t>(code);
+        size_t len = std::min(path.size(), sizeof(m_rec.path) - 1);
+        memcpy(m_rec.path, path.data(), len);
+        m_rec.path[len] = '\0';
+        Tracer::Instance()->Submit(m_rec);
+    }
+    m_state = IDLE;
+}
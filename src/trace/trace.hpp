@@ -0,0 +1,153 @@
+#ifndef __TRACE_HPP
+#define __TRACE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <time.h>
+
+/*
+请求的分阶段耗时追踪
+每个连接带一个RequestTrace 按采样率选中的请求在各个阶段记下单调时钟时间 响应写完后整条记录写进共享内存环
+tools/tracedump读这个环 输出每个阶段的分位数 最近的请求 或者给flamegraph.pl用的折叠栈
+同样的位置还有USDT探针(provider为webserver) 编译时有<sys/sdt.h>才生效 没人attach时只是一条nop
+没有sys/sdt.h或者定义了NO_USDT时探针宏为空
+*/
+
+#if defined(__has_include) && !defined(NO_USDT)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TRACE_HAS_USDT 1
+#endif
+#endif
+
+#ifdef TRACE_HAS_USDT
+#define TRACE_PROBE1(name, a) DTRACE_PROBE1(webserver, name, a)
+#define TRACE_PROBE2(name, a, b) DTRACE_PROBE2(webserver, name, a, b)
+#else
+#define TRACE_PROBE1(name, a) do { (void)(a); } while(0)
+#define TRACE_PROBE2(name, a, b) do { (void)(a); (void)(b); } while(0)
+#endif
+
+//探针和采样记录打在同一个点上
+#define TRACE_MARK(trace, point, probe, id) do { TRACE_PROBE1(probe, id); (trace).Mark(point); } while(0)
+
+enum TRACE_POINT {
+    TP_START, //这个请求第一次解析(数据已经到了)
+    TP_PARSED, //请求完整
+    TP_VERIFY_BEGIN, //开始查用户存储(可能要排队等线程池)
+    TP_VERIFY_END,
+    TP_OPEN_BEGIN, //io_uring异步statx/openat
+    TP_BUILD_BEGIN, //生成响应 包括stat/open
+    TP_MMAP_BEGIN,
+    TP_MMAP_END,
+    TP_BUILD_END,
+    TP_WRITE_END, //响应全部写进socket
+    TP_COUNT
+};
+
+//共享内存里的一条记录 tracedump按同样的布局读
+struct TraceRecord {
+    static const uint32_t UNSET = 0xFFFFFFFF;
+
+    uint64_t id; //连接句柄
+    uint64_t startns; //TP_START时的CLOCK_MONOTONIC
+    uint32_t at[TP_COUNT]; //相对startns的纳秒 UNSET表示没经过这个点
+    uint16_t code;
+    uint16_t pad;
+    uint32_t bytes; //响应长度
+    char path[48];
+};
+
+//环的头部 后面紧跟slots个TraceSlot
+struct TraceRingHeader {
+    static constexpr char MAGIC[8] = {'T', 'W', 'S', 'T', 'R', 'C', '0', '1'};
+
+    char magic[8];
+    uint32_t recordSize;
+    uint32_t pad;
+    uint64_t slots; //2的幂
+    alignas(64) std::atomic<uint64_t> head; //已经分配出去的记录数
+};
+
+//seq为奇数时正在写 读的一方读前读后seq一致才算读到完整记录
+struct alignas(64) TraceSlot {
+    std::atomic<uint64_t> seq;
+    TraceRecord rec;
+};
+
+class Tracer {
+public:
+    static Tracer* Instance();
+
+    //创建共享内存环 name是shm_open的名字 slots向上取2的幂 每sampleEvery个请求采一个 0表示关闭
+    bool Init(const std::string& name, size_t slots, int sampleEvery);
+
+    //解除映射并删除共享内存
+    void Close();
+
+    //当前线程的这个请求要不要追踪
+    bool Sample();
+
+    void Submit(const TraceRecord& rec);
+
+    static uint64_t NowNS() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+
+    //按端口取的默认共享内存名 tracedump -p用同样的规则
+    static std::string DefaultName(int port) { return "/webserver-trace-" + std::to_string(port); }
+
+private:
+    Tracer(): m_every(0), m_header(nullptr), m_slots(nullptr), m_mask(0), m_maplen(0) {}
+    ~Tracer();
+
+    std::atomic<int> m_every;
+    TraceRingHeader* m_header;
+    TraceSlot* m_slots;
+    uint64_t m_mask;
+    size_t m_maplen;
+    std::string m_name;
+};
+
+//一个连接上当前请求的追踪状态 只在连接所属的reactor线程里用
+class RequestTrace {
+public:
+    RequestTrace(): m_state(IDLE) {}
+
+    //请求开始 按采样率决定这一个要不要记
+    void Begin(uint64_t id);
+
+    bool Started() const { return m_state != IDLE; }
+
+    void Mark(TRACE_POINT point) {
+        if(m_state == ACTIVE) {
+            uint64_t elapsed = Tracer::NowNS() - m_rec.startns;
+            m_rec.at[point] = elapsed < TraceRecord::UNSET ? static_cast<uint32_t>(elapsed) : TraceRecord::UNSET - 1;
+        }
+    }
+
+    //响应写完 选中的话提交记录 回到空闲等下一个请求
+    void End(int code, const std::string& path);
+
+    void SetBytes(size_t bytes) { m_rec.bytes = static_cast<uint32_t>(bytes); }
+
+    //连接关闭 丢弃没写完的请求
+    void Reset() { m_state = IDLE; }
+
+private:
+    enum STATE {
+        IDLE,
+        SKIPPED, //已开始但没被采样
+        ACTIVE
+    };
+
+    STATE m_state;
+    TraceRecord m_rec;
+};
+
+
+#endif
@@ -0,0 +1,104 @@
+/*
+二进制日志解码工具 把Log::BINARY模式写出的文件还原成文本
+用法: logdecoder file.log [file2.log ...]
+*/
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include "../src/log/logformat.hpp"
+
+static bool ReadN(FILE* fp, void* dst, size_t n) {
+    return fread(dst, 1, n, fp) == n;
+}
+
+static int Decode(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if(!fp) {
+        fprintf(stderr, "open %s failed\n", path);
+        return 1;
+    }
+    LogFileHeader header;
+    if(!ReadN(fp, &header, sizeof(header)) || memcmp(header.magic, "TWSBLOG1", 8) != 0) {
+        fprintf(stderr, "%s: not a binary log\n", path);
+        fclose(fp);
+        return 1;
+    }
+    auto toWallUs = [&](uint64_t tsc) {
+        return header.wall0 + static_cast<int64_t>(static_cast<int64_t>(tsc - header.tsc0) / header.ticksperus);
+    };
+
+    std::unordered_map<uint32_t, LogSite> sites;
+    std::string args;
+    char line[4096];
+    int type;
+    while((type = fgetc(fp)) != EOF) {
+        if(type == '\0') {
+            continue; //异常退出留下的预分配空间
+        }
+        if(type == 'T') {
+            //同一个文件重新打开时会再写一个文件头
+            char magic[7];
+            long pos = ftell(fp);
+            if(ReadN(fp, magic, 7) && memcmp(magic, "WSBLOG1", 7) == 0) {
+                if(!ReadN(fp, &header.tsc0, sizeof(header) - 8)) break;
+                continue;
+            }
+            fseek(fp, pos, SEEK_SET);
+        }
+        if(type == 'S') {
+            uint32_t ids[3];
+            uint16_t lens[3];
+            if(!ReadN(fp, ids, sizeof(ids)) || !ReadN(fp, lens, sizeof(lens))) break;
+            LogSite site;
+            site.level = ids[1];
+            site.line = ids[2];
+            site.tags.resize(lens[0]);
+            site.format.resize(lens[1]);
+            site.file.resize(lens[2]);
+            if(!ReadN(fp, site.tags.data(), lens[0]) || !ReadN(fp, &site.format[0], lens[1])
+                || !ReadN(fp, &site.file[0], lens[2])) break;
+            sites[ids[0]] = std::move(site);
+        }else if(type == 'B' || type == 'T') {
+            uint64_t tsc;
+            uint32_t level;
+            if(!ReadN(fp, &tsc, 8) || !ReadN(fp, &level, 4)) break;
+            uint32_t site = 0, len = 0;
+            if(type == 'B' && !ReadN(fp, &site, 4)) break;
+            if(!ReadN(fp, &len, 4)) break;
+            args.resize(len);
+            if(len && !ReadN(fp, &args[0], len)) break;
+
+            if(type == 'T') {
+                //文本记录在调用线程就已经格式化好了
+                fwrite(args.data(), 1, args.size(), stdout);
+                continue;
+            }
+            size_t n = LogFormat::Prefix(line, sizeof(line), toWallUs(tsc), level);
+            auto it = sites.find(site);
+            if(it == sites.end()) {
+                n += snprintf(line + n, sizeof(line) - n, "<unknown site %u>", site);
+            }else {
+                n += LogFormat::Format(it->second, args.data(), args.size(), line + n, sizeof(line) - n - 1);
+            }
+            line[n++] = '\n';
+            fwrite(line, 1, n, stdout);
+        }else {
+            fprintf(stderr, "%s: corrupted record type %d\n", path, type);
+            break;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s file.log [file2.log ...]\n", argv[0]);
+        return 1;
+    }
+    int ret = 0;
+    for(int i = 1; i < argc; i++) {
+        ret |= Decode(argv[i]);
+    }
+    return ret;
+}
@@ -0,0 +1,135 @@
+/*
+按时间范围查看日志 支持LogArchiver压缩出的.gz(带.idx时只解压范围内的块)和普通文本日志
+用法: logreader [-f "YYYY-MM-DD HH:MM:SS"] [-t "YYYY-MM-DD HH:MM:SS"] [-g 子串] file...
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+#include "../src/log/logarchiver.hpp"
+
+struct Filter {
+    uint64_t from = 0;
+    uint64_t to = UINT64_MAX;
+    const char* grep = nullptr;
+};
+
+static uint64_t ParseArgTime(const char* s) {
+    std::string line = std::string(s) + ".000000";
+    uint64_t t = LogArchiver::ParseLineTime(line.c_str(), line.size());
+    if(!t) {
+        fprintf(stderr, "bad time: %s\n", s);
+        exit(1);
+    }
+    return t;
+}
+
+//输出块里落在范围内并且匹配子串的行
+static void EmitLines(const char* data, size_t len, const Filter& filter) {
+    const char* end = data + len;
+    uint64_t last = 0; //没有时间戳的行跟随上一行
+    for(const char* p = data; p < end;) {
+        const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+        const char* next = nl ? nl + 1 : end;
+        uint64_t t = LogArchiver::ParseLineTime(p, next - p);
+        if(t) last = t;
+        if(last >= filter.from && last <= filter.to
+            && (!filter.grep || memmem(p, next - p, filter.grep, strlen(filter.grep)))) {
+            fwrite(p, 1, next - p, stdout);
+        }
+        p = next;
+    }
+}
+
+static bool Inflate(const std::vector<unsigned char>& in, size_t usize, std::string& out) {
+    z_stream zs = {};
+    if(inflateInit2(&zs, 15 + 16) != Z_OK) {
+        return false;
+    }
+    out.resize(usize);
+    zs.next_in = const_cast<unsigned char*>(in.data());
+    zs.avail_in = in.size();
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = usize;
+    int ret = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+static int ReadIndexed(const char* path, const Filter& filter) {
+    std::string idxpath = std::string(path) + ".idx";
+    FILE* idx = fopen(idxpath.c_str(), "rb");
+    FILE* gz = fopen(path, "rb");
+    char magic[8];
+    if(!idx || !gz || fread(magic, 1, 8, idx) != 8 || memcmp(magic, "TWSIDX01", 8) != 0) {
+        if(idx) fclose(idx);
+        if(gz) fclose(gz);
+        return -1;
+    }
+    LogChunkIndex entry;
+    std::vector<unsigned char> in;
+    std::string out;
+    int ret = 0;
+    while(fread(&entry, sizeof(entry), 1, idx) == 1) {
+        //有时间信息并且和范围不相交的块直接跳过
+        if(entry.firstus && (entry.lastus < filter.from || entry.firstus > filter.to)) {
+            continue;
+        }
+        in.resize(entry.csize);
+        if(fseek(gz, entry.offset, SEEK_SET) != 0 || fread(in.data(), 1, in.size(), gz) != in.size()
+            || !Inflate(in, entry.usize, out)) {
+            fprintf(stderr, "%s: corrupted chunk at %lu\n", path, (unsigned long)entry.offset);
+            ret = 1;
+            break;
+        }
+        EmitLines(out.data(), out.size(), filter);
+    }
+    fclose(idx);
+    fclose(gz);
+    return ret;
+}
+
+//没有索引的文件整体读 gzopen对普通文件也能透明读取
+static int ReadWhole(const char* path, const Filter& filter) {
+    gzFile fp = gzopen(path, "rb");
+    if(!fp) {
+        fprintf(stderr, "open %s failed\n", path);
+        return 1;
+    }
+    std::string data;
+    char buf[1 << 16];
+    int n;
+    while((n = gzread(fp, buf, sizeof(buf))) > 0) {
+        data.append(buf, n);
+    }
+    gzclose(fp);
+    EmitLines(data.data(), data.size(), filter);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    Filter filter;
+    int opt;
+    while((opt = getopt(argc, argv, "f:t:g:")) != -1) {
+        switch(opt) {
+        case 'f': filter.from = ParseArgTime(optarg); break;
+        case 't': filter.to = ParseArgTime(optarg) + 999999; break;
+        case 'g': filter.grep = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-f from] [-t to] [-g pattern] file...\n", argv[0]);
+            return 1;
+        }
+    }
+    int ret = 0;
+    for(int i = optind; i < argc; i++) {
+        int r = ReadIndexed(argv[i], filter);
+        if(r < 0) {
+            r = ReadWhole(argv[i], filter);
+        }
+        ret |= r;
+    }
+    return ret;
+}
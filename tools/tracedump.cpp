@@ -0,0 +1,190 @@
+/*
+读服务器的请求追踪环(-x打开) 按阶段拆开每个请求的耗时
+默认输出每个阶段的次数 平均值和分位数; -l N 列出最近N个请求; -f 输出折叠栈 可以直接交给flamegraph.pl
+折叠栈的权重是微秒 同一个请求里没有归到任何阶段的时间记为wait(在epoll/io_uring里等数据或者等可写)
+用法: tracedump [-p port | -n shmname] [-l N] [-f]
+*/
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "../src/trace/trace.hpp"
+
+//一个阶段的起止点 parent是包含它的阶段在STAGES里的下标
+struct Stage {
+    const char* name;
+    const char* stack; //折叠栈里的路径
+    TRACE_POINT from, to;
+    int parent;
+};
+
+static const Stage STAGES[] = {
+    {"parse", "request;parse", TP_START, TP_PARSED, -1},
+    {"verify", "request;verify", TP_VERIFY_BEGIN, TP_VERIFY_END, -1},
+    {"open", "request;open", TP_OPEN_BEGIN, TP_BUILD_BEGIN, -1},
+    {"build", "request;build", TP_BUILD_BEGIN, TP_BUILD_END, -1},
+    {"mmap", "request;build;mmap", TP_MMAP_BEGIN, TP_MMAP_END, 3},
+    {"write", "request;write", TP_BUILD_END, TP_WRITE_END, -1},
+};
+static const size_t STAGE_COUNT = sizeof(STAGES) / sizeof(STAGES[0]);
+
+static bool Span(const TraceRecord& rec, const Stage& stage, uint32_t* ns) {
+    uint32_t from = rec.at[stage.from], to = rec.at[stage.to];
+    if(from == TraceRecord::UNSET || to == TraceRecord::UNSET || to < from) {
+        return false;
+    }
+    *ns = to - from;
+    return true;
+}
+
+//按seq从旧到新读出环里所有完整的记录
+static std::vector<TraceRecord> ReadRing(const TraceRingHeader* header) {
+    const TraceSlot* slots = reinterpret_cast<const TraceSlot*>(reinterpret_cast<const char*>(header) + sizeof(TraceRingHeader));
+    uint64_t head = header->head.load(std::memory_order_acquire);
+    uint64_t begin = head > header->slots ? head - header->slots : 0;
+    std::vector<TraceRecord> records;
+    for(uint64_t pos = begin; pos < head; pos++) {
+        const TraceSlot& slot = slots[pos & (header->slots - 1)];
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        if(seq != pos * 2 + 2) continue; //还在写或者已经被覆盖
+        TraceRecord rec;
+        memcpy(&rec, &slot.rec, sizeof(rec));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(slot.seq.load(std::memory_order_relaxed) != seq) continue;
+        records.push_back(rec);
+    }
+    return records;
+}
+
+static uint32_t Percentile(std::vector<uint32_t>& v, double q) {
+    size_t idx = std::min(v.size() - 1, static_cast<size_t>(q * v.size()));
+    std::nth_element(v.begin(), v.begin() + idx, v.end());
+    return v[idx];
+}
+
+static void Summary(const std::vector<TraceRecord>& records) {
+    printf("%zu requests\n", records.size());
+    printf("%-8s %8s %10s %10s %10s %10s\n", "stage", "count", "mean(us)", "p50(us)", "p99(us)", "max(us)");
+    std::vector<uint32_t> values;
+    auto print = [&](const char* name) {
+        if(values.empty()) return;
+        double sum = 0;
+        for(uint32_t v: values) sum += v;
+        uint32_t max = *std::max_element(values.begin(), values.end());
+        size_t n = values.size();
+        uint32_t p50 = Percentile(values, 0.5), p99 = Percentile(values, 0.99);
+        printf("%-8s %8zu %10.1f %10.1f %10.1f %10.1f\n", name, n, sum / n / 1000, p50 / 1000.0, p99 / 1000.0, max / 1000.0);
+    };
+    for(auto& stage: STAGES) {
+        values.clear();
+        uint32_t ns;
+        for(auto& rec: records) {
+            if(Span(rec, stage, &ns)) values.push_back(ns);
+        }
+        print(stage.name);
+    }
+    values.clear();
+    for(auto& rec: records) {
+        if(rec.at[TP_WRITE_END] != TraceRecord::UNSET) values.push_back(rec.at[TP_WRITE_END]);
+    }
+    print("total");
+}
+
+static void List(const std::vector<TraceRecord>& records, size_t n) {
+    printf("%-16s %4s %8s %9s", "id", "code", "bytes", "total(us)");
+    for(auto& stage: STAGES) printf(" %8s", stage.name);
+    printf("  path\n");
+    for(size_t i = records.size() > n ? records.size() - n : 0; i < records.size(); i++) {
+        const TraceRecord& rec = records[i];
+        printf("%-16llx %4u %8u %9.1f", (unsigned long long)rec.id, rec.code, rec.bytes,
+               rec.at[TP_WRITE_END] == TraceRecord::UNSET ? 0.0 : rec.at[TP_WRITE_END] / 1000.0);
+        for(auto& stage: STAGES) {
+            uint32_t ns;
+            if(Span(rec, stage, &ns)) printf(" %8.1f", ns / 1000.0);
+            else printf(" %8s", "-");
+        }
+        printf("  %.*s\n", (int)sizeof(rec.path), rec.path);
+    }
+}
+
+//内层阶段的时间从外层里扣掉 剩下的是外层自己的时间
+static void Folded(const std::vector<TraceRecord>& records) {
+    std::map<std::string, double> weights;
+    for(auto& rec: records) {
+        if(rec.at[TP_WRITE_END] == TraceRecord::UNSET) continue;
+        double self[STAGE_COUNT];
+        double accounted = 0;
+        for(size_t i = 0; i < STAGE_COUNT; i++) {
+            uint32_t ns;
+            self[i] = Span(rec, STAGES[i], &ns) ? static_cast<double>(ns) : -1;
+            if(self[i] >= 0 && STAGES[i].parent < 0) accounted += self[i];
+        }
+        for(size_t i = 0; i < STAGE_COUNT; i++) {
+            if(self[i] >= 0 && STAGES[i].parent >= 0) self[STAGES[i].parent] -= self[i];
+        }
+        for(size_t i = 0; i < STAGE_COUNT; i++) {
+            if(self[i] >= 0) weights[STAGES[i].stack] += self[i] / 1000.0;
+        }
+        double total = rec.at[TP_WRITE_END];
+        if(total > accounted) {
+            weights["request;wait"] += (total - accounted) / 1000.0;
+        }
+    }
+    for(auto& kv: weights) {
+        printf("%s %.0f\n", kv.first.c_str(), kv.second);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string name = Tracer::DefaultName(1316);
+    size_t list = 0;
+    bool folded = false;
+    int opt;
+    while((opt = getopt(argc, argv, "p:n:l:f")) != -1) {
+        switch(opt) {
+            case 'p': name = Tracer::DefaultName(atoi(optarg)); break;
+            case 'n': name = optarg; break;
+            case 'l': list = strtoul(optarg, nullptr, 10); break;
+            case 'f': folded = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-p port | -n shmname] [-l N] [-f]\n", argv[0]);
+                return 1;
+        }
+    }
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if(fd < 0) {
+        fprintf(stderr, "cannot open %s (is the server running with -x?)\n", name.c_str());
+        return 1;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED || static_cast<size_t>(st.st_size) < sizeof(TraceRingHeader)) {
+        fprintf(stderr, "cannot map %s\n", name.c_str());
+        return 1;
+    }
+    const TraceRingHeader* header = static_cast<const TraceRingHeader*>(addr);
+    if(memcmp(header->magic, TraceRingHeader::MAGIC, sizeof(header->magic)) != 0 || header->recordSize != sizeof(TraceRecord)
+       || sizeof(TraceRingHeader) + header->slots * sizeof(TraceSlot) > static_cast<size_t>(st.st_size)) {
+        fprintf(stderr, "%s is not a trace ring of this version\n", name.c_str());
+        return 1;
+    }
+    std::vector<TraceRecord> records = ReadRing(header);
+    if(folded) {
+        Folded(records);
+    }else if(list > 0) {
+        List(records, list);
+    }else {
+        Summary(records);
+    }
+    munmap(addr, st.st_size);
+    return 0;
+}